@@ -0,0 +1,78 @@
+/**
+ * @file assignment.h
+ * @brief Optimal (minimum cost) assignment of rows to columns.
+ */
+
+#ifndef _PICOPTERX_ASSIGNMENT_H
+#define _PICOPTERX_ASSIGNMENT_H
+
+#include <vector>
+
+namespace picopter {
+    /**
+     * Solves the (rectangular) assignment problem: pairs rows with columns so
+     * that as many pairs as possible are made, at the least total cost.
+     * Only the pairs that are set are allowed, so a gated cost matrix can be
+     * given sparsely. Rows and columns with no allowed pairs never enter
+     * the solver.
+     *
+     * The buffers are kept between problems, so once they have grown to the
+     * largest problem seen, solving doesn't allocate.
+     */
+    class Assignment {
+        public:
+            Assignment();
+
+            void Reset(size_t rows, size_t cols);
+            void Set(size_t row, size_t col, double cost);
+            size_t Solve();
+
+            /**
+             * Retrieves the column a row was assigned to.
+             * @param [in] row The row.
+             * @return The column, or -1 if the row is unassigned.
+             */
+            int RowMatch(size_t row) const { return m_row_match[row]; }
+            /**
+             * Retrieves the row a column was assigned to.
+             * @param [in] col The column.
+             * @return The row, or -1 if the column is unassigned.
+             */
+            int ColMatch(size_t col) const { return m_col_match[col]; }
+            /**
+             * Retrieves the total cost of the assignment.
+             * @return The sum of the costs of the assigned pairs.
+             */
+            double Cost() const { return m_cost; }
+        private:
+            /**
+             * An allowed pairing.
+             */
+            typedef struct Entry {
+                int row, col;
+                double cost;
+            } Entry;
+
+            size_t m_rows, m_cols;
+            double m_cost;
+            /** The allowed pairs **/
+            std::vector<Entry> m_entries;
+            /** The solution **/
+            std::vector<int> m_row_match, m_col_match;
+            /** Maps the rows and columns into the (compacted) problem and back **/
+            std::vector<int> m_row_index, m_col_index, m_rows_used, m_cols_used;
+            /** The compacted (dense) cost matrix **/
+            std::vector<double> m_dense;
+            /** Solver workspace **/
+            std::vector<double> m_u, m_v, m_minv;
+            std::vector<int> m_p, m_way;
+            std::vector<char> m_used;
+
+            /** Copy constructor (disabled) **/
+            Assignment(const Assignment &other);
+            /** Assignment operator (disabled) **/
+            Assignment& operator= (const Assignment &other);
+    };
+}
+
+#endif // _PICOPTERX_ASSIGNMENT_H
@@ -0,0 +1,83 @@
+/**
+ * @file camera_blobs.h
+ * @brief Connected component (blob) labelling of binary images.
+ */
+
+#ifndef _PICOPTERX_CAMERA_BLOBS_H
+#define _PICOPTERX_CAMERA_BLOBS_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+namespace picopter {
+    /**
+     * Statistics of one 8-connected blob of set pixels.
+     */
+    typedef struct Blob {
+        /** The number of pixels (zeroth moment). **/
+        int64_t m00;
+        /** The sum of the pixel x coordinates (first moment). **/
+        int64_t m10;
+        /** The sum of the pixel y coordinates (first moment). **/
+        int64_t m01;
+        /** The inclusive bounds of the blob. **/
+        int min_x, min_y, max_x, max_y;
+    } Blob;
+
+    /**
+     * Labels the blobs in a binary image in a single streaming pass.
+     * The image can optionally be closed (dilated then eroded with a square
+     * element, as cv::dilate and cv::erode do) in the same pass. Runs of set
+     * pixels are joined to the runs above them using union-find, and each
+     * blob's area, moments and bounds are accumulated as it is labelled.
+     */
+    class BlobLabeller {
+        public:
+            BlobLabeller(int close_size = 0);
+            virtual ~BlobLabeller();
+
+            size_t Label(uint8_t *mask, int width, int height, int stride);
+            const std::vector<Blob>& GetBlobs(void);
+            size_t GetLargest(size_t k, int64_t min_area, std::vector<Blob> *blobs);
+        private:
+            /** The closing element size (1 for no closing) **/
+            int m_size;
+            /** Element offsets above/left of and below/right of the anchor **/
+            int m_before, m_after;
+            /** The image width **/
+            int m_width;
+            /** Recent input rows (0/1), for removing them from the counts **/
+            std::vector<uint8_t> m_input;
+            /** Recent dilated rows (0/1), for removing them from the counts **/
+            std::vector<uint8_t> m_dilated;
+            /** Set input pixels per column within the dilation window **/
+            std::vector<int> m_set_count;
+            /** Clear dilated pixels per column within the erosion window **/
+            std::vector<int> m_clear_count;
+            /** The closed row being labelled (0/1) **/
+            std::vector<uint8_t> m_closed;
+            /** Labels of the previous and current rows (-1 for none) **/
+            std::vector<int> m_labels[2];
+            /** Union-find parent of each provisional label **/
+            std::vector<int> m_parent;
+            /** Statistics of each provisional label **/
+            std::vector<Blob> m_stats;
+            /** The final blobs **/
+            std::vector<Blob> m_blobs;
+
+            void AddInput(const uint8_t *row, int y);
+            void Dilate(int y, uint8_t *out);
+            void Erode(int y, uint8_t *out);
+            void LabelRow(const uint8_t *row, int y);
+            int Find(int label);
+            int Union(int a, int b);
+
+            /** Copy constructor (disabled) **/
+            BlobLabeller(const BlobLabeller &other);
+            /** Assignment operator (disabled) **/
+            BlobLabeller& operator= (const BlobLabeller &other);
+    };
+}
+
+#endif // _PICOPTERX_CAMERA_BLOBS_H
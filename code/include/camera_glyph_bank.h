@@ -0,0 +1,53 @@
+/**
+ * @file camera_glyph_bank.h
+ * @brief Bit-packed glyph templates for fast glyph recognition.
+ */
+
+#ifndef _PICOPTERX_CAMERA_GLYPH_BANK_H
+#define _PICOPTERX_CAMERA_GLYPH_BANK_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+/** The width and height that glyphs are normalised to (one word per row) **/
+#define GLYPH_BANK_SIZE 64
+
+namespace picopter {
+    /**
+     * The result of matching an image against the glyph bank.
+     */
+    typedef struct GlyphMatch {
+        /** The index of the glyph (in the order added). **/
+        int index;
+        /** The number of clockwise quarter turns of the glyph that matched. **/
+        int rotation;
+        /** The fraction of pixels that agree (0 to 1). **/
+        double similarity;
+    } GlyphMatch;
+
+    /**
+     * A set of binary glyph templates, normalised to GLYPH_BANK_SIZE square
+     * and stored one bit per pixel in all four rotations. An image is
+     * scored against every template by counting differing bits (XOR and
+     * popcount), one row word at a time.
+     */
+    class GlyphBank {
+        public:
+            GlyphBank();
+            virtual ~GlyphBank();
+
+            void Add(const uint8_t *image, int stride);
+            void Clear(void);
+            size_t Size(void) const;
+            bool Match(const uint8_t *image, int stride, double min_similarity,
+                GlyphMatch *match) const;
+        private:
+            /** The packed templates: glyph, then rotation, then row **/
+            std::vector<uint64_t> m_bits;
+
+            static void Pack(const uint8_t *image, int stride, uint64_t *rows);
+    };
+}
+
+#endif // _PICOPTERX_CAMERA_GLYPH_BANK_H
@@ -12,30 +12,27 @@
 #include "navigation.h"
 #include "flightboard.h" //For HUDInfo
 #include "threadpool.h"
+#include "camera_threshold.h"
+#include "camera_blobs.h"
+#include "camera_glyph_bank.h"
+#include "frame_queue.h"
+#include "frame_pool.h"
+#include "seqlock.h"
+#include "mjpeg_server.h"
+#include "stream_controller.h"
 #include <opencv2/opencv.hpp>
 #ifdef IS_ON_PI
 #  include "omxcv.h"
  #endif
 
-#define STREAM_FILE "/mnt/ramdisk/out.jpg"
-/** The size of the threshold lookup (number of colour bins per channel) **/
-#define THRESH_SIZE 16
-/** The scaling factor for reducing a value into its respective colour bin **/
-#define THRESH_DIV (256/THRESH_SIZE)
-/** Un-reduces a threshold value into the midpoint of the colour bin. **/
-#define UNREDUCE(x) (((x)*255 + 127) / THRESH_SIZE)
+/** The capacity of the queues between camera pipeline stages **/
+#define FRAME_QUEUE_SIZE 2
+/** The number of frames in flight (both queues full, plus one per stage) **/
+#define FRAME_POOL_SIZE (2*FRAME_QUEUE_SIZE + 3)
+/** The maximum number of objects published per frame **/
+#define DETECTION_MAX 32
 
 namespace picopter {
-    /**
-     * Enum defining the colourspaces that we threshold.
-     */
-    typedef enum ThresholdColourspaces {
-        /** The HSV colourspace. **/
-        THRESH_HSV = 0,
-        /** The Y'CbCr colourspace. **/
-        THRESH_YCbCr = 1
-    } ThresholdColourspace;
-
     /**
      * Structure to hold colour thresholding information.
      */
@@ -66,6 +63,68 @@ namespace picopter {
         /** Real-world location (lat/lon/alt) **/
         navigation::Coord3D location;
     } ObjectInfo;
+
+    /**
+     * The orientation of the copter and gimbal when a frame was captured.
+     */
+    typedef struct CapturePose {
+        /** Whether the pose was sampled at all. **/
+        bool valid;
+        /** The gimbal orientation. **/
+        navigation::EulerAngle gimbal;
+        /** The copter orientation (from the IMU). **/
+        navigation::EulerAngle imu;
+    } CapturePose;
+
+    /**
+     * The objects detected in one processed frame.
+     */
+    typedef struct DetectionSet {
+        /** The frame sequence number (0 if nothing has been processed). **/
+        uint64_t seq;
+        /** The time the frame was captured. **/
+        std::chrono::steady_clock::time_point timestamp;
+        /** The pose sampled closest to the time of capture. **/
+        CapturePose pose;
+        /** The number of valid entries in objects. **/
+        int count;
+        /** The detected objects. **/
+        ObjectInfo objects[DETECTION_MAX];
+    } DetectionSet;
+
+    /** Receives every processed frame's detections (on the camera thread). **/
+    typedef std::function<void(const DetectionSet&)> DetectionCallback;
+    /** Samples the current pose, for stamping captured frames. **/
+    typedef std::function<void(CapturePose*)> PoseSource;
+
+    /**
+     * A queue of detection sets, for a consumer that runs on its own thread.
+     * An eventfd is readable while the queue may be non-empty, so the queue
+     * can also be waited on with poll/epoll.
+     */
+    class DetectionQueue {
+        public:
+            DetectionQueue(size_t capacity = 4);
+            virtual ~DetectionQueue();
+
+            int GetFd(void);
+            bool Pop(DetectionSet *detections);
+            bool Wait(int timeout_ms);
+            size_t GetOverflows(void);
+            void Push(const DetectionSet &detections);
+        private:
+            /** The queued detection sets **/
+            FrameQueue<DetectionSet> m_queue;
+            /** Signalled when a set is queued **/
+            int m_fd;
+            /** Number of sets discarded because the queue was full **/
+            std::atomic<size_t> m_overflows;
+
+            /** Copy constructor (disabled) **/
+            DetectionQueue(const DetectionQueue &other);
+            /** Assignment operator (disabled) **/
+            DetectionQueue& operator= (const DetectionQueue &other);
+    };
     
     /**
      * Holds information about a glyph.
@@ -116,10 +175,115 @@ namespace picopter {
             void DoAutoLearning(void);
 
             void GetDetectedObjects(std::vector<ObjectInfo>* objects);
+            uint64_t GetDetections(DetectionSet *detections);
+            bool WaitForDetections(uint64_t seq, DetectionSet *detections, int timeout_ms);
+            int Subscribe(DetectionCallback callback);
+            int Subscribe(DetectionQueue *queue);
+            void Unsubscribe(int id);
+            void SetPoseSource(PoseSource source);
             double GetFramerate(void);
+            double GetAllocationsPerFrame(void);
             bool TakePhoto(std::string filename);
             void SetTrackingArrow(navigation::Point3D arrow);
         private:
+            /**
+             * A frame passed between the capture, processing and output
+             * stages of the pipeline.
+             */
+            typedef struct Frame {
+                /** The captured (and later annotated) image **/
+                cv::Mat image;
+                /** The processing working copy (e.g. thresholded image) **/
+                cv::Mat backend;
+                /** Whether the backend image should be streamed **/
+                bool show_backend;
+                /** The time of capture **/
+                std::chrono::steady_clock::time_point timestamp;
+                /** The capture sequence number **/
+                uint64_t seq;
+                /** The pose at the time of capture **/
+                CapturePose pose;
+            } Frame;
+            /** Handle to a frame from the frame pool **/
+            typedef FramePool<Frame>::Handle FrameHandle;
+
+            /**
+             * Matrix allocator that counts the buffers it allocates. It is
+             * attached to the pooled and scratch buffers so that allocation
+             * churn in the pipeline can be measured.
+             */
+            class CountingAllocator : public cv::MatAllocator {
+                public:
+                    CountingAllocator() : m_count{0} {}
+                    void allocate(int dims, const int* sizes, int type, int*& refcount,
+                        uchar*& datastart, uchar*& data, size_t* step);
+                    void deallocate(int* refcount, uchar* datastart, uchar* data);
+                    unsigned long GetCount(void) { return m_count; }
+                private:
+                    std::atomic<unsigned long> m_count;
+            };
+
+            /**
+             * The tracking window: once an object is found, later frames
+             * only search around where it is predicted to be.
+             */
+            typedef struct TrackingWindow {
+                /** Whether an object is being tracked **/
+                bool locked;
+                /** The object's last bounds (processing coordinates) **/
+                cv::Rect bounds;
+                /** The object's motion per processed frame **/
+                cv::Point2f velocity;
+                /** Consecutive frames the object was not found in the window **/
+                int misses;
+                /** Frames since the last full frame search **/
+                int frames;
+            } TrackingWindow;
+
+            /**
+             * State of the asynchronous HOG people detector.
+             */
+            typedef struct HOGState {
+                /** The outstanding jobs (one per pyramid level band) **/
+                std::vector<std::future<void>> jobs;
+                /** The windows found by each job **/
+                std::vector<std::vector<cv::Rect>> hits;
+                /** The greyscale image being searched **/
+                cv::Mat image;
+                /** Where the searched image is in the processing image **/
+                cv::Point offset;
+                /** Frames since the last run was started **/
+                int frames;
+                /** Bumped on a mode change, to invalidate runs in flight **/
+                unsigned generation;
+                /** The generation the outstanding run was started in **/
+                unsigned run_generation;
+                /** The current detections (processing coordinates) **/
+                std::vector<cv::Rect> found;
+                /** What each current detection looks like (half scale) **/
+                std::vector<cv::Mat> templates;
+                /** Template matching scratch buffer **/
+                cv::Mat match;
+            } HOGState;
+
+            /**
+             * Working state for evaluating one candidate glyph quad.
+             */
+            typedef struct GlyphCandidate {
+                /** The simplified contour **/
+                std::vector<cv::Point> approx;
+                /** The quad, warped to the glyph bank size **/
+                cv::Mat warp;
+                /** The thresholded quad **/
+                cv::Mat quad;
+                /** The bounds of the quad in the source image **/
+                cv::Rect bounds;
+                /** Whether the quad matched a glyph **/
+                bool matched;
+                /** The glyph that was matched **/
+                GlyphMatch match;
+            } GlyphCandidate;
+
             /** A list of distinct colours **/
             static const std::vector<cv::Scalar> m_colours;
             /** The OpenCV video capture handle **/
@@ -128,6 +292,8 @@ namespace picopter {
             std::atomic<bool> m_stop;
             /** The current camera mode **/
             CameraMode m_mode;
+            /** The number of thresholding workers (including the caller) **/
+            int m_thresh_workers;
             /** Worker thread pool **/
             ThreadPool m_pool;
 
@@ -137,38 +303,108 @@ namespace picopter {
             std::mutex m_aux_mutex;
             /** The video processing thread **/
             std::future<void> m_worker_thread;
+            /** The camera capture thread **/
+            std::future<void> m_capture_thread;
+            /** The output (HUD/encoding/streaming) thread **/
+            std::future<void> m_output_thread;
+            /** Counts allocations of the pipeline's buffers **/
+            CountingAllocator m_allocator;
+            /** The recycled frames used by the pipeline **/
+            FramePool<Frame> m_frames;
+            /** Captured frames waiting to be processed **/
+            FrameQueue<FrameHandle> m_capture_queue;
+            /** Processed frames waiting to be output **/
+            FrameQueue<FrameHandle> m_output_queue;
+            /** What to do when a stage falls behind **/
+            FrameDropPolicy m_drop_policy;
 
             /** The colour thresholding parameters **/
             ThresholdParams m_thresholds;
             /** The colour auto-learning thresholding parameters **/
             ThresholdParams m_learning_thresholds;
+            /** The detections from the last processed frame **/
+            SeqLock<DetectionSet> m_published;
+            /** Guards the subscriber list **/
+            std::mutex m_subscriber_mutex;
+            /** Detection subscribers, by subscription ID **/
+            std::vector<std::pair<int, DetectionCallback>> m_subscribers;
+            /** The next subscription ID **/
+            int m_next_subscriber;
+            /** Guards the pose source **/
+            std::mutex m_pose_mutex;
+            /** Where to sample the capture pose from, if anywhere **/
+            PoseSource m_pose_source;
             /** The processing rate (FPS) **/
-            double m_fps;
+            std::atomic<double> m_fps;
+            /** Buffer allocations per processed frame **/
+            std::atomic<double> m_allocs_per_frame;
             /** Demo mode (displays camera stream in GTK window) **/
             bool m_demo_mode;
             /** Show the working copy (e.g. thresholded image) **/
             bool m_show_backend;
-            /** Indicates that a snapshot should be taken **/
+            /** Guards the snapshot request and the snapshot **/
+            std::mutex m_photo_mutex;
+            /** Indicates that a snapshot is pending (until it is written) **/
             bool m_save_photo;
             /** The path to store the snapshot to **/
             std::string m_save_filename;
+            /** Unannotated copy of the image to save, once taken **/
+            cv::Mat m_photo;
             /** The current HUD info. **/
-            HUDInfo m_hud;
+            LatestValue<HUDInfo> m_hud;
             /** Arrow indicating movement **/
             navigation::Point3D m_arrow;
+            /** Only search a window around a tracked object **/
+            bool m_roi_tracking;
+            /** The tracking window state **/
+            TrackingWindow m_window;
             /** Detected objects **/
             std::vector<ObjectInfo> m_detected;
             /** List of glyphs **/
             std::vector<CameraGlyph> m_glyphs;
+            /** The glyphs, normalised and bit-packed for matching **/
+            GlyphBank m_glyph_bank;
+            /** The minimum fraction of pixels that must match a glyph **/
+            double m_glyph_similarity;
             /** Colour lookup thresholding table **/
             uint8_t m_lookup_threshold[THRESH_SIZE][THRESH_SIZE][THRESH_SIZE];
+            /** The row kernel used to apply the lookup table **/
+            ThresholdKernel m_threshold_kernel;
+            /** Full precision threshold table (if enabled) **/
+            ThresholdBitTable *m_full_threshold;
+            /** The row kernel used to apply the full precision table **/
+            ThresholdKernel m_full_kernel;
 
             /** HOG Detector **/
             cv::HOGDescriptor m_hog;
+            /** Asynchronous HOG detection state **/
+            HOGState m_hog_state;
+
+            /** Structuring elements for closing thresholded images **/
+            cv::Mat m_element_dilate, m_element_erode;
+            /** Processing stage scratch buffers **/
+            cv::Mat m_scratch, m_scratch_gray, m_glyph_quad;
+            /** Per contour glyph candidates (evaluated on the pool) **/
+            std::vector<GlyphCandidate> m_glyph_candidates;
+            /** Processing stage contour storage **/
+            std::vector<std::vector<cv::Point>> m_contours;
+            /** Connected component labeller (with closing) **/
+            BlobLabeller m_labeller;
+            /** The largest blobs found by the labeller **/
+            std::vector<Blob> m_blobs;
+            /** Output stage buffer for the resized stream image **/
+            cv::Mat m_stream_buffer;
+            /** Output stage buffer for the encoded stream image **/
+            std::vector<uint8_t> m_stream_jpeg;
+            /** Serves the stream to the web interface (if enabled) **/
+            MJPEGServer *m_stream_server;
+            /** Adapts the stream settings to the processing load **/
+            StreamController m_stream_control;
 
             int INPUT_WIDTH, INPUT_HEIGHT, PROCESS_WIDTH, PROCESS_HEIGHT;
-            int STREAM_WIDTH, STREAM_HEIGHT, PIXEL_SKIP, PIXEL_THRESHOLD;
+            int STREAM_WIDTH, STREAM_HEIGHT, STREAM_PORT, PIXEL_SKIP, PIXEL_THRESHOLD;
             int LEARN_SIZE;
+            int ROI_MAX_MISSES, ROI_FULL_INTERVAL, ROI_MARGIN, HOG_STRIDE;
 
 #ifdef IS_ON_PI
             omxcv::OmxCv *m_enc;
@@ -176,25 +412,35 @@ namespace picopter {
 
             void LoadGlyphs(Options *opts);
 
+            void CaptureImages(void);
             void ProcessImages(void);
+            void PublishDetections(const Frame &frame);
+            void OutputImages(void);
             void DrawHUD(cv::Mat& img);
             void DrawCrosshair(cv::Mat& img, cv::Point centre, const cv::Scalar& colour, int size);
             void DrawTrackingArrow(cv::Mat& img);
 
-            void RGB2HSV(uint8_t r, uint8_t g, uint8_t b, uint8_t *h, uint8_t *s, uint8_t *v);
-            void RGB2YCbCr(uint8_t r, uint8_t g, uint8_t b, uint8_t *y, uint8_t *cb, uint8_t *cr);
             void BuildThreshold(uint8_t lookup[][THRESH_SIZE][THRESH_SIZE], ThresholdParams thresh);
-            void ThresholdSlice(const cv::Mat& src, cv::Mat &out, int skip, int offset, int slice_height);
-            void Threshold(const cv::Mat& src, cv::Mat &out, int width);
+            void UpdateThresholds(void);
+            void ThresholdSlice(const cv::Mat& src, cv::Mat &out, int skip, int offset, int slice_height, ThresholdKernel kernel, const uint8_t *lut);
+            void Threshold(const cv::Mat& src, cv::Mat &out, int width, cv::Rect window = cv::Rect());
+            cv::Rect SearchWindow(cv::Size min_size = cv::Size());
+            void UpdateSearchWindow(void);
             void LearnThresholds(cv::Mat& src, cv::Mat& threshold, cv::Rect roi);
             bool CentreOfMass(cv::Mat& src, cv::Mat& threshold);
             int ConnectedComponents(cv::Mat& src, cv::Mat& threshold);
             bool CamShift(cv::Mat& src, cv::Mat& threshold);
             bool CannyGlyphDetection(cv::Mat& src, cv::Mat& proc);
             bool ThresholdingGlyphDetection(cv::Mat& src, cv::Mat& proc);
+            bool MatchGlyph(const cv::Mat &roi, cv::Mat &scratch, cv::Mat &quad, GlyphMatch *match) const;
+            void AddGlyph(const cv::Mat &src, const GlyphMatch &match, cv::Rect bounds);
             bool GlyphDetection(cv::Mat &src, cv::Mat& roi, cv::Rect bounds);
-            bool GlyphContourDetection(cv::Mat& src, std::vector<std::vector<cv::Point>> contours);
+            void EvaluateGlyphCandidate(const cv::Mat &src, const std::vector<cv::Point> &contour, GlyphCandidate *candidate) const;
+            bool GlyphContourDetection(cv::Mat& src, const std::vector<std::vector<cv::Point>> &contours);
             bool HoughDetection(cv::Mat& src, cv::Mat& proc);
+            void StartHOG(const cv::Mat &gray, cv::Rect window);
+            bool CollectHOG(void);
+            void PropagateHOG(const cv::Mat &gray);
             bool HOGPeople(cv::Mat &src, cv::Mat& process);
 
             /** Copy constructor (disabled) **/
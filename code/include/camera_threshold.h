@@ -0,0 +1,157 @@
+/**
+ * @file camera_threshold.h
+ * @brief Colour thresholding lookup kernels.
+ **/
+
+#ifndef _PICOPTERX_CAMERA_THRESHOLD_H
+#define _PICOPTERX_CAMERA_THRESHOLD_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** The size of the threshold lookup (number of colour bins per channel) **/
+#define THRESH_SIZE 16
+/** The scaling factor for reducing a value into its respective colour bin **/
+#define THRESH_DIV (256/THRESH_SIZE)
+/** The shift equivalent of dividing by THRESH_DIV **/
+#define THRESH_SHIFT 4
+/** Un-reduces a threshold value into the midpoint of the colour bin. **/
+#define UNREDUCE(x) (((x)*255 + 127) / THRESH_SIZE)
+/** The size in bytes of the full precision (one bit per colour) table. **/
+#define THRESH_FULL_SIZE ((1 << 24) / 8)
+
+namespace picopter {
+    /**
+     * Enum defining the colourspaces that we threshold.
+     */
+    typedef enum ThresholdColourspaces {
+        /** The HSV colourspace. **/
+        THRESH_HSV = 0,
+        /** The Y'CbCr colourspace. **/
+        THRESH_YCbCr = 1
+    } ThresholdColourspace;
+
+    /**
+     * The layouts of lookup table that the kernels can use.
+     */
+    typedef enum ThresholdTableTypes {
+        /** THRESH_SIZE^3 byte table, indexed by colour bin. **/
+        THRESH_TABLE_BINNED = 0,
+        /** THRESH_FULL_SIZE bit table, indexed by the full 24 bit colour. **/
+        THRESH_TABLE_FULL = 1
+    } ThresholdTableType;
+
+    /**
+     * The available implementations of the thresholding kernel.
+     */
+    typedef enum ThresholdKernelTypes {
+        /** Portable C++ implementation. **/
+        THRESH_KERNEL_SCALAR = 0,
+        /** x86 SSE2 implementation. **/
+        THRESH_KERNEL_SSE2 = 1,
+        /** x86 AVX2 (gather) implementation. **/
+        THRESH_KERNEL_AVX2 = 2,
+        /** ARM NEON implementation. **/
+        THRESH_KERNEL_NEON = 3
+    } ThresholdKernelType;
+
+    /**
+     * Thresholds a single row of BGR pixels using a colour lookup table.
+     * For a binned table, each output byte is
+     * lut[R/THRESH_DIV][G/THRESH_DIV][B/THRESH_DIV] of the input pixel; for
+     * a full table, it is 255 if bit (R<<16|G<<8|B) of the table is set.
+     * @param [in] src The start of the source row (B, G, R byte order).
+     * @param [out] dst The output row (one byte per pixel).
+     * @param [in] width The number of output pixels.
+     * @param [in] stride The byte distance between sampled input pixels
+     *                    (number of channels * pixel skip; at least 3).
+     * @param [in] lut The lookup table, in [R][G][B] order.
+     */
+    typedef void (*ThresholdKernel)(const uint8_t *src, uint8_t *dst,
+        int width, int stride, const uint8_t *lut);
+
+    ThresholdKernel GetThresholdKernel(ThresholdKernelType type, ThresholdTableType table = THRESH_TABLE_BINNED);
+    ThresholdKernelType GetBestThresholdKernel(void);
+    const char* GetThresholdKernelName(ThresholdKernelType type);
+
+    void RGB2HSV(uint8_t r, uint8_t g, uint8_t b, uint8_t *h, uint8_t *s, uint8_t *v);
+    void RGB2YCbCr(uint8_t r, uint8_t g, uint8_t b, uint8_t *y, uint8_t *cb, uint8_t *cr);
+
+    /**
+     * Thresholds expressed per channel of the colourspace. A colour passes
+     * if each of its three converted channel values is accepted.
+     */
+    typedef struct ThresholdChannels {
+        /** The colourspace that the channels belong to. **/
+        ThresholdColourspace colourspace;
+        /** Accepted values of each channel (e.g. [0] is hue for HSV). **/
+        bool accept[3][256];
+    } ThresholdChannels;
+
+    /**
+     * Full precision threshold table, with one bit per 24-bit colour.
+     * The table is double buffered. Updates are built on a background
+     * thread into the back buffer and then swapped in, so readers never
+     * wait on a rebuild. Only the parts of the colour cube whose converted
+     * channel values changed are recomputed.
+     */
+    class ThresholdBitTable {
+        public:
+            ThresholdBitTable();
+            virtual ~ThresholdBitTable();
+
+            void Update(const ThresholdChannels &channels);
+            void Flush(void);
+            const uint8_t* Acquire(int *handle);
+            void Release(int handle);
+        private:
+            /** Range of each converted channel within a tile of the colour cube **/
+            typedef struct TileRange {
+                uint8_t lo[3], hi[3];
+            } TileRange;
+
+            /** Guards the pending update **/
+            std::mutex m_mutex;
+            /** Signals the builder thread **/
+            std::condition_variable m_signal;
+            /** Signals that pending updates have been applied **/
+            std::condition_variable m_done;
+            /** Flag to stop the builder thread **/
+            bool m_stop;
+            /** Indicates an update is waiting to be built **/
+            bool m_pending;
+            /** Indicates the builder is working on an update **/
+            bool m_building;
+            /** The most recently requested thresholds **/
+            ThresholdChannels m_next;
+            /** The two table buffers **/
+            uint8_t *m_tables[2];
+            /** The thresholds each buffer was last built with **/
+            ThresholdChannels m_built[2];
+            /** Whether each buffer has been built at all **/
+            bool m_valid[2];
+            /** The buffer readers should use (-1 if none is ready) **/
+            std::atomic<int> m_front;
+            /** Number of readers using each buffer **/
+            std::atomic<int> m_readers[2];
+            /** Channel ranges per tile, for each colourspace (built lazily) **/
+            std::vector<TileRange> m_ranges[2];
+            /** The background builder thread **/
+            std::thread m_builder;
+
+            void BuildLoop(void);
+            void BuildRanges(ThresholdColourspace colourspace);
+            void Rebuild(int buffer, const ThresholdChannels &channels);
+
+            /** Copy constructor (disabled) **/
+            ThresholdBitTable(const ThresholdBitTable &other);
+            /** Assignment operator (disabled) **/
+            ThresholdBitTable& operator= (const ThresholdBitTable &other);
+    };
+}
+
+#endif // _PICOPTERX_CAMERA_THRESHOLD_H
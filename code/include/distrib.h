@@ -0,0 +1,116 @@
+/**
+ * @file distrib.h
+ * @brief Ellipsoidal (gaussian) uncertainty distributions and their algebra.
+ */
+
+#ifndef _PICOPTERX_DISTRIB_H
+#define _PICOPTERX_DISTRIB_H
+
+#include <opencv2/core/core.hpp>
+#include <chrono>
+
+#define TICKS_PER_SEC 1000000000l
+
+//#define TIME_TYPE std::chrono::duration<long int, std::ratio<1l, TICKS_PER_SEC> >
+#define TIME_TYPE std::chrono::steady_clock::duration
+
+//#define CLOCK_TYPE std::chrono::time_point<std::chrono::_V2::steady_clock, std::chrono::duration<long int, std::ratio<1l, TICKS_PER_SEC> > >
+#define CLOCK_TYPE std::chrono::time_point<std::chrono::steady_clock>
+
+namespace picopter {
+    /**
+     * A symmetric 3x3 matrix, stored as its upper triangle.
+     */
+    typedef struct SymMat3 {
+        /** The diagonal **/
+        double xx, yy, zz;
+        /** The off-diagonal **/
+        double yz, xz, xy;
+
+        /** Constructs a zero matrix. **/
+        SymMat3() : xx(0), yy(0), zz(0), yz(0), xz(0), xy(0) {}
+        /** Constructs a matrix from its elements. **/
+        SymMat3(double xx, double yy, double zz, double yz, double xz, double xy)
+        : xx(xx), yy(yy), zz(zz), yz(yz), xz(xz), xy(xy) {}
+        SymMat3(const cv::Matx33d &m);
+        operator cv::Matx33d() const;
+        double operator()(int i, int j) const;
+    } SymMat3;
+
+    SymMat3 operator+(const SymMat3 &a, const SymMat3 &b);
+    SymMat3 operator-(const SymMat3 &a, const SymMat3 &b);
+    SymMat3 operator*(double s, const SymMat3 &a);
+    cv::Vec3d operator*(const SymMat3 &a, const cv::Vec3d &v);
+
+    /**
+     * The LDL^T factorisation of a positive semi-definite SymMat3. Pivots
+     * that are (numerically) zero are directions with no information; solves
+     * leave those components at zero instead of failing.
+     */
+    typedef struct SymFactor {
+        /** The pivots (D) **/
+        double d[3];
+        /** The strictly lower part of the unit lower-triangular L **/
+        double l10, l20, l21;
+        /** The number of non-zero pivots **/
+        int rank;
+    } SymFactor;
+
+    SymFactor factorSym(const SymMat3 &a);
+    cv::Vec3d solveSym(const SymFactor &f, const cv::Vec3d &b);
+    double quadForm(const SymMat3 &a, const cv::Vec3d &v);
+    SymMat3 rotateSym(const SymMat3 &a, const cv::Matx33d &r);
+    SymMat3 convolveSym(const SymMat3 &a, const SymMat3 &b);
+
+    /**
+     * A 3D gaussian elliptical structure, in information form:
+     *   p(x) = e^-((x - vect)^T axes (x - vect))
+     * A zero axes matrix represents infinite variance and covariance, and
+     * singular ones represent no information along some directions (such as
+     * along the ray of a monocular camera sighting).
+     */
+    typedef struct Distrib {
+        /** Eigenvectors are the semi-major axes, eigenvalues are 1/(2 sigma^2) **/
+        SymMat3 axes;
+        /** The centre **/
+        cv::Vec3d vect;
+    } Distrib;
+
+    //parameters to construct the elliptic structure above
+    typedef struct DistribParams {
+        double x,y,z;
+        double sigma_x, sigma_y, sigma_z;
+        double yaw, pitch, roll;
+    } DistribParams;
+
+    Distrib generatedistrib();                                                  //Generate an empty (sigma 1) distribution
+    Distrib generatedistrib(DistribParams params);                              //generate an distrib struct from a primitive and operators
+    DistribParams getdistribParams(Distrib A);                                  //calculate the centre and covariance widths of this object
+
+    double sampleDistrib(Distrib &A, cv::Vec3d &B);
+
+    Distrib combineDistribs(Distrib A, Distrib B);                              //combine two distrib distributions (as though statistically independent)
+    Distrib combineDistribs(const Distrib *dists, size_t n);                     //combine many distributions at once
+    Distrib separateDistribs(Distrib C, Distrib B);                             //undo combineDistribs: remove B from the combination C
+    double overlapDistribs(const Distrib &A, const Distrib &B);                 //how well two distributions agree (1 if their centres coincide)
+    void overlapDistribs(const Distrib &A, const Distrib *B, size_t n, double *out);   //overlap of A with each of B[0..n)
+    double distanceDistribs(const Distrib &A, const Distrib &B);                //squared Mahalanobis distance between the centres
+    void distanceDistribs(const Distrib &A, const Distrib *B, size_t n, double *out);  //distance from A to each of B[0..n)
+
+    Distrib translateDistrib(Distrib A, cv::Vec3d offset);
+    inline Distrib translateDistrib(Distrib A, double x, double y, double z){   //translate a distrib struct from the origin
+        return translateDistrib(A, cv::Vec3d(x,y,z));
+    }
+    Distrib rotateDistrib(Distrib A, cv::Matx33d Mrot);                         //rotate a distrib struct about the origin
+    Distrib rotateDistribEuler(Distrib A, double roll, double pitch, double yaw);    //rotate a distrib struct about the origin
+
+    cv::Matx33d rotationMatrix(double roll, double pitch, double yaw);
+
+    Distrib stretchDistrib(Distrib A, double sx, double sy, double sz);         //stretch a distrib struct about the origin
+    inline Distrib stretchDistrib(Distrib A, double s){                         //overload
+        return stretchDistrib(A,s,s,s);}
+    Distrib vectorSum(Distrib A, Distrib B);                                    //move the centre of A by a distance described by B.
+    Distrib changeStep(Distrib newLoc, Distrib oldLoc, TIME_TYPE timestep);     //find the step from one distrib to another.
+}
+
+#endif // _PICOPTERX_DISTRIB_H
@@ -12,17 +12,34 @@
 #include "navigation.h"
 /* For MAVProxy includes and other related baggage */
 #include "mavcommslink.h"
+/* For the transmit queue */
+#include "mavcommsqueue.h"
+/* For the event loop */
+#include "reactor.h"
+/* For the message bus */
+#include "message_bus.h"
+/* For telemetry requests */
+#include "telemetry.h"
+/* For the latest gimbal pose */
+#include "latest_value.h"
+
+/** The maximum number of MAVLink messages read at a time **/
+#define MAVLINK_READ_BATCH 16
+/** The size of the HUD status messages (including the terminator) **/
+#define HUD_STATUS_LENGTH 64
 
 namespace picopter {
     /* Forward declaration of the GPS class */
     class GPS;
     /* Forward declaration of the IMU class */
     class IMU;
+    /* Forward declaration of the Watchdog class */
+    class Watchdog;
     
     /**
      * Struct to hold information that might be displayed on a heads-up display.
      * This is basically the same as the MAVLink VFR_HUD message, plus a bit
-     * extra.
+     * extra. It is plain data, so that it can be held in a LatestValue.
      */
     typedef struct HUDInfo {
         /** UNIX epoch offset, in seconds **/
@@ -55,9 +72,9 @@ namespace picopter {
         /** Position (altitude is above ground) **/
         navigation::Coord3D pos;
         /** Status message **/
-        std::string status1;
+        char status1[HUD_STATUS_LENGTH];
         /** Flightboard status message **/
-        std::string status2;
+        char status2[HUD_STATUS_LENGTH];
     } HUDInfo;
 
     /**
@@ -65,7 +82,7 @@ namespace picopter {
      */
     class FlightBoard {
         public:
-            typedef std::function<void(const mavlink_message_t*)> EventHandler;
+            typedef MessageBus::Handler EventHandler;
 
             FlightBoard();
             FlightBoard(Options *opts);
@@ -73,9 +90,11 @@ namespace picopter {
             
             GPS* GetGPSInstance();
             IMU* GetIMUInstance();
-            void GetGimbalPose(navigation::EulerAngle *p);
+            Reactor* GetReactor();
+            void GetGimbalPose(navigation::EulerAngle *p, SampleInfo *info = NULL);
             bool GetHomePosition(navigation::Coord3D *p);
-            void GetLatestHUD(HUDInfo *i);
+            void GetLinkStats(MAVCommsStats *stats);
+            void GetQueueStats(MAVCommsQueueStats *stats);
             
             bool IsAutoMode();
             bool IsRTL();
@@ -96,12 +115,18 @@ namespace picopter {
             bool SetRegionOfInterest(navigation::Coord3D roi);
             bool UnsetRegionOfInterest();
 
-            int RegisterHandler(int msgid, EventHandler handler);
+            int RegisterHandler(int msgid, EventHandler handler, DeliveryMode mode = DELIVER_INLINE);
             void DeregisterHandler(int handlerid);
+            void GetMessageStats(int msgid, MessageBusStats *stats);
+            int RequestTelemetry(int msgid, double rate);
+            void ReleaseTelemetry(int id);
+            void GetTelemetryRate(int msgid, TelemetryRate *rate);
             void SendMessage(mavlink_message_t *msg);
         private:
             /** The autopilot connection timeout (in s) **/
             static const int HEARTBEAT_TIMEOUT_DEFAULT = 4;
+            /** The rate to request the gimbal pose at (Hz) **/
+            static const int MOUNT_STATUS_RATE = 5;
 
             /** The hearbeat timeout **/
             int m_heartbeat_timeout;
@@ -113,18 +138,20 @@ namespace picopter {
             IMU *m_imu;
             /** The MAVLink data connection **/
             MAVCommsLink *m_link;
+            /** The transmit queue for the data connection **/
+            MAVCommsQueue *m_tx;
+            /** Requests the telemetry that's needed **/
+            TelemetryManager *m_telemetry;
             /** The shutdown signal **/
             std::atomic<bool> m_shutdown;
             /** Whether or not to disable local position sending **/
             std::atomic<bool> m_disable_local;
             /** Output worker mutex **/
             std::mutex m_output_mutex;
-            /** Gimbal mutex **/
-            std::mutex m_gimbal_mutex;
-            /** Message receiving thread **/
-            std::thread m_input_thread;
-            /** Message sending thread **/
-            std::thread m_output_thread;
+            /** The event loop for the link and timers **/
+            Reactor m_reactor;
+            /** The heartbeat watchdog **/
+            Watchdog *m_heartbeat;
             /** The system ID of the flight board we connect to **/
             int m_system_id;
             /** The component ID of the flight board we connect to **/
@@ -143,19 +170,27 @@ namespace picopter {
             std::atomic<bool> m_is_armed;
             /** Do we have a home position? **/
             std::atomic<bool> m_has_home_position;
+            /** Do we need to (re)initialise the connection? **/
+            std::atomic<bool> m_needs_refresh;
             /** Watchdog counter on sending relative commands. **/
             int m_rel_watchdog;
+            /** The watchdog counter when last checked by the output handler **/
+            int m_safety_watchdog;
+            /** Output handler checks since relative commands stopped **/
+            int m_safety_skip;
             /** The current gimbal position **/
-            navigation::EulerAngle m_gimbal;
+            LatestValue<navigation::EulerAngle> m_gimbal;
             /** The home position (usually launch point) **/
             navigation::Coord3D m_home_position;
-            /** The event handler table **/
-            EventHandler m_handler_table[256];
+            /** Dispatches received messages to the event handlers **/
+            MessageBus m_bus;
 
-            /** Loop to receive and dispatch MAVLink  messages **/
-            void InputLoop();
-            /** Loop to send the setpoint via MAVLink **/
-            void OutputLoop();
+            /** Receives and dispatches MAVLink messages **/
+            void InputHandler();
+            /** Processes a received MAVLink message **/
+            void HandleMessage(const mavlink_message_t &msg);
+            /** Sends the safety setpoint via MAVLink **/
+            void OutputHandler();
             /** Copy constructor (disabled) **/
             FlightBoard(const FlightBoard &other);
             /** Assignment operator (disabled) **/
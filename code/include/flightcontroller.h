@@ -94,6 +94,7 @@ namespace picopter {
             
             ControllerState GetCurrentState();
             TaskIdentifier GetCurrentTaskId();
+            void GetLatestHUD(HUDInfo *i, SampleInfo *info = NULL);
             void Stop();
             bool CheckForStop();
             bool Sleep(int ms);
@@ -147,8 +148,12 @@ namespace picopter {
             std::mutex m_control_mutex;
             /** The current task **/
             std::shared_ptr<FlightTask> m_task;
-            /** HUD info **/
+            /** HUD info being updated (HUD parser only) **/
             HUDInfo m_hud;
+            /** The latest HUD info, for readers **/
+            LatestValue<HUDInfo> m_latest_hud;
+            /** The HUD parser's message handler ids **/
+            int m_hud_handlers[4];
             /** Flightboard status text **/
             std::string m_fb_status_text;
             /** Poor man's timeout **/
@@ -156,6 +161,8 @@ namespace picopter {
             
             /** HUD Loop updater **/
             void HUDParser(const mavlink_message_t *msg);
+            /** Samples the pose for stamping camera frames **/
+            void SampleCameraPose(CapturePose *pose);
             /** Update the current state **/
             ControllerState SetCurrentState(ControllerState state);
             /** Copy constructor (disabled) **/
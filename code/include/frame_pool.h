@@ -0,0 +1,131 @@
+/**
+ * @file frame_pool.h
+ * @brief Fixed-size pool of recyclable frames with reference-counted handles.
+ */
+
+#ifndef _PICOPTERX_FRAME_POOL_H
+#define _PICOPTERX_FRAME_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace picopter {
+    /**
+     * A fixed set of preallocated items that are handed out and recycled.
+     * Items keep their buffers between uses, so once every item has been
+     * used at least once, acquiring one does not allocate.
+     */
+    template <typename T>
+    class FramePool {
+        private:
+            /** A pool entry, with an intrusive reference count. **/
+            typedef struct Slot {
+                std::atomic<int> refs;
+                T item;
+                Slot() : refs{0}, item() {}
+            } Slot;
+        public:
+            /**
+             * A reference-counted handle to a pool item. The item returns
+             * to the pool when the last handle to it goes away.
+             */
+            class Handle {
+                public:
+                    Handle() : m_slot(nullptr) {}
+                    Handle(const Handle &other) : m_slot(other.m_slot) {
+                        if (m_slot) {
+                            m_slot->refs++;
+                        }
+                    }
+                    Handle(Handle &&other) : m_slot(other.m_slot) {
+                        other.m_slot = nullptr;
+                    }
+                    ~Handle() {
+                        Reset();
+                    }
+                    Handle& operator= (Handle other) {
+                        std::swap(m_slot, other.m_slot);
+                        return *this;
+                    }
+
+                    /** Releases this handle's reference. **/
+                    void Reset() {
+                        if (m_slot) {
+                            m_slot->refs.fetch_sub(1, std::memory_order_release);
+                            m_slot = nullptr;
+                        }
+                    }
+
+                    explicit operator bool() const { return m_slot != nullptr; }
+                    T& operator*() const { return m_slot->item; }
+                    T* operator->() const { return &m_slot->item; }
+                private:
+                    /** The referenced pool entry **/
+                    Slot *m_slot;
+
+                    explicit Handle(Slot *slot) : m_slot(slot) {}
+                    friend class FramePool;
+            };
+
+            /**
+             * Constructor.
+             * @param [in] size The number of items in the pool.
+             */
+            FramePool(size_t size)
+            : m_slots(size)
+            , m_next{0}
+            {}
+
+            /**
+             * Acquires a free item from the pool. Never blocks or allocates.
+             * @return A handle to the item, or an empty handle if every item
+             *         is in use.
+             */
+            Handle Acquire() {
+                size_t start = m_next++;
+                for (size_t i = 0; i < m_slots.size(); i++) {
+                    Slot &slot = m_slots[(start + i) % m_slots.size()];
+                    int expected = 0;
+                    if (slot.refs.compare_exchange_strong(expected, 1,
+                        std::memory_order_acquire)) {
+                        return Handle(&slot);
+                    }
+                }
+                return Handle();
+            }
+
+            /**
+             * Applies a function to every item, e.g. to preallocate buffers.
+             * Must only be called while no handles are outstanding.
+             * @param [in] fn The function to apply.
+             */
+            void ForEach(const std::function<void(T&)> &fn) {
+                for (Slot &slot : m_slots) {
+                    fn(slot.item);
+                }
+            }
+
+            /**
+             * Retrieves the number of items in the pool.
+             * @return The pool size.
+             */
+            size_t Size() const {
+                return m_slots.size();
+            }
+        private:
+            /** The pool entries **/
+            std::vector<Slot> m_slots;
+            /** Where to start looking for a free entry **/
+            std::atomic<size_t> m_next;
+
+            /** Copy constructor (disabled) **/
+            FramePool(const FramePool &other);
+            /** Assignment operator (disabled) **/
+            FramePool& operator= (const FramePool &other);
+    };
+}
+
+#endif // _PICOPTERX_FRAME_POOL_H
@@ -0,0 +1,165 @@
+/**
+ * @file frame_queue.h
+ * @brief Bounded single-producer, single-consumer queue for passing frames
+ *        between pipeline stages.
+ */
+
+#ifndef _PICOPTERX_FRAME_QUEUE_H
+#define _PICOPTERX_FRAME_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace picopter {
+    /**
+     * What a pipeline stage does when frames arrive faster than they can be
+     * handled.
+     */
+    typedef enum FrameDropPolicies {
+        /** The producer discards new frames while the queue is full. **/
+        FRAME_DROP_NEWEST = 0,
+        /** The consumer skips any backlog and takes the latest frame. **/
+        FRAME_DROP_TO_LATEST = 1
+    } FrameDropPolicy;
+
+    /**
+     * Bounded lock-free ring buffer with exactly one producer thread and one
+     * consumer thread. Neither side ever blocks the other; the consumer may
+     * optionally sleep while the queue is empty.
+     */
+    template <typename T>
+    class FrameQueue {
+        public:
+            /**
+             * Constructor.
+             * @param [in] capacity The minimum queue capacity. Rounded up to
+             *                      a power of two.
+             */
+            FrameQueue(size_t capacity)
+            : m_head{0}
+            , m_tail{0}
+            , m_sleeping{false}
+            {
+                size_t size = 1;
+                while (size < capacity) {
+                    size <<= 1;
+                }
+                m_slots.resize(size);
+                m_mask = size - 1;
+            }
+
+            /**
+             * Adds an item to the queue (producer only).
+             * @param [in] item The item to add. Moved from on success.
+             * @return true iff the item was queued (false if the queue is full).
+             */
+            bool Push(T &item) {
+                size_t tail = m_tail.load(std::memory_order_relaxed);
+                if (tail - m_head.load() > m_mask) {
+                    return false;
+                }
+                m_slots[tail & m_mask] = std::move(item);
+                m_tail.store(tail + 1);
+
+                //Only take the lock if the consumer is (about to be) asleep.
+                if (m_sleeping.load()) {
+                    std::lock_guard<std::mutex> lock(m_wait_mutex);
+                    m_wait.notify_one();
+                }
+                return true;
+            }
+
+            /**
+             * Removes the oldest item from the queue (consumer only).
+             * @param [out] item Location to store the item.
+             * @return true iff an item was retrieved.
+             */
+            bool Pop(T *item) {
+                size_t head = m_head.load(std::memory_order_relaxed);
+                if (head == m_tail.load()) {
+                    return false;
+                }
+                *item = std::move(m_slots[head & m_mask]);
+                //Don't hold on to the item's resources in the slot.
+                m_slots[head & m_mask] = T();
+                m_head.store(head + 1);
+                return true;
+            }
+
+            /**
+             * Removes all queued items, keeping only the most recent one
+             * (consumer only).
+             * @param [out] item Location to store the item.
+             * @param [out] skipped Incremented by the number of older items
+             *                      that were discarded.
+             * @return true iff an item was retrieved.
+             */
+            bool PopLatest(T *item, size_t *skipped) {
+                if (!Pop(item)) {
+                    return false;
+                }
+                while (Pop(item)) {
+                    (*skipped)++;
+                }
+                return true;
+            }
+
+            /**
+             * Waits for the queue to become non-empty (consumer only).
+             * @param [in] timeout The maximum time to wait.
+             * @return true iff the queue is non-empty.
+             */
+            template <typename Rep, typename Period>
+            bool Wait(const std::chrono::duration<Rep, Period> &timeout) {
+                if (!Empty()) {
+                    return true;
+                }
+
+                std::unique_lock<std::mutex> lock(m_wait_mutex);
+                m_sleeping = true;
+                //Re-check after flagging; the producer checks the flag after
+                //publishing, so one of the two will see the other.
+                if (Empty()) {
+                    m_wait.wait_for(lock, timeout);
+                }
+                m_sleeping = false;
+                return !Empty();
+            }
+
+            /**
+             * Determines if the queue is empty. Only exact when called from
+             * the consumer.
+             * @return true iff the queue is empty.
+             */
+            bool Empty(void) {
+                return m_head.load() == m_tail.load();
+            }
+        private:
+            /** The ring buffer storage **/
+            std::vector<T> m_slots;
+            /** Index mask (capacity - 1) **/
+            size_t m_mask;
+            /** Next slot to read (written by the consumer) **/
+            std::atomic<size_t> m_head;
+            /** Next slot to write (written by the producer) **/
+            std::atomic<size_t> m_tail;
+            /** Set while the consumer is waiting for an item **/
+            std::atomic<bool> m_sleeping;
+            /** Mutex used only to sleep/wake the consumer **/
+            std::mutex m_wait_mutex;
+            /** Wakes the consumer **/
+            std::condition_variable m_wait;
+
+            /** Copy constructor (disabled) **/
+            FrameQueue(const FrameQueue &other);
+            /** Assignment operator (disabled) **/
+            FrameQueue& operator= (const FrameQueue &other);
+    };
+}
+
+#endif // _PICOPTERX_FRAME_QUEUE_H
@@ -9,6 +9,8 @@
 /* For the Options class */
 #include "opts.h"
 #include "navigation.h"
+/* For the latest fix */
+#include "latest_value.h"
 
 class gpsmm;
 
@@ -59,7 +61,7 @@ namespace picopter {
             GPS();
             GPS(Options *opts);
             virtual ~GPS();
-            virtual void GetLatest(GPSData *d);
+            virtual void GetLatest(GPSData *d, SampleInfo *info = NULL);
             virtual double GetLatestRelAlt();
             
             int TimeSinceLastFix();
@@ -71,10 +73,14 @@ namespace picopter {
             /** The time checks waits when waiting for a fix (in ms) **/
             static const int WAIT_PERIOD = 200;
             
+            /** Reported when there has never been a fix (in s) **/
+            static const int NO_FIX = 999;
+            
             int m_fix_timeout;
-            std::mutex m_worker_mutex;
+            /** The fix being updated (writer only) **/
             GPSData m_data;
-            std::atomic<int> m_last_fix;
+            /** The latest complete fix, for readers **/
+            LatestValue<GPSData> m_latest;
             std::atomic<bool> m_quit;
         private:
             /** Copy constructor (disabled) **/
@@ -21,6 +21,8 @@ namespace picopter {
             GPSMAV(picopter::FlightBoard *fb, Options *opts);
             virtual ~GPSMAV() override;
         private:
+            /** The default rate to request position updates at (Hz) **/
+            static const int RATE_DEFAULT = 6;
             bool m_had_fix;
             DataLog m_log;
             
@@ -10,6 +10,8 @@
 #include "opts.h"
 #include "navigation.h"
 #include "flightboard.h"
+/* For the latest attitude */
+#include "latest_value.h"
 
 namespace picopter {
     /**
@@ -25,17 +27,17 @@ namespace picopter {
             IMU(FlightBoard *fb);
             IMU(FlightBoard *fb, Options *opts);
             virtual ~IMU();
-            void GetLatest(IMUData *d);
+            void GetLatest(IMUData *d, SampleInfo *info = NULL);
             double GetLatestRoll();
             double GetLatestPitch();
             double GetLatestYaw();
         private:
             /** Read timeout from the IMU in ms **/
             static const int IMU_TIMEOUT = 500;
+            /** The default rate to request attitude updates at (Hz) **/
+            static const int RATE_DEFAULT = 25;
             /** The IMU data **/
-            IMUData m_data;
-            /** Read/Write lock on the IMU data **/
-            std::mutex m_mutex;
+            LatestValue<IMUData> m_data;
             
             /** Copy constructor (disabled) **/
             IMU(const IMU &other);
@@ -0,0 +1,124 @@
+/**
+ * @file latest_value.h
+ * @brief Holds the latest sample of some sensor or telemetry state.
+ */
+
+#ifndef _PICOPTERX_LATEST_VALUE_H
+#define _PICOPTERX_LATEST_VALUE_H
+
+#include "seqlock.h"
+
+namespace picopter {
+    /** The (monotonic) clock that samples are stamped with **/
+    typedef std::chrono::steady_clock SampleClock;
+
+    /**
+     * Describes when a sample was stored.
+     */
+    typedef struct SampleInfo {
+        /** The sample number (1 for the first; 0 if there is no sample) **/
+        uint64_t seq;
+        /** When the sample was stored **/
+        SampleClock::time_point time;
+    } SampleInfo;
+
+    /**
+     * Holds the latest value of some state, stamped with when it was stored
+     * and a sample number. One thread stores values; any number of threads
+     * may read them without taking locks or holding up the writer.
+     *
+     * T must be plain data (no std::string and the like); see SeqLock.
+     */
+    template <typename T>
+    class LatestValue {
+        public:
+            /**
+             * Constructor.
+             * @param [in] initial The value to return until one is stored.
+             */
+            explicit LatestValue(const T &initial = T())
+            : m_initial(initial)
+            {}
+
+            /**
+             * Stores a new value, stamped with the current time (writer only).
+             * @param [in] value The value to store.
+             */
+            void Store(const T &value) {
+                m_cell.Store(Sample{value, SampleClock::now()});
+            }
+
+            /**
+             * Retrieves the latest value.
+             * @param [out] value The location to store the value. This is the
+             *                    initial value if nothing has been stored.
+             * @param [out] info The location to store when the value was
+             *                   stored, if wanted (may be NULL).
+             * @return true iff a value has been stored.
+             */
+            bool Load(T *value, SampleInfo *info = NULL) const {
+                Sample s;
+                uint64_t seq = m_cell.Load(&s);
+                *value = seq ? s.value : m_initial;
+                if (info) {
+                    info->seq = seq;
+                    info->time = s.time;
+                }
+                return seq > 0;
+            }
+
+            /**
+             * Retrieves the number of values stored so far.
+             * @return The sample number of the latest value.
+             */
+            uint64_t Sequence() const {
+                return m_cell.Version();
+            }
+
+            /**
+             * Retrieves the age of the latest value.
+             * @return The time since it was stored, or the maximum duration
+             *         if nothing has been stored.
+             */
+            std::chrono::milliseconds Age() const {
+                Sample s;
+                if (m_cell.Load(&s) == 0) {
+                    return std::chrono::milliseconds::max();
+                }
+                return std::chrono::duration_cast<std::chrono::milliseconds>(
+                    SampleClock::now() - s.time);
+            }
+
+            /**
+             * Determines if the latest value is too old to be used.
+             * @param [in] max_age The maximum acceptable age.
+             * @return true iff nothing has been stored in the last max_age.
+             */
+            template <typename Rep, typename Period>
+            bool IsStale(const std::chrono::duration<Rep, Period> &max_age) const {
+                Sample s;
+                return m_cell.Load(&s) == 0 ||
+                    SampleClock::now() - s.time > max_age;
+            }
+        private:
+            /**
+             * A stored value and when it was stored.
+             */
+            typedef struct Sample {
+                T value;
+                SampleClock::time_point time;
+            } Sample;
+
+            /** Publishes the samples **/
+            SeqLock<Sample> m_cell;
+            /** The value returned before anything is stored **/
+            const T m_initial;
+
+            /** Copy constructor (disabled) **/
+            LatestValue(const LatestValue &other);
+            /** Assignment operator (disabled) **/
+            LatestValue& operator= (const LatestValue &other);
+    };
+}
+
+#endif // _PICOPTERX_LATEST_VALUE_H
@@ -9,12 +9,15 @@
 /* For the Options class */
 #include "opts.h"
 #include "datalog.h"
+/* For the event loop */
+#include "reactor.h"
 
 namespace picopter {
     class Lidar {
         public:
             Lidar();
             Lidar(Options *opts);
+            Lidar(Options *opts, Reactor *reactor);
             virtual ~Lidar(void);
             int GetLatest();
         private:
@@ -22,10 +25,18 @@ namespace picopter {
             std::atomic<int> m_distance;
             DataLog m_log;
             
-            std::atomic<bool> m_stop;
-            std::thread m_worker;
+            /** Our own event loop, if not given one **/
+            Reactor *m_own_reactor;
+            /** The event loop that polls the sensor **/
+            Reactor *m_reactor;
+            /** The polling timer id **/
+            int m_timer;
+            /** Whether a measurement has been started **/
+            bool m_measuring;
+            /** The number of readings taken **/
+            int m_counter;
             
-            void Worker();
+            void Poll();
             
             /** Copy constructor (disabled) **/
             Lidar(const Lidar &other);
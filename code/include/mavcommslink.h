@@ -74,18 +74,72 @@ extern "C" {
 #define MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_YAW_ANGLE    0x9FF //0b0000100111111111
 #define MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_YAW_RATE     0x5FF //0b0000010111111111
 
+/** The size of the receive buffer (the most read per system call) **/
+#define MAVLINK_RX_BUFFER_SIZE 4096
+
 namespace picopter {
     /**
-     * Class to communicate with a MAVLink device. 
+     * Statistics of a MAVLink connection.
+     */
+    typedef struct MAVCommsStats {
+        /** Total bytes received **/
+        unsigned long bytes;
+        /** Total messages received **/
+        unsigned long messages;
+        /** Total messages dropped because they failed the CRC check **/
+        unsigned long crc_drops;
+        /** Total read system calls that returned data **/
+        unsigned long reads;
+        /** Bytes received per second (over the last second or so) **/
+        double bytes_per_second;
+        /** Messages received per second (over the last second or so) **/
+        double messages_per_second;
+    } MAVCommsStats;
+
+    /**
+     * Class to communicate with a MAVLink device. Received data is read as
+     * it becomes available (up to MAVLINK_RX_BUFFER_SIZE bytes per system
+     * call) into a buffer, from which messages are parsed on demand.
      */
     class MAVCommsLink {
         public:
-            virtual ~MAVCommsLink() {};
-            virtual bool ReadMessage(mavlink_message_t *ret) = 0;
+            virtual ~MAVCommsLink();
+            bool ReadMessage(mavlink_message_t *ret);
+            size_t ReadMessages(mavlink_message_t *ret, size_t max, int timeout = -1);
             virtual bool WriteMessage(const mavlink_message_t *src) = 0;
+            /**
+             * Retrieves the descriptor that becomes readable when data arrives.
+             * @return The descriptor.
+             */
+            virtual int GetDescriptor() = 0;
+            void GetStats(MAVCommsStats *stats);
         protected:
-            MAVCommsLink() {};
+            MAVCommsLink();
+            /**
+             * Waits for data and reads as much as is available.
+             * @param [out] buffer The buffer to read into.
+             * @param [in] length The size of the buffer.
+             * @param [in] timeout How long to wait, in ms (0 to not wait,
+             *                     negative for the link's default).
+             * @return The number of bytes read (0 on timeout or error).
+             */
+            virtual size_t ReadBytes(uint8_t *buffer, size_t length, int timeout) = 0;
         private:
+            /** Received data that hasn't been parsed yet **/
+            uint8_t m_rx_buffer[MAVLINK_RX_BUFFER_SIZE];
+            /** The unparsed region of the receive buffer **/
+            size_t m_rx_start, m_rx_end;
+            /** Protects m_stats **/
+            std::mutex m_stats_mutex;
+            /** The link statistics **/
+            MAVCommsStats m_stats;
+            /** When the rates were last calculated **/
+            std::chrono::steady_clock::time_point m_sample_start;
+            /** The byte and message totals when the rates were last calculated **/
+            unsigned long m_sample_bytes, m_sample_messages;
+
+            size_t Parse(mavlink_message_t *ret, size_t max, unsigned long *crc_drops);
+
             /** Copy constructor (disabled) **/
             MAVCommsLink(const MAVCommsLink &other);
             /** Assignment operator (disabled) **/
@@ -100,13 +154,14 @@ namespace picopter {
         public:
             MAVCommsSerial(const char *device, int baudrate);
             virtual ~MAVCommsSerial() override;
-            bool ReadMessage(mavlink_message_t *ret) override;
             bool WriteMessage(const mavlink_message_t *src) override;
+            int GetDescriptor() override;
+        protected:
+            size_t ReadBytes(uint8_t *buffer, size_t length, int timeout) override;
         private:
             std::string m_device;
             std::mutex m_io_mutex;
             int m_baudrate, m_fd;
-            int m_packet_drop_count;
 
             /** Copy constructor (disabled) **/
             MAVCommsSerial(const MAVCommsSerial &other);
@@ -122,13 +177,14 @@ namespace picopter {
         public:
             MAVCommsTCP(const char *address, uint16_t port);
             virtual ~MAVCommsTCP() override;
-            bool ReadMessage(mavlink_message_t *ret) override;
             bool WriteMessage(const mavlink_message_t *src) override;
+            int GetDescriptor() override;
+        protected:
+            size_t ReadBytes(uint8_t *buffer, size_t length, int timeout) override;
         private:
             std::string m_address;
             uint16_t m_port;
             int m_fd;
-            int m_packet_drop_count;
             
             /** Copy constructor (disabled) **/
             MAVCommsTCP(const MAVCommsTCP &other);
@@ -0,0 +1,113 @@
+/**
+ * @file mavcommsqueue.h
+ * @brief Queues MAVLink messages to be sent by a dedicated thread.
+ */
+
+#ifndef _PICOPTERX_MAVCOMMSQUEUE_H
+#define _PICOPTERX_MAVCOMMSQUEUE_H
+
+#include "mavcommslink.h"
+#include <condition_variable>
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <thread>
+
+/** Droppable messages are dropped beyond this many queued messages **/
+#define MAV_TX_QUEUE_SIZE 32
+
+namespace picopter {
+    /**
+     * The priority of a queued message (highest first).
+     */
+    typedef enum MAVPriorities {
+        /** Safety/stop messages; never coalesced or dropped, and they
+            discard any queued setpoint of the same kind **/
+        MAV_PRIORITY_SAFETY = 0,
+        /** One-off commands; never coalesced or dropped **/
+        MAV_PRIORITY_COMMAND = 1,
+        /** Setpoints; a newer one supersedes a queued one of the same kind **/
+        MAV_PRIORITY_SETPOINT = 2,
+        /** Housekeeping; may be dropped if the queue is full **/
+        MAV_PRIORITY_LOW = 3,
+        MAV_PRIORITY_COUNT = 4
+    } MAVPriority;
+
+    /**
+     * Statistics of a transmit queue.
+     */
+    typedef struct MAVCommsQueueStats {
+        /** Messages sent **/
+        unsigned long sent;
+        /** Messages replaced by a newer message of the same kind **/
+        unsigned long coalesced;
+        /** Messages dropped because the queue was full **/
+        unsigned long dropped;
+        /** Messages waiting to be sent **/
+        size_t queued;
+    } MAVCommsQueueStats;
+
+    /**
+     * Sends MAVLink messages on a dedicated thread, so that callers never
+     * block on the link. Messages are sent highest priority first (and in
+     * order within a priority). A setpoint that is superseded while still
+     * queued is overwritten in place, so only the latest is sent.
+     */
+    class MAVCommsQueue {
+        public:
+            MAVCommsQueue(MAVCommsLink *link);
+            virtual ~MAVCommsQueue();
+
+            bool Send(const mavlink_message_t *msg, MAVPriority priority, bool wait = false);
+            void GetStats(MAVCommsQueueStats *stats);
+        private:
+            /**
+             * A queued message.
+             */
+            typedef struct Entry {
+                /** The message **/
+                mavlink_message_t msg;
+                /** What kind of message it is (for coalescing) **/
+                uint32_t kind;
+                /** Unique id (for waiting on) **/
+                uint64_t id;
+            } Entry;
+
+            /** The link to send on **/
+            MAVCommsLink *m_link;
+            /** Protects everything below **/
+            std::mutex m_mutex;
+            /** Signalled when a message is queued or on shutdown **/
+            std::condition_variable m_queued;
+            /** Signalled when a message is sent **/
+            std::condition_variable m_sent;
+            /** The queues, one per priority **/
+            std::deque<Entry> m_queues[MAV_PRIORITY_COUNT];
+            /** The ids of messages that haven't been sent yet **/
+            std::set<uint64_t> m_pending;
+            /** The ids of messages that someone is waiting on (once per waiter) **/
+            std::multiset<uint64_t> m_waiting;
+            /** The ids of waited-on messages that were discarded unsent **/
+            std::set<uint64_t> m_discarded;
+            /** The next message id **/
+            uint64_t m_next_id;
+            /** The queue statistics **/
+            MAVCommsQueueStats m_stats;
+            /** Stop once the queue is empty **/
+            bool m_stop;
+            /** The transmit thread **/
+            std::thread m_thread;
+
+            void Run(void);
+            bool Drop(MAVPriority priority);
+            void Discard(const Entry &entry);
+            static uint32_t Kind(const mavlink_message_t *msg);
+
+            /** Copy constructor (disabled) **/
+            MAVCommsQueue(const MAVCommsQueue &other);
+            /** Assignment operator (disabled) **/
+            MAVCommsQueue& operator= (const MAVCommsQueue &other);
+    };
+}
+
+#endif // _PICOPTERX_MAVCOMMSQUEUE_H
@@ -0,0 +1,142 @@
+/**
+ * @file message_bus.h
+ * @brief Publish/subscribe dispatch of received MAVLink messages.
+ */
+
+#ifndef _PICOPTERX_MESSAGE_BUS_H
+#define _PICOPTERX_MESSAGE_BUS_H
+
+/* For MAVLink includes */
+#include "mavcommslink.h"
+#include <memory>
+
+/** The number of topics (MAVLink message ids) **/
+#define MESSAGE_BUS_TOPICS 256
+/** Queued deliveries beyond this many are dropped (oldest first) **/
+#define MESSAGE_BUS_QUEUE_SIZE 256
+
+namespace picopter {
+    /**
+     * How a subscriber is given its messages.
+     */
+    typedef enum DeliveryModes {
+        /** Called on the publishing (input) thread; must be quick **/
+        DELIVER_INLINE = 0,
+        /** Queued and called on the bus worker thread **/
+        DELIVER_QUEUED = 1
+    } DeliveryMode;
+
+    /**
+     * Per-topic delivery statistics.
+     */
+    typedef struct MessageBusStats {
+        /** Messages published **/
+        unsigned long published;
+        /** Handler calls made **/
+        unsigned long delivered;
+        /** Queued deliveries dropped because the queue was full **/
+        unsigned long dropped;
+        /** Mean time from publishing to the handler returning, in ms **/
+        double mean_latency;
+        /** Worst time from publishing to the handler returning, in ms **/
+        double max_latency;
+    } MessageBusStats;
+
+    /**
+     * Dispatches messages to any number of subscribers per message id.
+     * Subscriber lists are immutable snapshots that are replaced on
+     * (un)subscription, so publishing takes no locks and is never held up
+     * by subscription changes. Slow subscribers should ask for queued
+     * delivery, so that they don't hold up the publisher.
+     */
+    class MessageBus {
+        public:
+            typedef std::function<void(const mavlink_message_t*)> Handler;
+
+            MessageBus();
+            virtual ~MessageBus();
+
+            int Subscribe(int msgid, Handler handler, DeliveryMode mode);
+            void Unsubscribe(int id);
+            void Publish(const mavlink_message_t *msg);
+            void GetStats(int msgid, MessageBusStats *stats);
+            void Stop();
+        private:
+            typedef std::chrono::steady_clock::time_point TimePoint;
+
+            /**
+             * A subscription.
+             */
+            typedef struct Subscriber {
+                /** The subscription id **/
+                int id;
+                /** The message id subscribed to **/
+                int msgid;
+                /** How messages are delivered **/
+                DeliveryMode mode;
+                /** The handler **/
+                Handler handler;
+                /** Cleared on unsubscription **/
+                std::atomic<bool> active;
+                /** Handler calls in progress (counted before active is checked) **/
+                std::atomic<int> calls;
+            } Subscriber;
+            typedef std::vector<std::shared_ptr<Subscriber>> SubscriberList;
+
+            /**
+             * A queued delivery.
+             */
+            typedef struct Delivery {
+                /** Who to deliver to **/
+                std::shared_ptr<Subscriber> subscriber;
+                /** The message **/
+                mavlink_message_t msg;
+                /** When it was published **/
+                TimePoint published;
+            } Delivery;
+
+            /**
+             * Per-topic statistics counters.
+             */
+            typedef struct Counters {
+                std::atomic<unsigned long> published;
+                std::atomic<unsigned long> delivered;
+                std::atomic<unsigned long> dropped;
+                /** Total and worst latency, in us **/
+                std::atomic<uint64_t> latency_total, latency_max;
+            } Counters;
+
+            /** The subscriber lists (read and replaced atomically) **/
+            std::shared_ptr<const SubscriberList> m_topics[MESSAGE_BUS_TOPICS];
+            /** Serialises subscription changes **/
+            std::mutex m_subscribe_mutex;
+            /** The next subscription id **/
+            int m_next_id;
+            /** The statistics counters **/
+            Counters m_counters[MESSAGE_BUS_TOPICS];
+            /** Used to wait for handler calls to finish on unsubscription **/
+            std::mutex m_calls_mutex;
+            /** Signalled when a call to an unsubscribed handler finishes **/
+            std::condition_variable m_calls_cv;
+            /** Protects the delivery queue **/
+            std::mutex m_queue_mutex;
+            /** Signalled when a delivery is queued or on stop **/
+            std::condition_variable m_queue_cv;
+            /** The queued deliveries **/
+            std::deque<Delivery> m_queue;
+            /** Stop signal **/
+            bool m_stop;
+            /** The worker thread for queued deliveries **/
+            std::thread m_worker;
+
+            void Deliver(Subscriber &s, const mavlink_message_t *msg, TimePoint published);
+            void Worker();
+
+            /** Copy constructor (disabled) **/
+            MessageBus(const MessageBus &other);
+            /** Assignment operator (disabled) **/
+            MessageBus& operator= (const MessageBus &other);
+    };
+}
+
+#endif // _PICOPTERX_MESSAGE_BUS_H
@@ -0,0 +1,105 @@
+/**
+ * @file mjpeg_server.h
+ * @brief A minimal HTTP server for streaming JPEG frames (MJPEG).
+ */
+
+#ifndef _PICOPTERX_MJPEG_SERVER_H
+#define _PICOPTERX_MJPEG_SERVER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** The maximum number of simultaneously connected clients **/
+#define MJPEG_MAX_CLIENTS 8
+/** The number of frame buffers recycled between the publisher and clients **/
+#define MJPEG_BUFFERS (2*MJPEG_MAX_CLIENTS + 2)
+
+namespace picopter {
+    /**
+     * Serves encoded JPEG frames over HTTP, in the same style as
+     * mjpg-streamer's output_http plugin: '?action=stream' gives a
+     * multipart/x-mixed-replace stream and '?action=snapshot' gives the
+     * next frame. Frames are shared (not copied) between clients, and a
+     * client that can't keep up only ever gets the latest frame; anything
+     * older that it hasn't started receiving is dropped.
+     */
+    class MJPEGServer {
+        public:
+            MJPEGServer(uint16_t port);
+            virtual ~MJPEGServer();
+
+            uint16_t GetPort(void);
+            int GetClientCount(void);
+            unsigned long GetDroppedFrames(void);
+            void Publish(std::vector<uint8_t> *jpeg);
+        private:
+            typedef std::shared_ptr<std::vector<uint8_t>> Buffer;
+
+            /**
+             * The state of a connected client.
+             */
+            typedef struct Client {
+                /** The client socket **/
+                int fd;
+                /** The request received so far **/
+                std::string request;
+                /** Whether the request has been received **/
+                bool requested;
+                /** Whether the client wants a stream (not a snapshot) **/
+                bool stream;
+                /** The headers to be sent before the current frame **/
+                std::string head;
+                /** The frame being sent, if any **/
+                Buffer frame;
+                /** The frame to send next, if any **/
+                Buffer next;
+                /** The bytes sent of the headers, frame and trailer **/
+                size_t sent;
+                /** Close the connection once everything is sent **/
+                bool close;
+            } Client;
+
+            /** The listening socket **/
+            int m_listen_fd;
+            /** Signalled when a frame is published or on shutdown **/
+            int m_event_fd;
+            /** The port being listened on **/
+            uint16_t m_port;
+            /** Stop the server thread **/
+            std::atomic<bool> m_stop;
+            /** The number of connected clients **/
+            std::atomic<int> m_client_count;
+            /** Frames that clients did not receive because they were slow **/
+            std::atomic<unsigned long> m_dropped;
+            /** Protects m_buffers and m_latest **/
+            std::mutex m_mutex;
+            /** The frame buffers, reused once no client holds them **/
+            std::vector<Buffer> m_buffers;
+            /** The most recently published frame **/
+            Buffer m_latest;
+            /** The connected clients (server thread only) **/
+            std::vector<Client> m_clients;
+            /** The server thread **/
+            std::future<void> m_thread;
+
+            void Run(void);
+            void Accept(void);
+            void Dispatch(const Buffer &frame);
+            bool ReadRequest(Client *client);
+            void Queue(Client *client, const Buffer &frame);
+            void StartFrame(Client *client, const Buffer &frame);
+            bool Send(Client *client);
+
+            /** Copy constructor (disabled) **/
+            MJPEGServer(const MJPEGServer &other);
+            /** Assignment operator (disabled) **/
+            MJPEGServer& operator= (const MJPEGServer &other);
+    };
+}
+
+#endif // _PICOPTERX_MJPEG_SERVER_H
@@ -15,6 +15,7 @@
 #include "navigation.h"
 #include "PID.h"
 #include "observations.h"
+#include "assignment.h"
 #include <opencv2/opencv.hpp>
  
 namespace picopter {
@@ -44,6 +45,7 @@ namespace picopter {
 
 
             Observation ObservationFromImageCoords(TIME_TYPE sample_time, GPSData *pos, navigation::EulerAngle *gimbal, IMUData *imu_data, ObjectInfo *object);
+            void ObservationsFromImageCoords(TIME_TYPE sample_time, GPSData *pos, navigation::EulerAngle *gimbal, IMUData *imu_data, const std::vector<ObjectInfo> &objects, std::vector<Observation> *observations);
             Observation ObservationFromLidar(TIME_TYPE sample_time, GPSData *pos, navigation::EulerAngle *gimbal, IMUData *imu_data, double lidar_range);
             Observation AssumptionGroundLevel();
             Observation ObservationFromRemote(navigation::Coord3D &pos);
@@ -53,6 +55,7 @@ namespace picopter {
             cv::Matx33d BodyToGround(IMUData *imu_data);
             cv::Matx33d BodyToLevel(IMUData *imu_data);
             cv::Matx33d LevelToGround(IMUData *imu_data);
+            cv::Matx33d CameraToGround(navigation::EulerAngle *gimbal, IMUData *imu_data);
 
             
             navigation::Coord3D CalculateVantagePoint(GPSData *pos, Observations *object, bool has_fix);
@@ -63,6 +66,8 @@ namespace picopter {
 
 
         private:
+            /** How long to wait for a camera frame before running the loop anyway (ms) **/
+            static const int FRAME_TIMEOUT = 200;
             CLOCK_TYPE m_task_start;
             navigation::Coord3D launch_point;       //centre and orientation of the ground coordinate system
 
@@ -84,6 +89,18 @@ namespace picopter {
             int observation_image_rows, observation_image_cols;
             bool print_observation_map;
             int observation_map_count = 0;
+            int observation_map_workers;            //threads for drawing and writing the observation map
+            ThreadPool *m_map_pool;                 //draws and writes the observation map (NULL if not printing)
+            std::future<void> m_map_write;          //the observation map being written
+            bool log_sightings;
+            DataLog *m_sighting_log;                //where old sightings of objects go (NULL if not logging)
+            double association_gate;                //furthest an observation can be from an object to match it (squared std devs)
+            int track_confirm_detections;           //detections before an object is confirmed
+            int track_tentative_timeout;            //how long an unconfirmed object is kept without being seen (ms)
+            int track_lost_timeout;                 //how long a confirmed object is kept without being seen (ms)
+            Assignment m_assoc;                     //matches observations to objects
+            std::vector<Distrib> m_assoc_locations; //the observation locations being matched
+            std::vector<double> m_assoc_distances;  //distances from one object to each observation
 
 
             //void EstimatePositionFromImageCoords(GPSData *pos, navigation::EulerAngle *gimbal, IMUData *imu_data, ObjectInfo *object, double lidar_range);
@@ -95,6 +112,8 @@ namespace picopter {
             void CalculatePath(FlightController *fc, GPSData *pos,  IMUData *imu_data, navigation::Coord3D dest, navigation::Coord3D Poi, navigation::Vec3D *course);
             void PathWaypoint(FlightController *fc, GPSData *pos, IMUData *imu_data, navigation::Coord3D dest, navigation::Coord3D poi);
             bool UseLidar(ObjectInfo *object, double lidar_range);
+            void StoreObservationMap(const cv::Mat &map);
+            Observation ObservationFromRay(TIME_TYPE sample_time, const cv::Vec3d &origin, const cv::Matx33d &Mcam, const ObjectInfo *object);
 
             /** Copy constructor (disabled) **/
             ObjectTracker(const ObjectTracker &other);
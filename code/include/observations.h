@@ -45,35 +45,14 @@ Motivated by investigation into the monocular case of:
 #include "opts.h"
 #include "flightcontroller.h"
 #include "camera_stream.h"
+#include "distrib.h"
+#include "threadpool.h"
 #include <opencv2/opencv.hpp>
 
-#define TICKS_PER_SEC 1000000000l
-
-//#define TIME_TYPE std::chrono::duration<long int, std::ratio<1l, TICKS_PER_SEC> >
-#define TIME_TYPE std::chrono::steady_clock::duration
-
-//#define CLOCK_TYPE std::chrono::time_point<std::chrono::_V2::steady_clock, std::chrono::duration<long int, std::ratio<1l, TICKS_PER_SEC> > >
-#define CLOCK_TYPE std::chrono::time_point<std::chrono::steady_clock>
+/** The number of recent sightings kept per object **/
+#define SIGHTING_HISTORY 32
 namespace picopter {
 
-    //a 3d gaussian elliptical structure
-
-    typedef struct Distrib {
-        cv::Matx33d axes;   //eigenvectors are the semi-major axes, eigenvalues are the sigma=1 widths
-        cv::Vec3d vect;   //offset from origin column vector
-        //double coeffs[10];
-    } Distrib;
-    //empty measurements will just be zeroed out. A zero matrix represents infinite variance and covariance
-    //zero coefficients in the polynomial case, zeroed matrix in the vector case
-
-    //parameters to construct the elliptic structure above
-    typedef struct DistribParams {
-        double x,y,z;
-        double sigma_x, sigma_y, sigma_z;
-        double yaw, pitch, roll;
-    } DistribParams;
-
-
     //where the observation came from
     typedef enum Source {   //should probably be a collection of booleans instead of splitting sensor values
         CAMERA_BLOB,    /** blob detection has no sense of range, (include a picture) **/
@@ -112,48 +91,50 @@ namespace picopter {
 
     } Observation;
 
-    Distrib generatedistrib();                                                  //Generate an empty (sigma 1) distribution
-    Distrib generatedistrib(DistribParams params);                              //generate an distrib struct from a primitive and operators
-    DistribParams getdistribParams(Distrib A);                                  //calculate the centre and covariance widths of this object
-    
-    double sampleDistrib(Distrib &A, cv::Vec3d &B);
-
-    Distrib combineDistribs(Distrib A, Distrib B);                              //combine two distrib distributions (as though statistically independent)
-
-    Distrib translateDistrib(Distrib A, cv::Vec3d offset);
-    inline Distrib translateDistrib(Distrib A, double x, double y, double z){   //translate a distrib struct from the origin
-        return translateDistrib(A, cv::Vec3d(x,y,z));
-    }
-    Distrib rotateDistrib(Distrib A, cv::Matx33d Mrot);                         //rotate a distrib struct about the origin
-    Distrib rotateDistribEuler(Distrib A, double roll, double pitch, double yaw);    //rotate a distrib struct about the origin
-    
-    cv::Matx33d rotationMatrix(double roll, double pitch, double yaw);
-
-    Distrib stretchDistrib(Distrib A, double sx, double sy, double sz);         //stretch a distrib struct about the origin
-    inline Distrib stretchDistrib(Distrib A, double s){                         //overload
-        return stretchDistrib(A,s,s,s);}                                              
-    Distrib vectorSum(Distrib A, Distrib B);                                    //move the centre of A by a distance described by B.
-    Distrib changeStep(Distrib newLoc, Distrib oldLoc, TIME_TYPE timestep);     //find the step from one distrib to another.
+    //The compact record of an observation kept in an object's history.
+    typedef struct Sighting {
+        TIME_TYPE sample_time;
+        Source source;
+        Distrib location;
+        Distrib velocity;
+        //bounding box of the camera detection (empty if not from the camera)
+        cv::Rect bounds;
+    } Sighting;
 
-    void rasterDistrib(cv::Mat *mat, Distrib *dist, cv::Vec4b colour, double scale);
-    void storeDistrib(cv::Mat* mat, std::string filename);
+    void rasterDistrib(cv::Mat *mat, Distrib *dist, cv::Vec4b colour, double scale, ThreadPool *pool = NULL, int bands = 1);    //screen a distribution onto a map (in bands on the pool, if given)
+    void storeDistrib(cv::Mat* mat, std::string filename, int compression = 1);   //write a map as PNG (compression 0-9)
 
     //one per distinct object.
+    //The fused state is kept as it goes, so only the last SIGHTING_HISTORY sightings are
+    //remembered (to allow removing them again). Older ones are written to the log, if given.
     class Observations {
         public:
-            Observations(Observation firstSighting);
+            Observations(Observation firstSighting, DataLog *log = NULL);
             double getSameProbability(Observation observation);    //estimate the probability the given observation is of the same object
+            void getSameProbabilities(const Distrib *locations, size_t n, double *out);    //getSameProbability for many observation locations at once
+            void getDistances(const Distrib *locations, size_t n, double *out);    //squared Mahalanobis distance to many observation locations
             void appendObservation(Observation observation);       //add another sighting to this object
-            void removeObservation(Observation observation);       //remove an observation from this object
+            bool removeObservation(Observation observation);       //remove a recent observation from this object
             void updateObject(TIME_TYPE timestep);                  //update the location and velocity with the time.
+            void spillSightings();                                  //write the remembered sightings to the log (when forgetting the object)
             TIME_TYPE lastObservation();
+            unsigned long sightingCount();                          //the number of sightings ever appended
+            unsigned long detectionCount();                         //the number of those that were real detections (not assumptions)
             Distrib getLocation();
         private:
             Observation accumulator;
 
             //TIME_TYPE last_sample;                                          //A timestamp for the last observation
             //characteristic data (colour, speckle histogram, glyph ID etc)
-            std::vector<Observation> sightings;                     //the collection of sightings associated with this object
+            std::vector<Sighting> sightings;                        //ring buffer of the most recent sightings of this object
+            size_t sightings_head;                                  //where the next sighting goes
+            size_t sightings_count;                                 //how many sightings are in the ring
+            unsigned long sightings_total;                          //how many sightings were ever appended
+            unsigned long detections_total;                         //how many of those weren't assumptions
+            DataLog *sightings_log;                                 //where evicted sightings are written (may be NULL)
+
+            void pushSighting(const Observation &observation);
+            void spillSighting(const Sighting &sighting);
             //Distrib location;                                       //cumulative uncertainty distribution
             //Distrib velocity;                                       //the current distribution for velocity. distrib will be translated and inflated by this much per unit of time.
             //Distrib acceleration;                                   //the current distribution for acceleration. velocity will be translated and inflated by this much per unit of time.
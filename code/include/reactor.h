@@ -0,0 +1,73 @@
+/**
+ * @file reactor.h
+ * @brief Single-threaded event loop for descriptors and timers.
+ */
+
+#ifndef _PICOPTERX_REACTOR_H
+#define _PICOPTERX_REACTOR_H
+
+#include <functional>
+#include <map>
+
+namespace picopter {
+    /**
+     * An event loop (epoll) that runs on one thread, calling a handler when
+     * a descriptor becomes readable or a timer (timerfd) expires. Handlers
+     * run one at a time on the reactor thread, so they must not block; a
+     * slow handler holds up every other handler.
+     */
+    class Reactor {
+        public:
+            typedef std::function<void()> Handler;
+
+            Reactor();
+            virtual ~Reactor();
+
+            void Start();
+            void Stop();
+            int AddDescriptor(int fd, Handler handler);
+            int AddTimer(int period, Handler handler);
+            bool ResetTimer(int id);
+            void Remove(int id);
+        private:
+            /**
+             * A registered descriptor or timer.
+             */
+            typedef struct Entry {
+                /** The descriptor to wait on **/
+                int fd;
+                /** The timer period in ms (0 if not a timer) **/
+                int period;
+                /** What to call when it's ready **/
+                Handler handler;
+            } Entry;
+
+            /** The epoll instance **/
+            int m_epoll_fd;
+            /** Used to wake the reactor up (to stop) **/
+            int m_event_fd;
+            /** Protects m_entries and m_next_id **/
+            std::mutex m_mutex;
+            /** Held while a handler is running **/
+            std::mutex m_dispatch_mutex;
+            /** The registered descriptors and timers, by id **/
+            std::map<int, Entry> m_entries;
+            /** The next id to hand out **/
+            int m_next_id;
+            /** Stop signal **/
+            std::atomic<bool> m_stop;
+            /** The reactor thread **/
+            std::thread m_worker;
+
+            int Add(int fd, int period, Handler handler);
+            bool Arm(int fd, int period);
+            void Run();
+
+            /** Copy constructor (disabled) **/
+            Reactor(const Reactor &other);
+            /** Assignment operator (disabled) **/
+            Reactor& operator= (const Reactor &other);
+    };
+}
+
+#endif // _PICOPTERX_REACTOR_H
@@ -0,0 +1,127 @@
+/**
+ * @file seqlock.h
+ * @brief Single-writer sequence lock for publishing snapshots of plain data.
+ */
+
+#ifndef _PICOPTERX_SEQLOCK_H
+#define _PICOPTERX_SEQLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+namespace picopter {
+    /**
+     * Publishes a value from one writer thread to any number of readers.
+     * The writer never blocks, and readers never block the writer; a reader
+     * that overlaps a write simply retries its copy. Readers may also sleep
+     * until a newer value is published.
+     *
+     * T must be plain data (no owned pointers), since a reader may copy it
+     * while it is being overwritten; such copies are detected and discarded.
+     */
+    template <typename T>
+    class SeqLock {
+        public:
+            /**
+             * Constructor.
+             */
+            SeqLock()
+            : m_seq{0}
+            , m_data()
+            , m_waiters{0}
+            {}
+
+            /**
+             * Publishes a new value (writer only).
+             * @param [in] value The value to publish.
+             */
+            void Store(const T &value) {
+                uint64_t seq = m_seq.load(std::memory_order_relaxed);
+                //Odd sequence: a write is in progress.
+                m_seq.store(seq + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                m_data = value;
+                //Sequentially consistent, so it is ordered with the check
+                //for waiters below.
+                m_seq.store(seq + 2);
+
+                //Only take the lock if someone is waiting.
+                if (m_waiters.load() > 0) {
+                    std::lock_guard<std::mutex> lock(m_wait_mutex);
+                    m_wait.notify_all();
+                }
+            }
+
+            /**
+             * Copies out the latest value.
+             * @param [out] value Location to store the value.
+             * @return The version of the value (the number of stores so far).
+             */
+            uint64_t Load(T *value) const {
+                uint64_t before, after;
+                do {
+                    while ((before = m_seq.load(std::memory_order_acquire)) & 1) {
+                        //Writer is mid-copy; it will finish shortly.
+                    }
+                    *value = m_data;
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    after = m_seq.load(std::memory_order_relaxed);
+                } while (before != after);
+                return before / 2;
+            }
+
+            /**
+             * Retrieves the version of the latest value.
+             * @return The number of stores so far.
+             */
+            uint64_t Version(void) const {
+                return m_seq.load() / 2;
+            }
+
+            /**
+             * Waits for a value newer than the given version to be published.
+             * @param [in] version The last version seen by the caller.
+             * @param [out] value Location to store the value.
+             * @param [in] timeout The maximum time to wait.
+             * @return The version of the value copied out. This is not newer
+             *         than the given version if the wait timed out.
+             */
+            template <typename Rep, typename Period>
+            uint64_t Wait(uint64_t version, T *value,
+                const std::chrono::duration<Rep, Period> &timeout)
+            {
+                if (Version() <= version) {
+                    std::unique_lock<std::mutex> lock(m_wait_mutex);
+                    m_waiters++;
+                    //The writer checks for waiters after publishing, so
+                    //re-checking here means a store cannot be missed.
+                    m_wait.wait_for(lock, timeout, [this, version] {
+                        return Version() > version;
+                    });
+                    m_waiters--;
+                }
+                return Load(value);
+            }
+        private:
+            /** Sequence counter (twice the version; odd while writing) **/
+            std::atomic<uint64_t> m_seq;
+            /** The published value **/
+            T m_data;
+            /** Number of readers waiting for a new value **/
+            std::atomic<int> m_waiters;
+            /** Mutex used only to sleep/wake waiting readers **/
+            std::mutex m_wait_mutex;
+            /** Wakes waiting readers **/
+            std::condition_variable m_wait;
+
+            /** Copy constructor (disabled) **/
+            SeqLock(const SeqLock &other);
+            /** Assignment operator (disabled) **/
+            SeqLock& operator= (const SeqLock &other);
+    };
+}
+
+#endif // _PICOPTERX_SEQLOCK_H
@@ -0,0 +1,84 @@
+/**
+ * @file stream_controller.h
+ * @brief Adapts the web stream's frame rate, size and quality to the load.
+ */
+
+#ifndef _PICOPTERX_STREAM_CONTROLLER_H
+#define _PICOPTERX_STREAM_CONTROLLER_H
+
+#include <mutex>
+
+/** The number of processed frames between controller decisions **/
+#define STREAM_CONTROL_WINDOW 30
+/** Consecutive good windows needed before the stream is improved **/
+#define STREAM_CONTROL_HOLD 3
+
+namespace picopter {
+    /**
+     * How the web stream is encoded.
+     */
+    typedef struct StreamSettings {
+        /** Stream one in every 'skip' frames **/
+        int skip;
+        /** The stream width, as a percentage of STREAM_WIDTH **/
+        int scale;
+        /** The JPEG quality (0-100) **/
+        int quality;
+    } StreamSettings;
+
+    /**
+     * Closed-loop controller for the web stream. The processing stage
+     * reports how long each frame took and the output stage reports how
+     * long each streamed frame took to encode and send. Every
+     * STREAM_CONTROL_WINDOW frames, the controller steps along a ladder of
+     * progressively cheaper settings if the detection frame rate is below
+     * the floor (or the projected load exceeds the frame budget), and only
+     * steps back once the cheaper setting has had headroom for a while.
+     */
+    class StreamController {
+        public:
+            StreamController(double min_fps, int max_quality, bool adaptive);
+            virtual ~StreamController();
+
+            void SetAdaptive(bool adaptive);
+            bool GetAdaptive(void);
+            void SetMinimumFPS(double min_fps);
+            double GetMinimumFPS(void);
+            void SetMaximumQuality(int quality);
+            StreamSettings GetSettings(void);
+            void AddProcessed(double timestamp_ms, double process_ms);
+            void AddStreamed(double stream_ms);
+        private:
+            /** Protects all of the below **/
+            std::mutex m_mutex;
+            /** Whether the settings adapt to the load **/
+            bool m_adaptive;
+            /** The detection frame rate floor **/
+            double m_min_fps;
+            /** The maximum JPEG quality **/
+            int m_max_quality;
+            /** The current position on the settings ladder **/
+            int m_level;
+            /** Consecutive windows that could afford a better stream **/
+            int m_good;
+            /** Processed frames in this window **/
+            int m_frames;
+            /** When the first frame of the window was processed **/
+            double m_start;
+            /** The total processing time in this window **/
+            double m_process;
+            /** Streamed frames in this window **/
+            int m_streamed;
+            /** The total encode and send time in this window **/
+            double m_stream;
+
+            void Evaluate(double timestamp_ms);
+
+            /** Copy constructor (disabled) **/
+            StreamController(const StreamController &other);
+            /** Assignment operator (disabled) **/
+            StreamController& operator= (const StreamController &other);
+    };
+}
+
+#endif // _PICOPTERX_STREAM_CONTROLLER_H
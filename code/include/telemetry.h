@@ -0,0 +1,120 @@
+/**
+ * @file telemetry.h
+ * @brief Requests the telemetry that modules need, at the rates they need.
+ */
+
+#ifndef _PICOPTERX_TELEMETRY_H
+#define _PICOPTERX_TELEMETRY_H
+
+/* For the transmit queue (and MAVLink includes) */
+#include "mavcommsqueue.h"
+
+/** The number of MAVLink message ids **/
+#define TELEMETRY_MESSAGES 256
+/** The fastest rate that may be requested (Hz) **/
+#define TELEMETRY_MAX_RATE 50
+/** MAV_CMD_SET_MESSAGE_INTERVAL (not in older MAVLink headers) **/
+#define TELEMETRY_CMD_SET_MESSAGE_INTERVAL 511
+/** How often Check should be called (ms) **/
+#define TELEMETRY_CHECK_INTERVAL 500
+/** How long to wait for message intervals to be acknowledged (ms) **/
+#define TELEMETRY_ACK_TIMEOUT 2000
+/** How many times to ask for message intervals before using data streams **/
+#define TELEMETRY_ACK_ATTEMPTS 3
+/** How long a requested message may not arrive before it's asked for again (ms) **/
+#define TELEMETRY_ARRIVAL_TIMEOUT 3000
+
+namespace picopter {
+    /**
+     * The requested and achieved rate of a message.
+     */
+    typedef struct TelemetryRate {
+        /** The requested rate (Hz); 0 if not requested **/
+        double requested;
+        /** The rate it's arriving at (Hz), over the last second or so **/
+        double achieved;
+    } TelemetryRate;
+
+    /**
+     * Keeps track of which messages modules need and how often, and asks
+     * the autopilot for exactly that. Each message is requested with
+     * MAV_CMD_SET_MESSAGE_INTERVAL at the highest rate anyone needs, and
+     * nothing else is streamed. If the autopilot doesn't support that (or
+     * never acknowledges it), this falls back to requesting the (coarser) data
+     * stream groups. The default streams are left alone until the message
+     * intervals are acknowledged, so telemetry never stops altogether.
+     */
+    class TelemetryManager {
+        public:
+            TelemetryManager(MAVCommsQueue *tx, int component_id);
+            virtual ~TelemetryManager();
+
+            int Request(int msgid, double rate);
+            void Release(int id);
+            void Connect(int system_id, int target_component);
+            void CommandAck(const mavlink_command_ack_t *ack);
+            void Received(int msgid);
+            void Check();
+            void GetRate(int msgid, TelemetryRate *rate);
+        private:
+            typedef std::chrono::steady_clock::time_point TimePoint;
+
+            /**
+             * A module's request.
+             */
+            typedef struct Subscription {
+                /** The message id **/
+                int msgid;
+                /** The rate (Hz) **/
+                double rate;
+            } Subscription;
+
+            /** Protects everything below **/
+            std::mutex m_mutex;
+            /** Where requests are sent **/
+            MAVCommsQueue *m_tx;
+            /** Our component id **/
+            int m_component_id;
+            /** The autopilot's system and component ids **/
+            int m_target_system, m_target_component;
+            /** Whether we've heard from the autopilot **/
+            bool m_connected;
+            /** Whether to use the data streams instead of message intervals **/
+            bool m_use_streams;
+            /** Whether the autopilot has accepted a message interval **/
+            bool m_intervals_acked;
+            /** How many times message intervals have been asked for **/
+            int m_ack_attempts;
+            /** When message intervals were last asked for **/
+            TimePoint m_ack_start;
+            /** The modules' requests, by id **/
+            std::map<int, Subscription> m_subscriptions;
+            /** The next request id **/
+            int m_next_id;
+            /** The rate last asked of the autopilot, for each message **/
+            double m_requested[TELEMETRY_MESSAGES];
+            /** When each message was last asked for **/
+            TimePoint m_requested_at[TELEMETRY_MESSAGES];
+            /** Messages received in this window **/
+            unsigned long m_counts[TELEMETRY_MESSAGES];
+            /** The achieved rates, as of the last window **/
+            double m_achieved[TELEMETRY_MESSAGES];
+            /** When the current window started **/
+            TimePoint m_window_start;
+
+            double Needed(int msgid);
+            void Update(int msgid);
+            void SendInterval(int msgid, double rate);
+            void SendStreams();
+            void StopDefaultStreams();
+            void RequestAll(TimePoint now);
+            void Roll(TimePoint now);
+
+            /** Copy constructor (disabled) **/
+            TelemetryManager(const TelemetryManager &other);
+            /** Assignment operator (disabled) **/
+            TelemetryManager& operator= (const TelemetryManager &other);
+    };
+}
+
+#endif // _PICOPTERX_TELEMETRY_H
@@ -7,30 +7,27 @@
 #define _PICOPTERX_WATCHDOG_H
 
 #include <functional>
+#include "reactor.h"
 
 namespace picopter {
     class Watchdog {
         public:
-            Watchdog(int timeout, std::function<void()> cb);
+            Watchdog(Reactor *reactor, int timeout, std::function<void()> cb);
             virtual ~Watchdog();
             
             void Start();
             void Stop();
             void Touch();
         private:
-            /** Worker thread. **/
-            std::thread m_worker;
-            /** End indicator. **/
-            std::atomic<bool> m_stop;
-            /** Watchdog index. **/
-            std::atomic<int> m_index;
+            /** The reactor that runs the timer. **/
+            Reactor *m_reactor;
+            /** The timer id (negative if not started). **/
+            std::atomic<int> m_timer;
             /** The watchdog timeout, in milliseconds. **/
             int m_timeout;
             /** Handle to the callback if a timeout occurs. **/
             std::function<void()> m_callback;
             
-            /** Worker thread **/
-            void Worker();
             /** Copy constructor (disabled) **/
             Watchdog(const Watchdog &other);
             /** Assignment operator (disabled) **/
@@ -38,4 +35,4 @@ namespace picopter {
     };
 }
 
-#endif // _PICOPTERX_WATCHDOG_H
\ No newline at end of file
+#endif // _PICOPTERX_WATCHDOG_H
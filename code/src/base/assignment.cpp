@@ -0,0 +1,160 @@
+/**
+ * @file assignment.cpp
+ * @brief Optimal (minimum cost) assignment of rows to columns.
+ * Uses the Hungarian algorithm, in its shortest augmenting path form
+ * (O(n^2 m) for n <= m). Disallowed pairs are given a cost so large that a
+ * solution using fewer of them is always cheaper, and are then dropped.
+ */
+
+#include "common.h"
+#include "assignment.h"
+#include <algorithm>
+#include <limits>
+
+using namespace picopter;
+
+/**
+ * Constructor. Starts with an empty problem.
+ */
+Assignment::Assignment()
+: m_rows(0)
+, m_cols(0)
+, m_cost(0)
+{
+}
+
+/**
+ * Starts a new problem, with no pairs allowed.
+ * @param [in] rows The number of rows.
+ * @param [in] cols The number of columns.
+ */
+void Assignment::Reset(size_t rows, size_t cols) {
+    m_rows = rows;
+    m_cols = cols;
+    m_cost = 0;
+    m_entries.clear();
+    m_row_match.assign(rows, -1);
+    m_col_match.assign(cols, -1);
+}
+
+/**
+ * Allows a row to be paired with a column.
+ * @param [in] row The row.
+ * @param [in] col The column.
+ * @param [in] cost The cost of the pairing (non-negative).
+ */
+void Assignment::Set(size_t row, size_t col, double cost) {
+    if (row < m_rows && col < m_cols && cost >= 0 &&
+        cost < std::numeric_limits<double>::infinity()) {
+        m_entries.push_back(Entry{static_cast<int>(row), static_cast<int>(col), cost});
+    }
+}
+
+/**
+ * Solves the problem. The result is retrieved with RowMatch and ColMatch.
+ * @return The number of pairs made.
+ */
+size_t Assignment::Solve() {
+    const double inf = std::numeric_limits<double>::infinity();
+
+    //Compact the rows and columns down to those with allowed pairs.
+    m_row_index.assign(m_rows, -1);
+    m_col_index.assign(m_cols, -1);
+    m_rows_used.clear();
+    m_cols_used.clear();
+    double highest = 0;
+    for (const Entry &e : m_entries) {
+        if (m_row_index[e.row] < 0) {
+            m_row_index[e.row] = m_rows_used.size();
+            m_rows_used.push_back(e.row);
+        }
+        if (m_col_index[e.col] < 0) {
+            m_col_index[e.col] = m_cols_used.size();
+            m_cols_used.push_back(e.col);
+        }
+        highest = std::max(highest, e.cost);
+    }
+
+    //Solve with the shorter side as the rows.
+    bool transpose = m_rows_used.size() > m_cols_used.size();
+    size_t n = std::min(m_rows_used.size(), m_cols_used.size());
+    size_t m = std::max(m_rows_used.size(), m_cols_used.size());
+    if (n == 0) {
+        return 0;
+    }
+
+    //Any n pairs of allowed costs total less than one disallowed pair.
+    double disallowed = highest * n + 1;
+    m_dense.assign(n * m, disallowed);
+    for (const Entry &e : m_entries) {
+        int i = m_row_index[e.row], j = m_col_index[e.col];
+        double &c = transpose ? m_dense[j * m + i] : m_dense[i * m + j];
+        c = std::min(c, e.cost);
+    }
+
+    //Potentials and matches are 1-based; column 0 is the augmenting root.
+    m_u.assign(n + 1, 0);
+    m_v.assign(m + 1, 0);
+    m_p.assign(m + 1, 0);
+    m_way.assign(m + 1, 0);
+    for (size_t i = 1; i <= n; i++) {
+        m_p[0] = i;
+        size_t j0 = 0;
+        m_minv.assign(m + 1, inf);
+        m_used.assign(m + 1, 0);
+        do {
+            m_used[j0] = 1;
+            int i0 = m_p[j0];
+            double delta = inf;
+            size_t j1 = 0;
+            for (size_t j = 1; j <= m; j++) {
+                if (!m_used[j]) {
+                    double cur = m_dense[(i0 - 1) * m + (j - 1)] - m_u[i0] - m_v[j];
+                    if (cur < m_minv[j]) {
+                        m_minv[j] = cur;
+                        m_way[j] = j0;
+                    }
+                    if (m_minv[j] < delta) {
+                        delta = m_minv[j];
+                        j1 = j;
+                    }
+                }
+            }
+            for (size_t j = 0; j <= m; j++) {
+                if (m_used[j]) {
+                    m_u[m_p[j]] += delta;
+                    m_v[j] -= delta;
+                } else {
+                    m_minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (m_p[j0] != 0);
+
+        //Flip the augmenting path.
+        do {
+            size_t j1 = m_way[j0];
+            m_p[j0] = m_p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    //Keep the allowed pairs, mapped back to the original rows and columns.
+    size_t pairs = 0;
+    for (size_t j = 1; j <= m; j++) {
+        if (m_p[j] == 0) {
+            continue;
+        }
+        size_t i = m_p[j] - 1;
+        double c = m_dense[i * m + (j - 1)];
+        if (c < disallowed) {
+            int row = transpose ? m_rows_used[j - 1] : m_rows_used[i];
+            int col = transpose ? m_cols_used[i] : m_cols_used[j - 1];
+            m_row_match[row] = col;
+            m_col_match[col] = row;
+            m_cost += c;
+            pairs++;
+        }
+    }
+    return pairs;
+}
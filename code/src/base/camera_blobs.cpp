@@ -0,0 +1,288 @@
+/**
+ * @file camera_blobs.cpp
+ * @brief Connected component (blob) labelling of binary images.
+ */
+
+#include "camera_blobs.h"
+#include <algorithm>
+
+using namespace picopter;
+
+/**
+ * Constructor.
+ * @param [in] close_size The size of the square element to close the image
+ *                        with before labelling (0 or 1 for no closing).
+ */
+BlobLabeller::BlobLabeller(int close_size)
+: m_size(std::max(1, close_size))
+, m_before(m_size / 2)
+, m_after(m_size - 1 - m_size / 2)
+, m_width(0)
+{
+}
+
+/**
+ * Destructor.
+ */
+BlobLabeller::~BlobLabeller() {
+}
+
+/**
+ * Closes and labels a binary image. All buffers are reused between calls,
+ * so once warmed up this does not allocate (other than for new labels).
+ * @param [in,out] mask The image (non-zero pixels are set). It is
+ *                      overwritten with the closed image (0 or 255).
+ * @param [in] width The image width.
+ * @param [in] height The image height.
+ * @param [in] stride The distance in bytes between rows of the image.
+ * @return The number of blobs found.
+ */
+size_t BlobLabeller::Label(uint8_t *mask, int width, int height, int stride) {
+    //Two extra rows, so a row can be added before the oldest is removed.
+    int ring = m_size + 2;
+    m_width = width;
+    m_input.assign(ring * width, 0);
+    m_dilated.assign(ring * width, 0);
+    m_set_count.assign(width, 0);
+    m_clear_count.assign(width, 0);
+    m_closed.resize(width);
+    m_labels[0].assign(width, -1);
+    m_labels[1].assign(width, -1);
+    m_parent.clear();
+    m_stats.clear();
+    m_blobs.clear();
+
+    //Each closed row needs the dilated rows up to m_after below it, which in
+    //turn need the input rows up to m_after below them. Input rows are
+    //copied as they are read, so the output can overwrite them.
+    int next_input = 0, next_dilated = 0;
+    for (int y = 0; y < height; y++) {
+        int need_dilated = std::min(height - 1, y + m_after);
+        while (next_dilated <= need_dilated) {
+            int need_input = std::min(height - 1, next_dilated + m_after);
+            while (next_input <= need_input) {
+                AddInput(mask + next_input * stride, next_input);
+                next_input++;
+            }
+            Dilate(next_dilated, &m_dilated[(next_dilated % ring) * width]);
+            next_dilated++;
+        }
+
+        Erode(y, m_closed.data());
+        uint8_t *out = mask + y * stride;
+        for (int x = 0; x < width; x++) {
+            out[x] = m_closed[x] ? 255 : 0;
+        }
+        LabelRow(m_closed.data(), y);
+    }
+
+    //Merge the statistics of joined labels into their roots.
+    for (size_t i = 0; i < m_parent.size(); i++) {
+        int root = Find(i);
+        if (root != static_cast<int>(i)) {
+            Blob &r = m_stats[root], &b = m_stats[i];
+            r.m00 += b.m00;
+            r.m10 += b.m10;
+            r.m01 += b.m01;
+            r.min_x = std::min(r.min_x, b.min_x);
+            r.min_y = std::min(r.min_y, b.min_y);
+            r.max_x = std::max(r.max_x, b.max_x);
+            r.max_y = std::max(r.max_y, b.max_y);
+        }
+    }
+    for (size_t i = 0; i < m_parent.size(); i++) {
+        if (m_parent[i] == static_cast<int>(i)) {
+            m_blobs.push_back(m_stats[i]);
+        }
+    }
+    return m_blobs.size();
+}
+
+/**
+ * Retrieves the blobs found by the last call to Label.
+ * @return The blobs, in no particular order.
+ */
+const std::vector<Blob>& BlobLabeller::GetBlobs() {
+    return m_blobs;
+}
+
+/**
+ * Retrieves the largest blobs found by the last call to Label.
+ * @param [in] k The maximum number of blobs to retrieve.
+ * @param [in] min_area Only blobs with more pixels than this are retrieved.
+ * @param [out] blobs The blobs, in order of decreasing size.
+ * @return The number of blobs retrieved.
+ */
+size_t BlobLabeller::GetLargest(size_t k, int64_t min_area, std::vector<Blob> *blobs) {
+    blobs->clear();
+    for (const Blob &b : m_blobs) {
+        if (b.m00 > min_area) {
+            blobs->push_back(b);
+        }
+    }
+
+    k = std::min(k, blobs->size());
+    std::partial_sort(blobs->begin(), blobs->begin() + k, blobs->end(),
+        [] (const Blob &a, const Blob &b) {
+            return a.m00 > b.m00;
+        });
+    blobs->resize(k);
+    return k;
+}
+
+/**
+ * Adds an input row to the per-column counts used for dilation.
+ * @param [in] row The input row.
+ * @param [in] y The row index.
+ */
+void BlobLabeller::AddInput(const uint8_t *row, int y) {
+    uint8_t *copy = &m_input[(y % (m_size + 2)) * m_width];
+    for (int x = 0; x < m_width; x++) {
+        copy[x] = row[x] ? 1 : 0;
+        m_set_count[x] += copy[x];
+    }
+}
+
+/**
+ * Computes a dilated row. Pixels outside the image do not contribute.
+ * Also adds the row to the per-column counts used for erosion.
+ * @param [in] y The row index. Input rows up to y + m_after must be added.
+ * @param [out] out The dilated row (0/1).
+ */
+void BlobLabeller::Dilate(int y, uint8_t *out) {
+    //Drop the input row that has left the vertical window.
+    int old = y - m_before - 1;
+    if (old >= 0) {
+        const uint8_t *row = &m_input[(old % (m_size + 2)) * m_width];
+        for (int x = 0; x < m_width; x++) {
+            m_set_count[x] -= row[x];
+        }
+    }
+
+    //Sliding count of columns with any set pixel in the window.
+    int active = 0;
+    for (int x = 0; x <= m_after && x < m_width; x++) {
+        active += m_set_count[x] > 0;
+    }
+    for (int x = 0; x < m_width; x++) {
+        out[x] = active > 0;
+        m_clear_count[x] += !out[x];
+        if (x + m_after + 1 < m_width) {
+            active += m_set_count[x + m_after + 1] > 0;
+        }
+        if (x - m_before >= 0) {
+            active -= m_set_count[x - m_before] > 0;
+        }
+    }
+}
+
+/**
+ * Computes an eroded (closed) row. Pixels outside the image count as set.
+ * @param [in] y The row index. Dilated rows up to y + m_after must be done.
+ * @param [out] out The closed row (0/1).
+ */
+void BlobLabeller::Erode(int y, uint8_t *out) {
+    //Drop the dilated row that has left the vertical window.
+    int old = y - m_before - 1;
+    if (old >= 0) {
+        const uint8_t *row = &m_dilated[(old % (m_size + 2)) * m_width];
+        for (int x = 0; x < m_width; x++) {
+            m_clear_count[x] -= !row[x];
+        }
+    }
+
+    //Sliding count of columns with any clear pixel in the window.
+    int holes = 0;
+    for (int x = 0; x <= m_after && x < m_width; x++) {
+        holes += m_clear_count[x] > 0;
+    }
+    for (int x = 0; x < m_width; x++) {
+        out[x] = holes == 0;
+        if (x + m_after + 1 < m_width) {
+            holes += m_clear_count[x + m_after + 1] > 0;
+        }
+        if (x - m_before >= 0) {
+            holes -= m_clear_count[x - m_before] > 0;
+        }
+    }
+}
+
+/**
+ * Labels the runs of set pixels in a row, joining them to any 8-connected
+ * runs in the previous row, and accumulates their statistics.
+ * @param [in] row The row (0/1).
+ * @param [in] y The row index.
+ */
+void BlobLabeller::LabelRow(const uint8_t *row, int y) {
+    std::vector<int> &cur = m_labels[y & 1];
+    const std::vector<int> &prev = m_labels[(y + 1) & 1];
+    std::fill(cur.begin(), cur.end(), -1);
+
+    for (int x = 0; x < m_width; x++) {
+        if (!row[x]) {
+            continue;
+        }
+        int start = x;
+        while (x + 1 < m_width && row[x + 1]) {
+            x++;
+        }
+        int end = x;
+
+        //Join with every run above that touches this one (incl. diagonally).
+        int label = -1, last = -1;
+        if (y > 0) {
+            for (int i = std::max(0, start - 1); i <= std::min(m_width - 1, end + 1); i++) {
+                if (prev[i] >= 0 && prev[i] != last) {
+                    last = prev[i];
+                    label = label < 0 ? Find(last) : Union(label, last);
+                }
+            }
+        }
+        if (label < 0) {
+            label = static_cast<int>(m_parent.size());
+            m_parent.push_back(label);
+            m_stats.push_back(Blob{0, 0, 0, start, y, end, y});
+        }
+
+        int64_t length = end - start + 1;
+        Blob &b = m_stats[label];
+        b.m00 += length;
+        b.m10 += (static_cast<int64_t>(start + end) * length) / 2;
+        b.m01 += static_cast<int64_t>(y) * length;
+        b.min_x = std::min(b.min_x, start);
+        b.min_y = std::min(b.min_y, y);
+        b.max_x = std::max(b.max_x, end);
+        b.max_y = std::max(b.max_y, y);
+        std::fill(cur.begin() + start, cur.begin() + end + 1, label);
+    }
+}
+
+/**
+ * Finds the root of a label (with path halving).
+ * @param [in] label The label.
+ * @return The root label.
+ */
+int BlobLabeller::Find(int label) {
+    while (m_parent[label] != label) {
+        m_parent[label] = m_parent[m_parent[label]];
+        label = m_parent[label];
+    }
+    return label;
+}
+
+/**
+ * Joins two labels. The lower root becomes the root of both.
+ * @param [in] a The first label.
+ * @param [in] b The second label.
+ * @return The root of the joined labels.
+ */
+int BlobLabeller::Union(int a, int b) {
+    a = Find(a);
+    b = Find(b);
+    if (a < b) {
+        m_parent[b] = a;
+        return a;
+    }
+    m_parent[a] = b;
+    return b;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file camera_glyph_bank.cpp
+ * @brief Bit-packed glyph templates for fast glyph recognition.
+ */
+
+#include "camera_glyph_bank.h"
+
+using namespace picopter;
+
+/** The number of bits in a template. **/
+#define GLYPH_BANK_BITS (GLYPH_BANK_SIZE * GLYPH_BANK_SIZE)
+
+/**
+ * Counts the set bits in a word.
+ * @param [in] v The word.
+ * @return The number of set bits.
+ */
+static inline int PopCount(uint64_t v) {
+    return __builtin_popcountll(v);
+}
+
+/**
+ * Constructor. Creates an empty glyph bank.
+ */
+GlyphBank::GlyphBank() {
+}
+
+/**
+ * Destructor.
+ */
+GlyphBank::~GlyphBank() {
+}
+
+/**
+ * Packs an image into one word per row (bit x is pixel x).
+ * @param [in] image The GLYPH_BANK_SIZE square image (non-zero is set).
+ * @param [in] stride The distance in bytes between rows of the image.
+ * @param [out] rows The GLYPH_BANK_SIZE packed rows.
+ */
+void GlyphBank::Pack(const uint8_t *image, int stride, uint64_t *rows) {
+    for (int y = 0; y < GLYPH_BANK_SIZE; y++) {
+        const uint8_t *row = image + y * stride;
+        uint64_t bits = 0;
+        for (int x = 0; x < GLYPH_BANK_SIZE; x++) {
+            bits |= static_cast<uint64_t>(row[x] != 0) << x;
+        }
+        rows[y] = bits;
+    }
+}
+
+/**
+ * Adds a glyph to the bank, in all four rotations.
+ * @param [in] image The GLYPH_BANK_SIZE square glyph image (non-zero is set).
+ * @param [in] stride The distance in bytes between rows of the image.
+ */
+void GlyphBank::Add(const uint8_t *image, int stride) {
+    const int n = GLYPH_BANK_SIZE;
+    std::vector<uint8_t> turned(n * n), next(n * n);
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            turned[y * n + x] = image[y * stride + x];
+        }
+    }
+
+    size_t base = m_bits.size();
+    m_bits.resize(base + 4 * n);
+    for (int r = 0; r < 4; r++) {
+        Pack(turned.data(), n, &m_bits[base + r * n]);
+        //Turn a quarter clockwise for the next rotation.
+        for (int y = 0; y < n; y++) {
+            for (int x = 0; x < n; x++) {
+                next[y * n + x] = turned[(n - 1 - x) * n + y];
+            }
+        }
+        turned.swap(next);
+    }
+}
+
+/**
+ * Removes all glyphs from the bank.
+ */
+void GlyphBank::Clear() {
+    m_bits.clear();
+}
+
+/**
+ * Retrieves the number of glyphs in the bank.
+ * @return The number of glyphs.
+ */
+size_t GlyphBank::Size() const {
+    return m_bits.size() / (4 * GLYPH_BANK_SIZE);
+}
+
+/**
+ * Finds the glyph (and rotation) that best matches an image. On a tie, an
+ * unrotated match is preferred, so a glyph that is a rotation of another
+ * is reported as itself.
+ * @param [in] image The GLYPH_BANK_SIZE square image (non-zero is set).
+ * @param [in] stride The distance in bytes between rows of the image.
+ * @param [in] min_similarity The minimum fraction of pixels that must agree.
+ * @param [out] match The best match, if any.
+ * @return true iff a glyph matched with at least the minimum similarity.
+ */
+bool GlyphBank::Match(const uint8_t *image, int stride, double min_similarity,
+    GlyphMatch *match) const
+{
+    uint64_t rows[GLYPH_BANK_SIZE];
+    Pack(image, stride, rows);
+
+    //Templates are abandoned as soon as they can't beat the best so far.
+    int limit = static_cast<int>((1.0 - min_similarity) * GLYPH_BANK_BITS);
+    int best = -1, best_distance = limit + 1;
+    size_t templates = m_bits.size() / GLYPH_BANK_SIZE;
+    for (size_t t = 0; t < templates; t++) {
+        const uint64_t *bits = &m_bits[t * GLYPH_BANK_SIZE];
+        //An unrotated template only has to equal a rotated best.
+        int bound = best_distance + (best >= 0 && best % 4 != 0 && t % 4 == 0);
+        int distance = 0;
+        for (int y = 0; y < GLYPH_BANK_SIZE && distance < bound; y += 8) {
+            distance += PopCount(bits[y] ^ rows[y]) +
+                PopCount(bits[y + 1] ^ rows[y + 1]) +
+                PopCount(bits[y + 2] ^ rows[y + 2]) +
+                PopCount(bits[y + 3] ^ rows[y + 3]) +
+                PopCount(bits[y + 4] ^ rows[y + 4]) +
+                PopCount(bits[y + 5] ^ rows[y + 5]) +
+                PopCount(bits[y + 6] ^ rows[y + 6]) +
+                PopCount(bits[y + 7] ^ rows[y + 7]);
+        }
+        if (distance < bound) {
+            best = static_cast<int>(t);
+            best_distance = distance;
+        }
+    }
+
+    if (best < 0) {
+        return false;
+    }
+    match->index = best / 4;
+    match->rotation = best % 4;
+    match->similarity = 1.0 - static_cast<double>(best_distance) / GLYPH_BANK_BITS;
+    return true;
+}
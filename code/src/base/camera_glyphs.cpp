@@ -16,6 +16,7 @@ using picopter::Options;
 using namespace rapidjson;
 
 #define GLYPH_BLACK_THRESHOLD 140
+#define GLYPH_MIN_SIMILARITY 0.85
 
 /**
  * Unpacks a glyph from the given options entry.
@@ -61,9 +62,22 @@ static void GlyphUnpickler(const void *val, void *closure) {
  * @param [in] opts The instance to load glyphs from.
  */
 void CameraStream::LoadGlyphs(Options *opts) {
+    m_glyph_similarity = GLYPH_MIN_SIMILARITY;
     if (opts) {
         opts->SetFamily("CAMERA_GLYPHS");
         opts->GetList("GLYPH_LIST", (void*)&m_glyphs, GlyphUnpickler);
+        m_glyph_similarity = picopter::clamp(
+            opts->GetReal("MIN_SIMILARITY", GLYPH_MIN_SIMILARITY), 0.5, 1.0);
+    }
+
+    //Normalise every glyph to the same size so they can be matched at once.
+    cv::Mat canonical;
+    m_glyph_bank.Clear();
+    for (CameraGlyph &g : m_glyphs) {
+        cv::resize(g.image, canonical,
+            cv::Size(GLYPH_BANK_SIZE, GLYPH_BANK_SIZE), 0, 0, cv::INTER_AREA);
+        cv::threshold(canonical, canonical, 127, 255, cv::THRESH_BINARY);
+        m_glyph_bank.Add(canonical.ptr<uint8_t>(), canonical.step);
     }
 }
 
@@ -111,27 +125,71 @@ static std::vector<cv::Point2f> OrderPoints(std::vector<cv::Point>& pts) {
 
 /**
  * Use the contour points to warp the quad into a top-down perspective.
- * This function will only warp at least somewhat square quads.
  * @param [in] in The input frame.
  * @param [out] out The output frame.
  * @param [in] src The four defining points of the quad, ordered by:
  *                 (tl, tr, bl, br). (Use OrderPoints).
- * @return true iff it was warped.
+ * @param [in] size The size to warp the quad to.
  */
-static bool WarpPerspective(cv::Mat &in, cv::Mat &out, std::vector<cv::Point2f> &src) {
-    cv::Rect b = std::move(cv::boundingRect(src));
-    //float ratio = static_cast<float>(b.width)/b.height;
-    
-    //Discard largely non-square images
-    //if (ratio < 0.4 || ratio > 1.6)
-    //    return false;
-    
-    std::vector<cv::Point2f> dst{cv::Point2f(0,0), cv::Point2f(b.width-1, 0),
-        cv::Point2f(b.width-1,b.height-1), cv::Point2f(0, b.height-1)};
-    cv::Mat trn = std::move(cv::getPerspectiveTransform(src, dst));
-    cv::warpPerspective(in, out, trn, b.size());
-    
-    return true;
+static void WarpPerspective(const cv::Mat &in, cv::Mat &out,
+    const std::vector<cv::Point2f> &src, cv::Size size)
+{
+    std::vector<cv::Point2f> dst{cv::Point2f(0,0), cv::Point2f(size.width-1, 0),
+        cv::Point2f(size.width-1,size.height-1), cv::Point2f(0, size.height-1)};
+    cv::Mat trn = cv::getPerspectiveTransform(src, dst);
+    cv::warpPerspective(in, out, trn, size);
+}
+
+/**
+ * Attempts to match the provided image with a known glyph. This only uses
+ * the glyph bank (and the given buffers), so it may be called concurrently.
+ * @param [in] roi The image to match to a glyph.
+ * @param [in] scratch Buffer for the resized image, if roi isn't the bank size.
+ * @param [out] quad The thresholded image that was matched.
+ * @param [out] match The glyph that was matched.
+ * @return true iff a glyph was matched.
+ */
+bool CameraStream::MatchGlyph(const cv::Mat &roi, cv::Mat &scratch,
+    cv::Mat &quad, GlyphMatch *match) const
+{
+    if (m_glyph_bank.Size() == 0) {
+        return false;
+    }
+
+    //Normalise the image to the glyph bank size.
+    const cv::Mat *img = &roi;
+    if (roi.cols != GLYPH_BANK_SIZE || roi.rows != GLYPH_BANK_SIZE) {
+        cv::resize(roi, scratch, cv::Size(GLYPH_BANK_SIZE, GLYPH_BANK_SIZE));
+        img = &scratch;
+    }
+    cv::cvtColor(*img, quad, CV_BGR2GRAY);
+    cv::inRange(quad, cv::Scalar(0), cv::Scalar(GLYPH_BLACK_THRESHOLD), quad);
+
+    //Score against every glyph in every rotation; keep the best if good enough.
+    return m_glyph_bank.Match(quad.ptr<uint8_t>(), quad.step,
+        m_glyph_similarity, match);
+}
+
+/**
+ * Adds a matched glyph to the detected object list.
+ * @param [in] src The source image. Only used to get image bounds.
+ * @param [in] match The glyph that was matched.
+ * @param [in] bounds The bounding rectangle of the glyph.
+ */
+void CameraStream::AddGlyph(const cv::Mat &src, const GlyphMatch &match, cv::Rect bounds) {
+    const CameraGlyph &g = m_glyphs[match.index];
+    ObjectInfo obj{};
+
+    Log(LOG_DEBUG, "DETECTED %d<%s>! %.2f (rotation %d)",
+        g.id, g.description.c_str(), match.similarity, match.rotation * 90);
+    obj.id = g.id;
+    obj.image_width = src.cols;
+    obj.image_height = src.rows;
+    obj.bounds = bounds;
+    obj.position = navigation::Point2D{
+        obj.bounds.x + obj.bounds.width/2.0,
+        obj.bounds.y + obj.bounds.height/2.0};
+    m_detected.push_back(obj);
 }
 
 /**
@@ -139,92 +197,107 @@ static bool WarpPerspective(cv::Mat &in, cv::Mat &out, std::vector<cv::Point2f>
  * @param [in] src The source image. Only used to get image bounds.
  * @param [in] roi The image to match to a glpyh.
  * @param [in] bounds The bounding rectangle of the glyph.
- * @return true iff glyphs were matched.
+ * @return true iff a glyph was matched.
  */
 bool CameraStream::GlyphDetection(cv::Mat &src, cv::Mat& roi, cv::Rect bounds) {
-    bool ret = false;
-    cv::Mat rquad;
-    ObjectInfo obj{};
-    
-    //Perform initial resize.
-    if (m_glyphs.size() > 0) {
-        cv::resize(roi, rquad, 
-            cv::Size(m_glyphs[0].image.cols, m_glyphs[0].image.rows));
-        cv::cvtColor(rquad, rquad, CV_BGR2GRAY);
-        cv::inRange(rquad, cv::Scalar(0), cv::Scalar(GLYPH_BLACK_THRESHOLD), rquad);
+    GlyphMatch match;
+    bool ret = MatchGlyph(roi, m_scratch, m_glyph_quad, &match);
+
+    //Display the warped and resized image
+    if (m_demo_mode && !m_glyph_quad.empty()) {
+        cv::imshow("Test", m_glyph_quad);
     }
-    
-    for(size_t i = 0; i < m_glyphs.size(); i++) {
-        //Resize if necessary
-        if (rquad.cols != m_glyphs[i].image.cols || rquad.rows != m_glyphs[i].image.rows) {
-            cv::resize(roi, rquad, 
-                cv::Size(m_glyphs[i].image.cols, m_glyphs[i].image.rows));
-            cv::cvtColor(rquad, rquad, CV_BGR2GRAY);
-            cv::inRange(rquad, cv::Scalar(0), cv::Scalar(GLYPH_BLACK_THRESHOLD), rquad);
-        }
-        
-        //Display the warped and resized image
-        if (m_demo_mode) {
-            cv::imshow("Test", rquad);
-            //cv::imwrite("test.png", rquad);
-            //cv::waitKey(0);
-        }
-        
-        //Perform template matching. This is the bottleneck if the template image is large.
-        cv::Mat result(1, 1, CV_32FC1);
-        cv::matchTemplate(rquad, m_glyphs[i].image, result, CV_TM_CCORR_NORMED);
 
-        //Get the correlation value (no need for minMaxLoc - one result only)
-        //double minVal; double maxVal;
-        //cv::minMaxLoc(result, &minVal, &maxVal, NULL, NULL, cv::Mat());
-        
-        //Check goodness of fit. If good, add it.
-        if (result.at<float>(0,0) > 0.8) {
-            Log(LOG_DEBUG, "DETECTED %d<%s>! %.2f", 
-                m_glyphs[i].id, m_glyphs[i].description.c_str(),
-                result.at<float>(0,0));
-            obj.id = m_glyphs[i].id;
-            obj.image_width = src.cols;
-            obj.image_height = src.rows;
-            obj.bounds = bounds;
-            obj.position = navigation::Point2D{
-                obj.bounds.x + obj.bounds.width/2.0,
-                obj.bounds.y + obj.bounds.height/2.0};
-            m_detected.push_back(obj);
-            
-            ret = true;
-        }
+    if (ret) {
+        AddGlyph(src, match, bounds);
     }
     return ret;
 }
 
 /**
- * Performs glyph detection on the contour list.
+ * Checks if a contour is a quad and if so, tries to match it to a glyph.
+ * Each candidate has its own buffers, so candidates may be evaluated
+ * concurrently.
+ * @param [in] src The source image.
+ * @param [in] contour The contour to evaluate.
+ * @param [out] candidate The candidate state and result.
+ */
+void CameraStream::EvaluateGlyphCandidate(const cv::Mat &src,
+    const std::vector<cv::Point> &contour, GlyphCandidate *candidate) const
+{
+    candidate->matched = false;
+    candidate->quad.release();
+    if (cv::contourArea(contour) <= 10) {
+        return;
+    }
+
+    double perimiter = cv::arcLength(contour, true);
+    cv::approxPolyDP(contour, candidate->approx, 0.01*perimiter, true);
+    if (candidate->approx.size() == 4 && cv::isContourConvex(candidate->approx)) {
+        //We probably have a quad. Warp it straight to the glyph size.
+        std::vector<cv::Point2f> pts = OrderPoints(candidate->approx);
+        candidate->bounds = cv::boundingRect(pts);
+        WarpPerspective(src, candidate->warp, pts,
+            cv::Size(GLYPH_BANK_SIZE, GLYPH_BANK_SIZE));
+        //(Already the bank size, so no resize buffer is needed.)
+        candidate->matched = MatchGlyph(candidate->warp, candidate->warp,
+            candidate->quad, &candidate->match);
+    }
+}
+
+/**
+ * Performs glyph detection on the contour list. The contours are evaluated
+ * in parallel on the thread pool, then merged in contour order so the
+ * results don't depend on the order the jobs finish in.
  * @param [in] src The source image to detect glyphs from.
  * @param [in] contours The corresponding contour list.
  * @return true iff detected.
  */
-bool CameraStream::GlyphContourDetection(cv::Mat& src, std::vector<std::vector<cv::Point>> contours) {
+bool CameraStream::GlyphContourDetection(cv::Mat& src, const std::vector<std::vector<cv::Point>> &contours) {
     bool ret = false;
     m_detected.clear();
-    
-    for (size_t i = 0; i < contours.size(); i++) {
-        double area = cv::contourArea(contours[i]);
-        if (area > 10) {
-            double perimiter = cv::arcLength(contours[i], true);
-            std::vector<cv::Point> approx;
-            cv::approxPolyDP(contours[i], approx, 0.01*perimiter, true);
-            
-            if (approx.size() == 4 && cv::isContourConvex(approx)) { //We probably have a quad.
-                cv::Mat quad;
-                std::vector<cv::Point2f> pts = std::move(OrderPoints(approx));
-                
-                if (WarpPerspective(src, quad, pts)) {
-                    ret |= GlyphDetection(src, quad, cv::boundingRect(pts));
-                }
-            }
+
+    size_t count = contours.size();
+    while (m_glyph_candidates.size() < count) {
+        m_glyph_candidates.emplace_back();
+        m_glyph_candidates.back().warp.allocator = &m_allocator;
+        m_glyph_candidates.back().quad.allocator = &m_allocator;
+    }
+
+    //The first candidate is done on this thread while the pool does the rest.
+    if (count > 0) {
+        const cv::Mat &csrc = src;
+        std::vector<std::future<void>> jobs;
+        jobs.reserve(count - 1);
+        for (size_t i = 1; i < count; i++) {
+            GlyphCandidate *candidate = &m_glyph_candidates[i];
+            const std::vector<cv::Point> *contour = &contours[i];
+            jobs.emplace_back(m_pool.enqueue([this, &csrc, contour, candidate] {
+                EvaluateGlyphCandidate(csrc, *contour, candidate);
+            }));
+        }
+        EvaluateGlyphCandidate(csrc, contours[0], &m_glyph_candidates[0]);
+        for (auto &&job : jobs) {
+            job.get();
+        }
+    }
+
+    const cv::Mat *shown = NULL;
+    for (size_t i = 0; i < count; i++) {
+        const GlyphCandidate &candidate = m_glyph_candidates[i];
+        if (!candidate.quad.empty()) {
+            shown = &candidate.quad;
+        }
+        if (candidate.matched) {
+            AddGlyph(src, candidate.match, candidate.bounds);
+            ret = true;
         }
     }
+
+    //Display the last warped quad
+    if (m_demo_mode && shown) {
+        cv::imshow("Test", *shown);
+    }
     return ret;
 }
 
@@ -236,15 +309,25 @@ bool CameraStream::GlyphContourDetection(cv::Mat& src, std::vector<std::vector<c
  * @return true iff glyph was detected.
  */
 bool CameraStream::CannyGlyphDetection(cv::Mat& src, cv::Mat& proc) {
-    cv::Mat gray;
+    cv::Mat &gray = m_scratch_gray;
+    cv::Rect window = SearchWindow();
+    cv::Rect src_window(window.x*PIXEL_SKIP, window.y*PIXEL_SKIP,
+        window.width*PIXEL_SKIP, window.height*PIXEL_SKIP);
+
+    proc.create(PROCESS_HEIGHT, PROCESS_WIDTH, CV_8UC1);
+    if (window.size() != proc.size()) {
+        proc.setTo(cv::Scalar(0));
+    }
+    cv::Mat search = proc(window);
     //Downscale
-    cv::resize(src, gray, cv::Size(PROCESS_WIDTH, PROCESS_HEIGHT));
+    cv::resize(src(src_window & cv::Rect(0, 0, src.cols, src.rows)),
+        m_scratch, window.size());
     //Convert to grayscale
-    cv::cvtColor(gray, gray, CV_BGR2GRAY);
+    cv::cvtColor(m_scratch, gray, CV_BGR2GRAY);
     //Blur it a bit
     cv::GaussianBlur(gray, gray, cv::Size(5,5), 0);
     //Apply Canny detection
-    cv::Canny(gray, proc, 100, 200);
+    cv::Canny(gray, search, 100, 200);
     
     if (m_demo_mode) {
         cv::imshow("Thresholded image", proc);
@@ -253,8 +336,9 @@ bool CameraStream::CannyGlyphDetection(cv::Mat& src, cv::Mat& proc) {
     }
     
     //Find the contours in the image and sort in descending order of contour area.
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(proc, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+    std::vector<std::vector<cv::Point>> &contours = m_contours;
+    cv::findContours(search, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE,
+        window.tl());
     std::sort(contours.begin(), contours.end(), ContourSort);
     if (contours.size() > 10) {
         contours.resize(10);
@@ -270,7 +354,9 @@ bool CameraStream::CannyGlyphDetection(cv::Mat& src, cv::Mat& proc) {
     }
     
     //Get the detected glyphs.
-    return GlyphContourDetection(src, contours);
+    bool ret = GlyphContourDetection(src, contours);
+    UpdateSearchWindow();
+    return ret;
 }
 
 /**
@@ -284,14 +370,13 @@ bool CameraStream::CannyGlyphDetection(cv::Mat& src, cv::Mat& proc) {
  */
 bool CameraStream::ThresholdingGlyphDetection(cv::Mat& src, cv::Mat& threshold) {
     //Threshold the image.
-    Threshold(src, threshold, PROCESS_WIDTH);
+    cv::Rect window = SearchWindow();
+    Threshold(src, threshold, PROCESS_WIDTH, window);
+    cv::Mat search = threshold(window);
 
     //Blur, dilate and erode the image
-    cv::Mat elementDilate(8, 8, CV_8U, cv::Scalar(255));
-    cv::Mat elementErode(8, 8, CV_8U, cv::Scalar(255));
-
-    cv::dilate(threshold, threshold, elementDilate);
-    cv::erode(threshold, threshold, elementErode);
+    cv::dilate(search, search, m_element_dilate);
+    cv::erode(search, search, m_element_erode);
 
     if (m_demo_mode) {
         cv::imshow("Thresholded image", threshold);
@@ -299,8 +384,9 @@ bool CameraStream::ThresholdingGlyphDetection(cv::Mat& src, cv::Mat& threshold)
     }
 
     //Find the contours (connected components)
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(threshold, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
+    std::vector<std::vector<cv::Point>> &contours = m_contours;
+    cv::findContours(search, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE,
+        window.tl());
     std::sort(contours.begin(), contours.end(), ContourSort);
     if (contours.size() > 10) {
         contours.resize(10);
@@ -316,7 +402,9 @@ bool CameraStream::ThresholdingGlyphDetection(cv::Mat& src, cv::Mat& threshold)
     }
     
     //Get the detected glyphs.
-    return GlyphContourDetection(src, contours);
+    bool ret = GlyphContourDetection(src, contours);
+    UpdateSearchWindow();
+    return ret;
 }
 
 /**
@@ -327,11 +415,11 @@ bool CameraStream::ThresholdingGlyphDetection(cv::Mat& src, cv::Mat& threshold)
  */
 bool CameraStream::HoughDetection(cv::Mat& src, cv::Mat& proc) {
     bool ret = false;
-    cv::Mat gray;
+    cv::Mat &gray = m_scratch_gray;
     //Downscale
-    cv::resize(src, gray, cv::Size(PROCESS_WIDTH, PROCESS_HEIGHT));
+    cv::resize(src, m_scratch, cv::Size(PROCESS_WIDTH, PROCESS_HEIGHT));
     //Convert to grayscale
-    cv::cvtColor(gray, gray, CV_BGR2GRAY);
+    cv::cvtColor(m_scratch, gray, CV_BGR2GRAY);
     //Blur it a bit
     cv::GaussianBlur(gray, gray, cv::Size(9,9), 0);
     
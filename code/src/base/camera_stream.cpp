@@ -6,6 +6,13 @@
 #include "common.h"
 #include "camera_stream.h"
 #include "flightboard.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #define BLACK 0
 #define WHITE 255
@@ -28,6 +35,25 @@ const std::vector<cv::Scalar> CameraStream::m_colours {
     cv::Scalar(255, 255, 0), cv::Scalar(0, 255, 255), cv::Scalar(255, 0, 255)
 };
 
+/**
+ * Determines how many threads should be used for colour thresholding.
+ * Defaults to the number of hardware threads available.
+ * @param [in] opts A pointer to options, if any (NULL for defaults).
+ * @return The number of thresholding workers, in the range [1, 16].
+ */
+static int ThresholdWorkerCount(Options *opts) {
+    int def = static_cast<int>(std::thread::hardware_concurrency());
+    if (def <= 0) {
+        def = 4;
+    }
+
+    if (opts) {
+        opts->SetFamily("CAMERA_STREAM");
+        def = opts->GetInt("THRESH_WORKERS", def);
+    }
+    return picopter::clamp(def, 1, 16);
+}
+
 /**
  * Constructor. Creates a new camera stream.
  * @param [in] opts A pointer to options, if any (NULL for defaults).
@@ -36,12 +62,21 @@ CameraStream::CameraStream(Options *opts)
 : m_capture(-1)
 , m_stop{false}
 , m_mode(MODE_NO_PROCESSING)
-, m_pool(4)
-, m_fps(-1)
+, m_thresh_workers(ThresholdWorkerCount(opts))
+, m_pool(m_thresh_workers)
+, m_frames(FRAME_POOL_SIZE)
+, m_capture_queue(FRAME_QUEUE_SIZE)
+, m_output_queue(FRAME_QUEUE_SIZE)
+, m_drop_policy(FRAME_DROP_TO_LATEST)
+, m_next_subscriber(0)
+, m_fps{-1}
+, m_allocs_per_frame{-1}
 , m_show_backend(false)
 , m_save_photo(false)
-, m_hud{}
+, m_hud()
 , m_arrow{}
+, m_labeller(8)
+, m_stream_control(10, 75, true)
 {
     Options clear;
     if (!opts) {
@@ -57,8 +92,17 @@ CameraStream::CameraStream(Options *opts)
     INPUT_HEIGHT  = opts->GetInt("INPUT_HEIGHT", 240);
     PROCESS_WIDTH = opts->GetInt("PROCESS_WIDTH", 160);
     STREAM_WIDTH  = opts->GetInt("STREAM_WIDTH", 320);
+    STREAM_PORT   = opts->GetInt("STREAM_PORT", 5000);
+    m_stream_control.SetAdaptive(opts->GetBool("STREAM_ADAPTIVE", true));
+    m_stream_control.SetMinimumFPS(opts->GetReal("STREAM_MIN_FPS", 10));
+    m_stream_control.SetMaximumQuality(opts->GetInt("STREAM_MAX_QUALITY", 75));
     LEARN_SIZE    = picopter::clamp(opts->GetInt("LEARN_SIZE", 50), 20, 100);
 
+    //Set what happens when a pipeline stage can't keep up.
+    if (opts->GetInt("FRAME_DROP_POLICY", m_drop_policy) == FRAME_DROP_NEWEST) {
+        m_drop_policy = FRAME_DROP_NEWEST;
+    }
+
     //Set the default hue thresholds
     m_thresholds.p1_min = opts->GetInt("MIN_HUE", -10);
     m_thresholds.p1_max = opts->GetInt("MAX_HUE", 10);
@@ -91,12 +135,58 @@ CameraStream::CameraStream(Options *opts)
     PIXEL_THRESHOLD	= opts->GetInt("PIXEL_THRESHOLD", (30 * INPUT_WIDTH) / 320);
     PIXEL_SKIP = INPUT_WIDTH / PROCESS_WIDTH;
 
-    //Initialise the thresholding lookup table
-    BuildThreshold(m_lookup_threshold, m_thresholds);
+    //Tracking window parameters (in processing pixels/frames)
+    m_roi_tracking = opts->GetBool("ROI_TRACKING", false);
+    ROI_MAX_MISSES = picopter::clamp(opts->GetInt("ROI_MAX_MISSES", 3), 1, 100);
+    ROI_FULL_INTERVAL = picopter::clamp(opts->GetInt("ROI_FULL_INTERVAL", 30), 1, 1000);
+    ROI_MARGIN = picopter::clamp(opts->GetInt("ROI_MARGIN", 8), 0, PROCESS_WIDTH);
+    m_window = TrackingWindow{};
+
+    //Run HOG people detection at most every HOG_STRIDE frames
+    HOG_STRIDE = picopter::clamp(opts->GetInt("HOG_STRIDE", 2), 1, 100);
+    m_hog_state.frames = 0;
+    m_hog_state.generation = m_hog_state.run_generation = 0;
+
+    //Initialise the thresholding lookup table(s). The full precision table
+    //is built in the background; until it is ready the binned table is used.
+    ThresholdKernelType kernel = GetBestThresholdKernel();
+    m_threshold_kernel = GetThresholdKernel(kernel, THRESH_TABLE_BINNED);
+    m_full_kernel = GetThresholdKernel(kernel, THRESH_TABLE_FULL);
+    m_full_threshold = nullptr;
+    if (opts->GetBool("THRESH_FULL_TABLE", false)) {
+        m_full_threshold = new ThresholdBitTable();
+    }
+    UpdateThresholds();
+    Log(LOG_INFO, "Using the %s thresholding kernel with %d workers (%s table).",
+        GetThresholdKernelName(kernel), m_thresh_workers,
+        m_full_threshold ? "full" : "binned");
 
     //Initialise the HOG detector
     m_hog.setSVMDetector(cv::HOGDescriptor::getDefaultPeopleDetector());
 
+    //Set up the reusable buffers, counting any (re)allocations of them.
+    m_element_dilate = cv::Mat(8, 8, CV_8U, cv::Scalar(255));
+    m_element_erode = cv::Mat(8, 8, CV_8U, cv::Scalar(255));
+    m_frames.ForEach([this] (Frame &frame) {
+        frame.image.allocator = &m_allocator;
+        frame.backend.allocator = &m_allocator;
+    });
+    m_scratch.allocator = &m_allocator;
+    m_scratch_gray.allocator = &m_allocator;
+    m_glyph_quad.allocator = &m_allocator;
+    m_stream_buffer.allocator = &m_allocator;
+
+    //Serve the stream to the web interface (a port of 0 disables this).
+    m_stream_server = nullptr;
+    if (STREAM_PORT > 0) {
+        try {
+            m_stream_server = new MJPEGServer(STREAM_PORT);
+            Log(LOG_INFO, "Streaming on port %d.", STREAM_PORT);
+        } catch (std::invalid_argument e) {
+            Log(LOG_WARNING, "Cannot start the stream server: %s", e.what());
+        }
+    }
+
     //Determine if we're running in demo mode.
     opts->SetFamily("GLOBAL");
     m_demo_mode = opts->GetBool("DEMO_MODE", false);
@@ -113,24 +203,39 @@ CameraStream::CameraStream(Options *opts)
     }
 #endif
 
-    //Start the worker thread.
+    //Start the pipeline, from the output stage back to capture.
+    m_output_thread = std::async(std::launch::async,
+        &CameraStream::OutputImages, this);
     m_worker_thread = std::async(std::launch::async,
         &CameraStream::ProcessImages, this);
+    m_capture_thread = std::async(std::launch::async,
+        &CameraStream::CaptureImages, this);
 }
 
 /**
  * Destructor.
- * Stops the worker thread and closes the camera stream.
+ * Stops the worker threads and closes the camera stream.
  */
 CameraStream::~CameraStream() {
     m_stop = true;
+    if (m_capture_thread.valid()) {
+        m_capture_thread.wait();
+    }
     if (m_worker_thread.valid()) {
         m_worker_thread.wait();
     }
+    if (m_output_thread.valid()) {
+        m_output_thread.wait();
+    }
+    for (auto &job : m_hog_state.jobs) {
+        job.wait();
+    }
 
 #ifdef IS_ON_PI
     delete m_enc;
 #endif
+    delete m_full_threshold;
+    delete m_stream_server;
 
     if (m_demo_mode) {
         //Gtk is crap so this doesn't actually do much.
@@ -144,8 +249,200 @@ CameraStream::~CameraStream() {
  * @param [in,out] objects The list of detected objects.
  */
 void CameraStream::GetDetectedObjects(std::vector<ObjectInfo> *objects) {
-    std::lock_guard<std::mutex> lock(m_worker_mutex);
-    *objects = m_detected;
+    DetectionSet detections;
+    m_published.Load(&detections);
+    objects->assign(detections.objects, detections.objects + detections.count);
+}
+
+/**
+ * Retrieves the objects detected in the most recently processed frame.
+ * Never blocks on image processing.
+ * @param [out] detections Location to store the detections.
+ * @return The sequence number of the frame (0 if none yet).
+ */
+uint64_t CameraStream::GetDetections(DetectionSet *detections) {
+    m_published.Load(detections);
+    return detections->seq;
+}
+
+/**
+ * Waits for a frame newer than the given one to be processed.
+ * @param [in] seq The sequence number of the last frame seen.
+ * @param [out] detections Location to store the detections.
+ * @param [in] timeout_ms The maximum time to wait, in milliseconds.
+ * @return true iff newer detections were retrieved.
+ */
+bool CameraStream::WaitForDetections(uint64_t seq, DetectionSet *detections, int timeout_ms) {
+    auto deadline = steady_clock::now() + milliseconds(timeout_ms);
+    uint64_t version = m_published.Load(detections);
+    while (detections->seq <= seq) {
+        auto now = steady_clock::now();
+        if (now >= deadline) {
+            return false;
+        }
+        version = m_published.Wait(version, detections, deadline - now);
+    }
+    return true;
+}
+
+/**
+ * Subscribes to the detections from every processed frame. The callback is
+ * run on the camera processing thread, so it must be quick.
+ * @param [in] callback The function to call with each frame's detections.
+ * @return The subscription ID, for unsubscribing.
+ */
+int CameraStream::Subscribe(DetectionCallback callback) {
+    std::lock_guard<std::mutex> lock(m_subscriber_mutex);
+    m_subscribers.push_back(std::make_pair(m_next_subscriber, callback));
+    return m_next_subscriber++;
+}
+
+/**
+ * Subscribes a queue to the detections from every processed frame.
+ * @param [in] queue The queue to add detections to. Must remain valid until
+ *                   unsubscribed.
+ * @return The subscription ID, for unsubscribing.
+ */
+int CameraStream::Subscribe(DetectionQueue *queue) {
+    return Subscribe([queue] (const DetectionSet &detections) {
+        queue->Push(detections);
+    });
+}
+
+/**
+ * Removes a subscription. The subscriber is not called again once this
+ * returns.
+ * @param [in] id The subscription ID.
+ */
+void CameraStream::Unsubscribe(int id) {
+    std::lock_guard<std::mutex> lock(m_subscriber_mutex);
+    m_subscribers.erase(std::remove_if(m_subscribers.begin(), m_subscribers.end(),
+        [id] (const std::pair<int, DetectionCallback> &s) {
+            return s.first == id;
+        }), m_subscribers.end());
+}
+
+/**
+ * Sets where the pose of the copter is sampled from when each frame is
+ * captured.
+ * @param [in] source The pose source (empty to stop sampling).
+ */
+void CameraStream::SetPoseSource(PoseSource source) {
+    std::lock_guard<std::mutex> lock(m_pose_mutex);
+    m_pose_source = source;
+}
+
+/**
+ * Publishes the detections from the current frame to readers and
+ * subscribers (worker only).
+ * @param [in] frame The frame that was processed.
+ */
+void CameraStream::PublishDetections(const Frame &frame) {
+    DetectionSet detections;
+    detections.seq = frame.seq;
+    detections.timestamp = frame.timestamp;
+    detections.pose = frame.pose;
+    detections.count = static_cast<int>(std::min<size_t>(m_detected.size(), DETECTION_MAX));
+    std::copy(m_detected.begin(), m_detected.begin() + detections.count,
+        detections.objects);
+    m_published.Store(detections);
+
+    std::lock_guard<std::mutex> lock(m_subscriber_mutex);
+    for (auto &subscriber : m_subscribers) {
+        subscriber.second(detections);
+    }
+}
+
+/**
+ * Constructor. Creates a new detection queue.
+ * @param [in] capacity The number of detection sets that can be queued.
+ * @throws std::runtime_error if the eventfd cannot be created.
+ */
+DetectionQueue::DetectionQueue(size_t capacity)
+: m_queue(capacity)
+, m_overflows{0}
+{
+    m_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_fd < 0) {
+        throw std::runtime_error("Failed to create detection queue eventfd");
+    }
+}
+
+/**
+ * Destructor.
+ */
+DetectionQueue::~DetectionQueue() {
+    close(m_fd);
+}
+
+/**
+ * Retrieves the file descriptor to wait on. It is readable while the queue
+ * may be non-empty; call Pop until it returns false once it is.
+ * @return The eventfd.
+ */
+int DetectionQueue::GetFd() {
+    return m_fd;
+}
+
+/**
+ * Queues a set of detections (camera thread only).
+ * @param [in] detections The detections to queue.
+ */
+void DetectionQueue::Push(const DetectionSet &detections) {
+    DetectionSet item = detections;
+    if (m_queue.Push(item)) {
+        uint64_t one = 1;
+        if (write(m_fd, &one, sizeof(one)) != sizeof(one)) {
+            Log(LOG_WARNING, "Failed to signal detection queue");
+        }
+    } else {
+        m_overflows++;
+    }
+}
+
+/**
+ * Removes the oldest set of detections from the queue (consumer only).
+ * @param [out] detections Location to store the detections.
+ * @return true iff detections were retrieved.
+ */
+bool DetectionQueue::Pop(DetectionSet *detections) {
+    uint64_t count;
+    //Clear the signal first; a concurrent Push re-signals after queueing.
+    if (read(m_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        Log(LOG_WARNING, "Failed to read detection queue eventfd");
+    }
+    bool ret = m_queue.Pop(detections);
+    if (!m_queue.Empty()) {
+        //Stay readable while there is more to pop.
+        count = 1;
+        if (write(m_fd, &count, sizeof(count)) != sizeof(count)) {
+            Log(LOG_WARNING, "Failed to signal detection queue");
+        }
+    }
+    return ret;
+}
+
+/**
+ * Waits for detections to be queued (consumer only).
+ * @param [in] timeout_ms The maximum time to wait, in milliseconds.
+ * @return true iff the queue is non-empty.
+ */
+bool DetectionQueue::Wait(int timeout_ms) {
+    if (!m_queue.Empty()) {
+        return true;
+    }
+    struct pollfd pfd = {m_fd, POLLIN, 0};
+    poll(&pfd, 1, timeout_ms);
+    return !m_queue.Empty();
+}
+
+/**
+ * Retrieves the number of detection sets discarded because the consumer
+ * fell behind.
+ * @return The number of discarded sets.
+ */
+size_t DetectionQueue::GetOverflows() {
+    return m_overflows;
 }
 
 /**
@@ -164,6 +461,11 @@ CameraStream::CameraMode CameraStream::GetMode(void) {
 CameraStream::CameraMode CameraStream::SetMode(CameraMode mode) {
     std::lock_guard<std::mutex> lock(m_worker_mutex);
     m_mode = mode;
+    m_window.locked = false;
+    m_hog_state.found.clear();
+    m_hog_state.templates.clear();
+    //Any run still in flight was started before the change; ignore it.
+    m_hog_state.generation++;
     return m_mode;
 }
 
@@ -208,6 +510,14 @@ void CameraStream::GetConfig(Options *config) {
         config->Set("MAX_Cr", m_thresholds.p3_max);
     }
     config->Set("SHOW_BACKEND", m_show_backend);
+    config->Set("ROI_TRACKING", m_roi_tracking);
+
+    StreamSettings stream = m_stream_control.GetSettings();
+    config->Set("STREAM_ADAPTIVE", m_stream_control.GetAdaptive());
+    config->Set("STREAM_MIN_FPS", m_stream_control.GetMinimumFPS());
+    config->Set("STREAM_SKIP", stream.skip);
+    config->Set("STREAM_SCALE", stream.scale);
+    config->Set("STREAM_QUALITY", stream.quality);
 }
 
 /**
@@ -221,7 +531,17 @@ void CameraStream::SetConfig(Options *config) {
 
     config->SetFamily("CAMERA_STREAM");
     config->GetBool("SHOW_BACKEND", &m_show_backend);
-
+    if (config->GetBool("ROI_TRACKING", &m_roi_tracking)) {
+        m_window.locked = false;
+    }
+    bool adaptive;
+    double min_fps;
+    if (config->GetBool("STREAM_ADAPTIVE", &adaptive)) {
+        m_stream_control.SetAdaptive(adaptive);
+    }
+    if (config->GetReal("STREAM_MIN_FPS", &min_fps, 1, 60)) {
+        m_stream_control.SetMinimumFPS(min_fps);
+    }
 
     config->GetInt("THRESH_COLOURSPACE", &colourspace);
     switch(colourspace) {
@@ -248,7 +568,7 @@ void CameraStream::SetConfig(Options *config) {
     m_learning_thresholds.colourspace = m_thresholds.colourspace;
 
     if (refresh) {
-        BuildThreshold(m_lookup_threshold, m_thresholds);
+        UpdateThresholds();
     }
 
     if (config->GetBool("SET_LEARNING_SIZE", &decrease)) {
@@ -265,8 +585,7 @@ void CameraStream::SetConfig(Options *config) {
  * @param [in] hud The HUD info.
  */
 void CameraStream::SetHUDInfo(HUDInfo *hud) {
-    std::lock_guard<std::mutex> lock(m_aux_mutex);
-    m_hud = *hud;
+    m_hud.Store(*hud);
 }
 
 /**
@@ -284,7 +603,7 @@ void CameraStream::DoAutoLearning() {
             m_thresholds.p3_min = m_learning_thresholds.p3_min;
             m_thresholds.p3_max = m_learning_thresholds.p3_max;
         }
-        BuildThreshold(m_lookup_threshold, m_thresholds);
+        UpdateThresholds();
     }
 }
 
@@ -295,7 +614,7 @@ void CameraStream::DoAutoLearning() {
  *         it is in the process of taking another photo.
  */
 bool CameraStream::TakePhoto(std::string filename) {
-    std::lock_guard<std::mutex> lock(m_worker_mutex);
+    std::lock_guard<std::mutex> lock(m_photo_mutex);
     if (!m_save_photo && !filename.empty()) {
         m_save_filename = filename;
         m_save_photo = true;
@@ -317,45 +636,85 @@ void CameraStream::SetTrackingArrow(navigation::Point3D arrow) {
 
 //Private methods
 
+/**
+ * Capture thread. Grabs frames from the camera and hands them to the
+ * processing stage. Never waits on the later stages.
+ */
+void CameraStream::CaptureImages() {
+    size_t dropped = 0;
+    uint64_t seq = 0;
+
+    while (!m_stop) {
+        FrameHandle frame = m_frames.Acquire();
+        if (!frame) {
+            //Every frame is in flight; discard this one from the camera.
+            m_capture.grab();
+            dropped++;
+            continue;
+        }
+
+        //Grab image (into the recycled buffer)
+        m_capture >> frame->image;
+        frame->timestamp = steady_clock::now();
+        if (frame->image.empty()) {
+            sleep_for(milliseconds(10));
+            continue;
+        }
+        frame->seq = ++seq;
+        frame->pose.valid = false;
+        {
+            std::lock_guard<std::mutex> lock(m_pose_mutex);
+            if (m_pose_source) {
+                m_pose_source(&frame->pose);
+                frame->pose.valid = true;
+            }
+        }
+
+        if (!m_capture_queue.Push(frame)) {
+            dropped++;
+        }
+    }
+    Log(LOG_DEBUG, "Capture stage dropped %zu frames", dropped);
+}
+
 /**
  * Worker thread. Processes the images as necessary.
  */
 void CameraStream::ProcessImages() {
-    static const std::vector<int> saveparams = {CV_IMWRITE_JPEG_QUALITY, 90};
-    static const std::vector<int> streamparams {CV_IMWRITE_JPEG_QUALITY, 75};
-    int frame_counter = 0, frame_duration = 0, skip_factor = 5;
+    int frame_counter = 0, frame_duration = 0;
+    size_t skipped = 0, dropped = 0;
+    unsigned long alloc_start = m_allocator.GetCount();
     auto sampling_start = steady_clock::now();
-#ifdef IS_ON_PI
-    OmxCvJpeg *streamer = nullptr, *saver = nullptr;
-    try {
-        streamer = new OmxCvJpeg(STREAM_WIDTH, STREAM_HEIGHT, 75);
-        saver = new OmxCvJpeg(INPUT_WIDTH, INPUT_HEIGHT, 90);
-        skip_factor = 2;
-    } catch (std::invalid_argument e) {
-        Log(LOG_WARNING, "Cannot start hardware JPEG encoders: %s", e.what());
-    }
-#endif
 
     while (!m_stop) {
-        std::unique_lock<std::mutex> lock(m_worker_mutex, std::defer_lock);
-        cv::Mat image, backend;
+        FrameHandle frame;
 
-        //Grab image
-        m_capture >> image;
+        //Wait for the next frame
+        if (!m_capture_queue.Wait(milliseconds(100))) {
+            continue;
+        } else if (m_drop_policy == FRAME_DROP_TO_LATEST) {
+            m_capture_queue.PopLatest(&frame, &skipped);
+        } else {
+            m_capture_queue.Pop(&frame);
+        }
 
-        //Acquire the mutex
-        lock.lock();
+        cv::Mat &image = frame->image, &backend = frame->backend;
+        auto process_start = steady_clock::now();
+        std::unique_lock<std::mutex> lock(m_worker_mutex);
 
-        //Save it, if requested to.
-        if (m_save_photo) {
-#ifdef IS_ON_PI
-            if (saver) {
-                saver->Encode(m_save_filename.c_str(), image, true);
-            } else
-#endif
-            cv::imwrite(m_save_filename, image, saveparams);
-            m_save_photo = false;
-         }
+        //Keep an unannotated copy if a photo was requested. It is held
+        //apart from the frame, so dropping the frame can't lose it.
+        {
+            std::lock_guard<std::mutex> photo_lock(m_photo_mutex);
+            if (m_save_photo && m_photo.empty()) {
+                m_photo = image.clone();
+            }
+        }
+        //The backend buffer is recycled, so only show it if it was written.
+        frame->show_backend = m_show_backend && m_mode != MODE_NO_PROCESSING;
+
+        //Only report what was detected in this frame.
+        m_detected.clear();
 
         //Process image
         switch(m_mode) {
@@ -428,6 +787,90 @@ void CameraStream::ProcessImages() {
            break;
         }
 
+        lock.unlock();
+        PublishDetections(*frame);
+
+        //Let the stream controller know how much time processing takes.
+        auto process_end = steady_clock::now();
+        m_stream_control.AddProcessed(
+            duration_cast<microseconds>(process_end.time_since_epoch()).count() / 1000.0,
+            duration_cast<microseconds>(process_end - process_start).count() / 1000.0);
+
+        //Update frame rate
+        frame_counter++;
+        frame_duration = duration_cast<milliseconds>(steady_clock::now() - sampling_start).count();
+        if (frame_duration > 1000) {
+            unsigned long allocs = m_allocator.GetCount();
+            m_fps = (frame_counter * 1000.0) / frame_duration;
+            m_allocs_per_frame = static_cast<double>(allocs - alloc_start) / frame_counter;
+            alloc_start = allocs;
+            frame_counter = 0;
+            sampling_start = steady_clock::now();
+        }
+
+        //Hand over to the output stage
+        if (!m_output_queue.Push(frame)) {
+            dropped++;
+        }
+    }
+    Log(LOG_DEBUG, "Processing stage skipped %zu frames and dropped %zu frames",
+        skipped, dropped);
+}
+
+/**
+ * Output thread. Draws the HUD, saves photos and encodes the video and the
+ * web stream, so that none of this holds up capture or processing.
+ */
+void CameraStream::OutputImages() {
+    static const std::vector<int> saveparams = {CV_IMWRITE_JPEG_QUALITY, 90};
+    std::vector<int> streamparams {CV_IMWRITE_JPEG_QUALITY, 75};
+    int frame_counter = 0;
+    size_t skipped = 0;
+#ifdef IS_ON_PI
+    OmxCvJpeg *saver = nullptr;
+    try {
+        saver = new OmxCvJpeg(INPUT_WIDTH, INPUT_HEIGHT, 90);
+    } catch (std::invalid_argument e) {
+        Log(LOG_WARNING, "Cannot start hardware JPEG encoder: %s", e.what());
+    }
+#endif
+
+    while (!m_stop) {
+        FrameHandle frame;
+
+        //Save the photo, if one was taken. The request stays pending (so
+        //TakePhoto refuses others) until the file is written.
+        cv::Mat photo;
+        std::string photo_filename;
+        {
+            std::lock_guard<std::mutex> lock(m_photo_mutex);
+            if (!m_photo.empty()) {
+                photo = m_photo;
+                photo_filename = m_save_filename;
+            }
+        }
+        if (!photo.empty()) {
+#ifdef IS_ON_PI
+            if (saver) {
+                saver->Encode(photo_filename.c_str(), photo, true);
+            } else
+#endif
+            cv::imwrite(photo_filename, photo, saveparams);
+
+            std::lock_guard<std::mutex> lock(m_photo_mutex);
+            m_photo.release();
+            m_save_photo = false;
+        }
+
+        if (!m_output_queue.Wait(milliseconds(100))) {
+            continue;
+        } else if (m_drop_policy == FRAME_DROP_TO_LATEST) {
+            m_output_queue.PopLatest(&frame, &skipped);
+        } else {
+            m_output_queue.Pop(&frame);
+        }
+        cv::Mat &image = frame->image, &backend = frame->backend;
+
         DrawCrosshair(image, cv::Point(image.cols/2, image.rows/2),
             cv::Scalar(255, 255, 255), 20);
         // Draw an arrow on the image (for displaying where it wants to go for object tracking)
@@ -449,37 +892,32 @@ void CameraStream::ProcessImages() {
         }
 #endif
         //Stream image
-        //Only write the image out for web streaming every 5th frame
-        if ((frame_counter % skip_factor) == 0) {
-            if (m_show_backend) {
-                cv::imwrite(STREAM_FILE, backend, streamparams);
-            } else {
-                if (STREAM_WIDTH < INPUT_WIDTH) {
-                    cv::resize(image, image,
-                        cv::Size(STREAM_WIDTH, STREAM_HEIGHT));
-                }
-#ifdef IS_ON_PI
-                if (streamer) {
-                    streamer->Encode(STREAM_FILE, image);
-                } else
-#endif
-                cv::imwrite(STREAM_FILE, image, streamparams);
+        //Only encode as often as the controller allows, and only if anyone
+        //is watching.
+        StreamSettings settings = m_stream_control.GetSettings();
+        if ((frame_counter++ % settings.skip) == 0 &&
+            m_stream_server && m_stream_server->GetClientCount() > 0) {
+            auto stream_start = steady_clock::now();
+            int width = (STREAM_WIDTH * settings.scale) / 100;
+            cv::Mat *stream = &image;
+            if (frame->show_backend && !backend.empty()) {
+                stream = &backend;
             }
-        }
-
-        //Update frame rate
-        frame_counter++;
-        frame_duration = duration_cast<milliseconds>(steady_clock::now() - sampling_start).count();
-        if (frame_duration > 1000) {
-            m_fps = (frame_counter * 1000.0) / frame_duration;
-            frame_counter = 0;
-            sampling_start = steady_clock::now();
-            //printf("%f\n", m_fps);
-            //Log(LOG_INFO, "FPS: %.2f", m_fps);
+            if (stream->cols > width) {
+                //Resize into a separate buffer; the frame is recycled.
+                cv::resize(*stream, m_stream_buffer,
+                    cv::Size(width, (stream->rows * width) / stream->cols));
+                stream = &m_stream_buffer;
+            }
+            streamparams[1] = settings.quality;
+            cv::imencode(".jpg", *stream, m_stream_jpeg, streamparams);
+            m_stream_server->Publish(&m_stream_jpeg);
+            m_stream_control.AddStreamed(duration_cast<microseconds>(
+                steady_clock::now() - stream_start).count() / 1000.0);
         }
     }
+    Log(LOG_DEBUG, "Output stage skipped %zu frames", skipped);
 #ifdef IS_ON_PI
-    delete streamer;
     delete saver;
 #endif
 }
@@ -489,18 +927,51 @@ void CameraStream::ProcessImages() {
  * @return The current frame rate, in frames per second, or -1.0 if unknown.
  */
 double CameraStream::GetFramerate() {
-    std::lock_guard<std::mutex> lock(m_worker_mutex);
     return m_fps;
 }
 
+/**
+ * Retrieves the number of pipeline buffer allocations per processed frame.
+ * Once the pipeline has warmed up, this should be zero.
+ * @return The allocations per frame, or -1.0 if unknown.
+ */
+double CameraStream::GetAllocationsPerFrame() {
+    return m_allocs_per_frame;
+}
+
+/**
+ * Allocates a matrix buffer, counting the allocation.
+ * Follows the layout used by cv::Mat::create (reference count at the end).
+ */
+void CameraStream::CountingAllocator::allocate(int dims, const int* sizes, int type,
+    int*& refcount, uchar*& datastart, uchar*& data, size_t* step)
+{
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        step[i] = total;
+        total *= sizes[i];
+    }
+    total = cv::alignSize(total, static_cast<int>(sizeof(*refcount)));
+    datastart = data = static_cast<uchar*>(cv::fastMalloc(total + sizeof(*refcount)));
+    refcount = reinterpret_cast<int*>(data + total);
+    *refcount = 1;
+    m_count++;
+}
+
+/**
+ * Frees a matrix buffer allocated by CountingAllocator::allocate.
+ */
+void CameraStream::CountingAllocator::deallocate(int*, uchar* datastart, uchar*) {
+    cv::fastFree(datastart);
+}
+
 /**
  * Draws a heads-up display onto the frame.
  * @param [in] img The image to draw the HUD onto.
  */
 void CameraStream::DrawHUD(cv::Mat& img) {
-    std::unique_lock<std::mutex> lock(m_aux_mutex);
-    HUDInfo hud = m_hud;
-    lock.unlock();
+    HUDInfo hud;
+    m_hud.Load(&hud);
 
     char string_buf[128];
     time_t ts = time(NULL) + hud.unix_time_offset;
@@ -515,7 +986,7 @@ void CameraStream::DrawHUD(cv::Mat& img) {
     cv::putText(img, string_buf, cv::Point(70*img.cols/100, 10*img.rows/100),
         cv::FONT_HERSHEY_SIMPLEX, 0.4, cv::Scalar(255, 255, 255), 1, 8);
     //Enter the FPS
-    sprintf(string_buf, "%3.4f fps", m_fps);
+    sprintf(string_buf, "%3.4f fps", m_fps.load());
     cv::putText(img, string_buf, cv::Point(70*img.cols/100, 15*img.rows/100),
         cv::FONT_HERSHEY_SIMPLEX, 0.4, cv::Scalar(255, 255, 255), 1, 8);
     //Enter the LIDAR range
@@ -548,11 +1019,11 @@ void CameraStream::DrawHUD(cv::Mat& img) {
     cv::putText(img, string_buf, cv::Point(5*img.cols/100, 25*img.rows/100),
         cv::FONT_HERSHEY_SIMPLEX, 0.32, cv::Scalar(255, 255, 255), 1, 8);
 
-    if (hud.status2.size()) {
+    if (hud.status2[0]) {
         cv::putText(img, hud.status2,  cv::Point(5*img.cols/100, 87*img.rows/100),
         cv::FONT_HERSHEY_SIMPLEX, 0.4, cv::Scalar(255, 255, 255), 1, 8);
     }
-    if (hud.status1.size()) {
+    if (hud.status1[0]) {
         cv::putText(img, hud.status1, cv::Point(5*img.cols/100, 92*img.rows/100),
         cv::FONT_HERSHEY_SIMPLEX, 0.4, cv::Scalar(255, 255, 255), 1, 8);
     }
@@ -589,58 +1060,6 @@ void CameraStream::DrawTrackingArrow(cv::Mat& img) {
     }
 }
 
-/**
- * Converts from RGB to HSV colourspace.
- * Uses the OpenCV convention of 0-180 for hue.
- *
- * @param [in] r The red value.
- * @param [in] g The green value.
- * @param [in] b The blue value;
- * @param [out] h The hue value (0-180).
- * @param [out] s The saturation value (0-255).
- * @param [out] v The value value (0-255).
- */
-void CameraStream::RGB2HSV(uint8_t r, uint8_t g, uint8_t b, uint8_t *h, uint8_t *s, uint8_t *v) {
-    uint8_t rgb_max = std::max(r, std::max(g, b));
-    uint8_t rgb_min = std::min(r, std::min(g, b));
-    uint8_t delta = rgb_max - rgb_min;
-
-    *v = rgb_max;
-    if (rgb_max != 0 && delta != 0) {
-        *s = ((int)255*delta)/rgb_max;
-    } else {
-        *s = 0;
-        *h = 0;
-        return;
-    }
-
-    if(r == rgb_max) {
-        *h = 43 * (g-b)/delta;
-    } else if(g == rgb_max) {
-        *h = 85 + 43 * (b-r)/delta;
-    } else {
-        *h = 171 + 43 * (r-g)/delta;
-    }
-
-    *h = (uint8_t)(((int)180*(*h))/255);
-}
-
-/**
- * Converts to the Y'CbCr colourspace.
- * @param [in] r The red value.
- * @param [in] g The green value.
- * @param [in] b The blue value.
- * @param [in] y The luma component (0-255).
- * @param [in] cb The blue difference component (0-255).
- * @param [in] cr The red difference component (0-255).
- * @return Return_Description
- */
-void CameraStream::RGB2YCbCr(uint8_t r, uint8_t g, uint8_t b, uint8_t *y, uint8_t *cb, uint8_t *cr) {
-    *y = 0.299 * r + 0.587 * g + 0.114 * b;
-    *cb = -0.168736 * r - 0.331264 * g + 0.500 * b + 128;
-    *cr = 0.500 * r - 0.418688 * g - 0.081312 * b + 128;
-}
-
 /**
  * Builds the threshold lookup table from the given thresholding parameters.
  * @param [out] lookup The lookup table.
@@ -683,6 +1102,32 @@ void CameraStream::BuildThreshold(uint8_t lookup[][THRESH_SIZE][THRESH_SIZE], Th
     }
 }
 
+/**
+ * Applies the current thresholding parameters. The binned table is rebuilt
+ * immediately (it is small); the full precision table, if used, is only
+ * queued for rebuilding so that the caller never waits on it.
+ */
+void CameraStream::UpdateThresholds(void) {
+    BuildThreshold(m_lookup_threshold, m_thresholds);
+
+    if (m_full_threshold) {
+        ThresholdChannels channels;
+        channels.colourspace = m_thresholds.colourspace;
+        for (int v = 0; v < 256; v++) {
+            if (m_thresholds.colourspace == THRESH_HSV && m_thresholds.p1_min < 0) {
+                //Hue wraps around.
+                channels.accept[0][v] = (v >= m_thresholds.p1_min+180 && v <= 180) ||
+                                        (v <= m_thresholds.p1_max);
+            } else {
+                channels.accept[0][v] = v >= m_thresholds.p1_min && v <= m_thresholds.p1_max;
+            }
+            channels.accept[1][v] = v >= m_thresholds.p2_min && v <= m_thresholds.p2_max;
+            channels.accept[2][v] = v >= m_thresholds.p3_min && v <= m_thresholds.p3_max;
+        }
+        m_full_threshold->Update(channels);
+    }
+}
+
 /**
  * Threshold a slice of a frame.
  * @param [in] src The source frame.
@@ -690,20 +1135,15 @@ void CameraStream::BuildThreshold(uint8_t lookup[][THRESH_SIZE][THRESH_SIZE], Th
  * @param [in] skip The pixel skip factor.
  * @param [in] offset The starting offset.
  * @param [in] slice_height The number of destination rows to process.
+ * @param [in] kernel The thresholding kernel.
+ * @param [in] lut The lookup table to use with the kernel.
  */
-void CameraStream::ThresholdSlice(const cv::Mat &src, cv::Mat &out, int skip, int offset, int slice_height) {
-    const uint8_t *srcp;
-    uint8_t *destp;
-    int nChannels = src.channels();
-    int i, j, k;
-    
-    for(j=offset; j < offset+slice_height; j++) {
-        srcp = src.ptr<const uint8_t>(j*skip);
-        destp = out.ptr<uint8_t>(j);
-        for (i=0; i < out.cols; i++) {
-            k = i*nChannels*skip;
-            destp[i] = m_lookup_threshold[srcp[k+2]/THRESH_DIV][srcp[k+1]/THRESH_DIV][srcp[k]/THRESH_DIV];
-        }
+void CameraStream::ThresholdSlice(const cv::Mat &src, cv::Mat &out, int skip, int offset, int slice_height, ThresholdKernel kernel, const uint8_t *lut) {
+    int stride = src.channels() * skip;
+
+    for (int j = offset; j < offset + slice_height; j++) {
+        kernel(src.ptr<const uint8_t>(j*skip), out.ptr<uint8_t>(j),
+            out.cols, stride, lut);
     }
 }
 
@@ -712,33 +1152,128 @@ void CameraStream::ThresholdSlice(const cv::Mat &src, cv::Mat &out, int skip, in
  * @param [in] src The input image.
  * @param [out] out The output image.
  * @param [in] width The output processing width.
+ * @param [in] window The part of the output to threshold (empty for all of
+ *                    it). The rest of the output is cleared.
  */
-void CameraStream::Threshold(const cv::Mat& src, cv::Mat &out, int width) {
-    //auto start = steady_clock::now();
+void CameraStream::Threshold(const cv::Mat& src, cv::Mat &out, int width, cv::Rect window) {
     int skip = src.cols/width;
     out.create((src.rows * width) / src.cols, width, CV_8UC1);
-    
-    ThresholdSlice(src, out, skip, 0, out.rows);
-    
-    //GDB really does not like thread pooling and GDB will segfault
-    //if threaded thresholding is enabled. Probably fixed by upgrading
-    //GDB.
-    /*
-    if ((out.rows%4)) {
-        ThresholdSlice(src, out, skip, 0, out.rows);
+
+    //Restrict both images to the window, if any.
+    cv::Mat src_window = src, out_window = out;
+    window &= cv::Rect(0, 0, out.cols, out.rows);
+    if (window.area() > 0 && window.size() != out.size()) {
+        out.setTo(cv::Scalar(0));
+        src_window = src(cv::Rect(window.x*skip, window.y*skip,
+            window.width*skip, window.height*skip));
+        out_window = out(window);
+    }
+
+    //Use the full precision table if it's been built.
+    ThresholdKernel kernel = m_threshold_kernel;
+    const uint8_t *lut = &m_lookup_threshold[0][0][0];
+    const uint8_t *full = nullptr;
+    int handle = 0;
+    if (m_full_threshold && (full = m_full_threshold->Acquire(&handle))) {
+        kernel = m_full_kernel;
+        lut = full;
+    }
+
+    //Split the output into row bands. Each band is thresholded straight
+    //into the shared output image (no copies); the first band is done on
+    //this thread while the pool works on the rest.
+    int rows = out_window.rows;
+    int bands = std::min(m_thresh_workers, rows);
+    if (bands <= 1) {
+        ThresholdSlice(src_window, out_window, skip, 0, rows, kernel, lut);
     } else {
-        //Log(LOG_DEBUG, "SLICING");
         std::vector<std::future<void>> ret;
-        for (int i = 0; i < 4; i++) {
-            ret.emplace_back(m_pool.enqueue(&CameraStream::ThresholdSlice,
-                this, src, out, skip, (i*out.rows)/4, out.rows/4));
+        ret.reserve(bands - 1);
+        for (int i = 1; i < bands; i++) {
+            int start = (i * rows) / bands;
+            int end = ((i + 1) * rows) / bands;
+            ret.emplace_back(m_pool.enqueue([&src_window, &out_window, skip, start, end, kernel, lut, this] {
+                ThresholdSlice(src_window, out_window, skip, start, end - start, kernel, lut);
+            }));
         }
-        for(auto &&result : ret){
+        ThresholdSlice(src_window, out_window, skip, 0, rows / bands, kernel, lut);
+
+        //Barrier: all bands must be complete before the image is used.
+        for (auto &&result : ret) {
             result.get();
         }
     }
-    */
-    //printf("%d\n", (int)duration_cast<microseconds>(steady_clock::now()-start).count());
+
+    if (full) {
+        m_full_threshold->Release(handle);
+    }
+}
+
+/**
+ * Determines where to search for objects in this frame. While an object is
+ * being tracked, this is a window around its predicted position, grown by
+ * its recent motion and by each consecutive miss. The full frame is
+ * searched when nothing is tracked, and periodically to pick up new objects.
+ * @param [in] min_size The smallest window the detector can use.
+ * @return The search window, in processing coordinates.
+ */
+cv::Rect CameraStream::SearchWindow(cv::Size min_size) {
+    cv::Rect full(0, 0, PROCESS_WIDTH, PROCESS_HEIGHT);
+    if (!m_roi_tracking || !m_window.locked ||
+        ++m_window.frames >= ROI_FULL_INTERVAL) {
+        m_window.frames = 0;
+        return full;
+    }
+
+    const cv::Rect &b = m_window.bounds;
+    float vx = std::abs(m_window.velocity.x), vy = std::abs(m_window.velocity.y);
+    int grow = 1 + m_window.misses;
+    int pad_x = grow * (std::max(ROI_MARGIN, b.width/2) + static_cast<int>(vx + 0.5f));
+    int pad_y = grow * (std::max(ROI_MARGIN, b.height/2) + static_cast<int>(vy + 0.5f));
+    int width = std::max(b.width + 2*pad_x, min_size.width);
+    int height = std::max(b.height + 2*pad_y, min_size.height);
+
+    //Centre on the predicted position, keeping the window inside the frame.
+    float cx = b.x + b.width/2.0f + m_window.velocity.x * grow;
+    float cy = b.y + b.height/2.0f + m_window.velocity.y * grow;
+    cv::Rect window(static_cast<int>(cx - width/2.0f), static_cast<int>(cy - height/2.0f),
+        width, height);
+    window.x = picopter::clamp(window.x, 0, std::max(0, full.width - window.width));
+    window.y = picopter::clamp(window.y, 0, std::max(0, full.height - window.height));
+    return window & full;
+}
+
+/**
+ * Updates the tracking window from this frame's detections. The first
+ * (largest) detected object is the one that is tracked.
+ */
+void CameraStream::UpdateSearchWindow() {
+    if (!m_roi_tracking) {
+        return;
+    }
+
+    if (m_detected.size() > 0) {
+        const cv::Rect &r = m_detected[0].bounds;
+        cv::Rect b(r.x/PIXEL_SKIP, r.y/PIXEL_SKIP,
+            std::max(1, r.width/PIXEL_SKIP), std::max(1, r.height/PIXEL_SKIP));
+        if (m_window.locked) {
+            //Smoothed motion of the centre per frame.
+            cv::Point2f motion(
+                (b.x + b.width/2.0f) - (m_window.bounds.x + m_window.bounds.width/2.0f),
+                (b.y + b.height/2.0f) - (m_window.bounds.y + m_window.bounds.height/2.0f));
+            m_window.velocity = 0.5f * m_window.velocity + 0.5f * motion;
+        } else {
+            m_window.velocity = cv::Point2f(0, 0);
+            m_window.frames = 0;
+        }
+        m_window.bounds = b;
+        m_window.locked = true;
+        m_window.misses = 0;
+    } else if (m_window.locked && ++m_window.misses >= ROI_MAX_MISSES) {
+        //Lost it; go back to searching the full frame.
+        m_window.locked = false;
+        m_window.misses = 0;
+    }
 }
 
 /**
@@ -791,67 +1326,54 @@ void CameraStream::LearnThresholds(cv::Mat& src, cv::Mat& threshold, cv::Rect ro
  */
 bool CameraStream::CentreOfMass(cv::Mat& src, cv::Mat& threshold) {
     cv::Moments m;
-    Threshold(src, threshold, PROCESS_WIDTH);
+    cv::Rect window = SearchWindow();
+    Threshold(src, threshold, PROCESS_WIDTH, window);
     if (m_demo_mode) {
         cv::imshow("Thresholded image", threshold);
         cv::waitKey(1);
     }
     m_detected.clear();
-    m = cv::moments(threshold, true);
+    m = cv::moments(threshold(window), true);
     if(m.m00 > PIXEL_THRESHOLD) {
         ObjectInfo object = {0};
+        double cx = window.x + m.m10/m.m00, cy = window.y + m.m01/m.m00;
+        //Bounds of +/- 2 standard deviations about the centre.
+        double sx = 2*std::sqrt(m.mu20/m.m00), sy = 2*std::sqrt(m.mu02/m.m00);
+
         object.image_width = INPUT_WIDTH;
         object.image_height = INPUT_HEIGHT;
-        object.position.x = PIXEL_SKIP*m.m10/m.m00 - src.cols/2;
-        object.position.y = -(PIXEL_SKIP*m.m01/m.m00 - src.rows/2);
+        object.position.x = PIXEL_SKIP*cx - src.cols/2;
+        object.position.y = -(PIXEL_SKIP*cy - src.rows/2);
+        object.bounds = cv::Rect(PIXEL_SKIP*(cx - sx), PIXEL_SKIP*(cy - sy),
+            PIXEL_SKIP*2*sx + 1, PIXEL_SKIP*2*sy + 1);
         m_detected.push_back(object);
-        return true;
     }
-    return false;
+    UpdateSearchWindow();
+    return m_detected.size() > 0;
 }
 
 /**
- * Connected components V2
- * Computes position of 4 largest blobs on the image.
+ * Connected components V3
+ * Computes position of 4 largest blobs on the image. The thresholded image
+ * is closed and labelled in a single pass.
  * @param [in] src The image to compute from.
- * @param [out] threshold The location to store the thresholded image. NB:
- *                        Due to the call to `findContours`, this will likely
- *                        contain a meaningless image, and will not accurately
- *                        display the thresholded image used. To view this,
- *                        switch to 'Centre of Mass' mode.
+ * @param [out] threshold The location to store the (closed) thresholded image.
  * @return The number of objects detected, sorted by order of decreasing size.
  */
 int CameraStream::ConnectedComponents(cv::Mat& src, cv::Mat& threshold) {
-    Threshold(src, threshold, PROCESS_WIDTH);
+    cv::Rect window = SearchWindow();
+    Threshold(src, threshold, PROCESS_WIDTH, window);
+    cv::Mat search = threshold(window);
 
-    //Blur, dilate and erode the image
-    cv::Mat elementDilate(8, 8, CV_8U, cv::Scalar(255));
-    cv::Mat elementErode(8, 8, CV_8U, cv::Scalar(255));
-
-    cv::dilate(threshold, threshold, elementDilate);
-    cv::erode(threshold, threshold, elementErode);
+    //Close the image and find the blobs (connected components)
+    m_labeller.Label(search.data, search.cols, search.rows, search.step);
+    m_labeller.GetLargest(4, PIXEL_THRESHOLD, &m_blobs);
 
     if (m_demo_mode) {
         cv::imshow("Thresholded image", threshold);
         cv::waitKey(1);
     }
 
-    //Find the contours (connected components)
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(threshold, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
-
-    //Calculate the contour moments
-    typedef std::pair<std::vector<cv::Point>*, cv::Moments> ctm_t;
-    std::vector<ctm_t> comps(contours.size());
-    for(size_t i = 0; i < contours.size(); i++) {
-        comps[i] = ctm_t(&contours[i], cv::moments(contours[i], true));
-    }
-    //Sort moments in order of decreasing size (largest first)
-    std::sort(comps.begin(), comps.end(),
-    [] (const ctm_t &a, const ctm_t &b) {
-        return (int)b.second.m00 < (int)a.second.m00;
-    });
-
     m_detected.clear();
 
     ObjectInfo object = {0};
@@ -861,24 +1383,22 @@ int CameraStream::ConnectedComponents(cv::Mat& src, cv::Mat& threshold) {
     int nCols = threshold.cols * PIXEL_SKIP;
     int nRows = threshold.rows * PIXEL_SKIP;
 
-    //Calculate the locations on the original image (first 4 only)
-    for(int k=0; k < 4 && k < (int)comps.size(); k++) {
-        if(comps[k].second.m00 > PIXEL_THRESHOLD) {
-            comps[k].second.m01 *= PIXEL_SKIP;
-            comps[k].second.m10 *= PIXEL_SKIP;
-
-            object.id = k;
-            object.position.x = comps[k].second.m10/comps[k].second.m00 - nCols/2;
-            object.position.y = -(comps[k].second.m01/comps[k].second.m00 - nRows/2);
-
-            object.bounds = cv::boundingRect(*(comps[k].first));
-            object.bounds.x *= PIXEL_SKIP;
-            object.bounds.y *= PIXEL_SKIP;
-            object.bounds.width *= PIXEL_SKIP;
-            object.bounds.height *= PIXEL_SKIP;
-            m_detected.push_back(object);
-        }
+    //Calculate the locations on the original image
+    for(size_t k = 0; k < m_blobs.size(); k++) {
+        const Blob &b = m_blobs[k];
+        double cx = window.x + static_cast<double>(b.m10)/b.m00;
+        double cy = window.y + static_cast<double>(b.m01)/b.m00;
+
+        object.id = k;
+        object.position.x = PIXEL_SKIP*cx - nCols/2;
+        object.position.y = -(PIXEL_SKIP*cy - nRows/2);
+        object.bounds = cv::Rect((window.x + b.min_x)*PIXEL_SKIP,
+            (window.y + b.min_y)*PIXEL_SKIP,
+            (b.max_x - b.min_x + 1)*PIXEL_SKIP,
+            (b.max_y - b.min_y + 1)*PIXEL_SKIP);
+        m_detected.push_back(object);
     }
+    UpdateSearchWindow();
     return m_detected.size();
 }
 
@@ -952,27 +1472,189 @@ bool CameraStream::CamShift(cv::Mat& src, cv::Mat& threshold) {
 }
 
 /**
- * Uses the HOG descriptor to detect people.
+ * Runs the HOG detector over one band of one level of the image pyramid.
+ * @param [in] hog The HOG detector.
+ * @param [in] image The greyscale image to search.
+ * @param [in] scale The pyramid level's scale factor.
+ * @param [in] row_start The first row of the band (at the level's scale).
+ * @param [in] row_end The row after the last window start in the band.
+ * @param [out] hits The windows found, in image coordinates.
+ */
+static void HOGDetectLevel(const cv::HOGDescriptor &hog, const cv::Mat &image,
+    double scale, int row_start, int row_end, std::vector<cv::Rect> *hits)
+{
+    cv::Size size(cvRound(image.cols/scale), cvRound(image.rows/scale));
+    cv::Mat level = image;
+    if (size != image.size()) {
+        cv::resize(image, level, size);
+    }
+
+    //Include the rows needed by windows starting in the band.
+    int band_end = std::min(size.height, row_end + hog.winSize.height - 1);
+    std::vector<cv::Point> locations;
+    hog.detect(level.rowRange(row_start, band_end), locations);
+
+    hits->clear();
+    for (cv::Point &p : locations) {
+        hits->push_back(cv::Rect(cvRound(p.x*scale), cvRound((p.y + row_start)*scale),
+            cvRound(hog.winSize.width*scale), cvRound(hog.winSize.height*scale)));
+    }
+}
+
+/**
+ * Starts an asynchronous HOG run on the thread pool. The work is split by
+ * pyramid level, and large levels are further split into bands of rows.
+ * @param [in] gray The greyscale processing image.
+ * @param [in] window The part of the image to search.
+ */
+void CameraStream::StartHOG(const cv::Mat &gray, cv::Rect window) {
+    HOGState &state = m_hog_state;
+    gray(window).copyTo(state.image);
+    state.offset = window.tl();
+    state.frames = 0;
+    state.run_generation = state.generation;
+    state.jobs.clear();
+
+    //The same pyramid levels as detectMultiScale.
+    const cv::Size &win = m_hog.winSize;
+    std::vector<std::pair<double, cv::Point>> tasks;
+    double scale = 1;
+    for (int i = 0; i < 64; i++) {
+        cv::Size size(cvRound(state.image.cols/scale), cvRound(state.image.rows/scale));
+        if (size.width < win.width || size.height < win.height) {
+            break;
+        }
+        int rows = size.height - win.height + 1;
+        int bands = picopter::clamp(rows / win.height, 1, m_thresh_workers);
+        for (int j = 0; j < bands; j++) {
+            tasks.push_back(std::make_pair(scale,
+                cv::Point((j * rows) / bands, ((j + 1) * rows) / bands)));
+        }
+        scale *= 1.05;
+    }
+
+    state.hits.resize(tasks.size());
+    for (size_t i = 0; i < tasks.size(); i++) {
+        double level_scale = tasks[i].first;
+        cv::Point band = tasks[i].second;
+        std::vector<cv::Rect> *hits = &state.hits[i];
+        state.jobs.emplace_back(m_pool.enqueue([this, level_scale, band, hits] {
+            HOGDetectLevel(m_hog, m_hog_state.image, level_scale, band.x, band.y, hits);
+        }));
+    }
+}
+
+/**
+ * Collects the results of a HOG run, if it has finished. The results of
+ * a run started before the last mode change are discarded.
+ * @return true iff a run finished (and its results were collected).
+ */
+bool CameraStream::CollectHOG() {
+    HOGState &state = m_hog_state;
+    for (auto &job : state.jobs) {
+        if (job.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+    }
+
+    std::vector<cv::Rect> found;
+    for (size_t i = 0; i < state.jobs.size(); i++) {
+        state.jobs[i].get();
+        for (cv::Rect &r : state.hits[i]) {
+            found.push_back(r + state.offset);
+        }
+    }
+    state.jobs.clear();
+    if (state.run_generation != state.generation) {
+        return false;
+    }
+
+    //Merge overlapping windows, as detectMultiScale does.
+    cv::groupRectangles(found, 2, 0.2);
+    state.found = found;
+
+    //Keep what each person looked like, to follow them until the next run.
+    state.templates.resize(found.size());
+    cv::Rect bounds(state.offset, state.image.size());
+    for (size_t i = 0; i < found.size(); i++) {
+        cv::Rect r = (found[i] & bounds) - state.offset;
+        if (r.width < 2 || r.height < 2) {
+            state.templates[i].release();
+            continue;
+        }
+        cv::resize(state.image(r), state.templates[i],
+            cv::Size(r.width/2, r.height/2));
+    }
+    return true;
+}
+
+/**
+ * Moves the current HOG detections to follow the people in a newer frame,
+ * by matching their templates around where they were last seen.
+ * @param [in] gray The greyscale processing image.
+ */
+void CameraStream::PropagateHOG(const cv::Mat &gray) {
+    HOGState &state = m_hog_state;
+    cv::Rect bounds(0, 0, gray.cols, gray.rows);
+    for (size_t i = 0; i < state.found.size(); i++) {
+        cv::Rect &r = state.found[i];
+        cv::Mat &templ = state.templates[i];
+        cv::Rect area(r.x - r.width/2, r.y - r.height/2, r.width*2, r.height*2);
+        area &= bounds;
+        if (templ.empty() || area.width < r.width || area.height < r.height) {
+            continue;
+        }
+
+        //Match at half resolution, like the template.
+        cv::resize(gray(area), m_scratch_gray,
+            cv::Size(area.width/2, area.height/2));
+        if (m_scratch_gray.cols < templ.cols || m_scratch_gray.rows < templ.rows) {
+            continue;
+        }
+        cv::matchTemplate(m_scratch_gray, templ, state.match, CV_TM_CCOEFF_NORMED);
+        double score;
+        cv::Point best;
+        cv::minMaxLoc(state.match, NULL, &score, NULL, &best);
+        if (score > 0.6) {
+            r.x = area.x + best.x*2;
+            r.y = area.y + best.y*2;
+        }
+    }
+}
+
+/**
+ * Uses the HOG descriptor to detect people. Detection runs asynchronously
+ * on the thread pool, at most every HOG_STRIDE frames; in between, the
+ * people found are followed by template matching.
  * @param [in] src The image to compute from.
  * @param [in] process The process buffer.
  * @return true iff people were detected.
  */
 bool CameraStream::HOGPeople(cv::Mat &src, cv::Mat& process) {
-    std::vector<cv::Rect> found;
+    HOGState &state = m_hog_state;
+    cv::resize(src, m_scratch, cv::Size(PROCESS_WIDTH, PROCESS_HEIGHT));
+    cv::cvtColor(m_scratch, process, CV_BGR2GRAY);
+    state.frames++;
 
-    cv::resize(src, process, cv::Size(PROCESS_WIDTH, PROCESS_HEIGHT));
-    cv::cvtColor(process, process, CV_BGR2GRAY);
-    m_hog.detectMultiScale(process, found);
+    if (!state.jobs.empty()) {
+        CollectHOG();
+    }
+    //Detections are from an older frame; follow them into this one.
+    PropagateHOG(process);
+    if (state.jobs.empty() && state.frames >= HOG_STRIDE) {
+        StartHOG(process, SearchWindow(m_hog.winSize));
+    }
     m_detected.clear();
 
     if (m_demo_mode) {
         cv::imshow("Thresholded image", process);
     }
 
-    for (size_t i = 0; i < found.size(); i++) {
+    for (size_t i = 0; i < state.found.size(); i++) {
         ObjectInfo object{};
-        cv::Rect r(found[i].x*PIXEL_SKIP, found[i].y*PIXEL_SKIP,
-                   found[i].width*PIXEL_SKIP, found[i].height*PIXEL_SKIP);
+        const cv::Rect &f = state.found[i];
+        cv::Rect r(f.x*PIXEL_SKIP, f.y*PIXEL_SKIP,
+                   f.width*PIXEL_SKIP, f.height*PIXEL_SKIP);
 
         object.image_width = INPUT_WIDTH;
         object.image_height = INPUT_HEIGHT;
@@ -980,8 +1662,8 @@ bool CameraStream::HOGPeople(cv::Mat &src, cv::Mat& process) {
         object.position.y = -(r.y + r.height/2) + src.rows/2;
         object.bounds = r;
         m_detected.push_back(object);
-        Log(LOG_DEBUG, "DETECTED HOG");
     }
 
+    UpdateSearchWindow();
     return m_detected.size() > 0;
 }
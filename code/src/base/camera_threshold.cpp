@@ -0,0 +1,645 @@
+/**
+ * @file camera_threshold.cpp
+ * @brief Colour thresholding lookup kernels.
+ *
+ * The lookup itself is a gather from a table, so the vector kernels
+ * concentrate on de-interleaving the BGR input, quantising each channel
+ * with shifts and forming the table indices for a block of pixels at once.
+ * AVX2 can also do the table gather in hardware. All kernels produce
+ * exactly the same output as the scalar kernel.
+ */
+
+#include "common.h"
+#include "camera_threshold.h"
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define THRESH_HAVE_X86
+#  include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define THRESH_HAVE_NEON
+#  include <arm_neon.h>
+#  if defined(__arm__) && defined(__linux__)
+#    include <sys/auxv.h>
+#    include <asm/hwcap.h>
+#  endif
+#endif
+
+static_assert(THRESH_DIV == (1 << THRESH_SHIFT), "THRESH_SHIFT does not match THRESH_DIV");
+static_assert(THRESH_SIZE == 16, "Threshold kernels assume 4 bit colour bins");
+
+using namespace picopter;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+/**
+ * Lookup into the THRESH_SIZE^3 byte table (one byte per colour bin).
+ */
+struct BinnedTable {
+    static inline uint32_t Index(const uint8_t *p) {
+        return ((p[2] >> THRESH_SHIFT) << 8) | ((p[1] >> THRESH_SHIFT) << 4) | (p[0] >> THRESH_SHIFT);
+    }
+
+    static inline uint8_t Lookup(const uint8_t *lut, uint32_t idx) {
+        return lut[idx];
+    }
+
+#ifdef THRESH_HAVE_X86
+    /** Converts B,G,R,x pixels (one per 32 bit lane) into table indices. **/
+    __attribute__((target("sse2")))
+    static inline __m128i IndexSSE2(__m128i px) {
+        __m128i r = _mm_and_si128(_mm_srli_epi32(px, 12), _mm_set1_epi32(0xF00));
+        __m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), _mm_set1_epi32(0x0F0));
+        __m128i b = _mm_and_si128(_mm_srli_epi32(px, 4), _mm_set1_epi32(0x00F));
+        return _mm_or_si128(_mm_or_si128(r, g), b);
+    }
+
+    /**
+     * Looks up 8 table entries using gathers. The table is read as aligned
+     * 32 bit words so that nothing past the end of the table is touched.
+     */
+    __attribute__((target("avx2")))
+    static inline __m256i LookupAVX2(__m256i px, const uint8_t *lut) {
+        __m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 12), _mm256_set1_epi32(0xF00));
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), _mm256_set1_epi32(0x0F0));
+        __m256i b = _mm256_and_si256(_mm256_srli_epi32(px, 4), _mm256_set1_epi32(0x00F));
+        __m256i idx = _mm256_or_si256(_mm256_or_si256(r, g), b);
+
+        __m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut),
+            _mm256_and_si256(idx, _mm256_set1_epi32(~3)), 1);
+        __m256i shift = _mm256_slli_epi32(_mm256_and_si256(idx, _mm256_set1_epi32(3)), 3);
+        return _mm256_and_si256(_mm256_srlv_epi32(word, shift), _mm256_set1_epi32(0xFF));
+    }
+#endif
+
+#ifdef THRESH_HAVE_NEON
+    /** Converts de-interleaved B, G and R planes of 16 pixels into indices. **/
+    static inline void IndexNEON(uint8x16x3_t bgr, uint32_t *idx) {
+        uint8x16_t b = vshrq_n_u8(bgr.val[0], THRESH_SHIFT);
+        uint8x16_t g = vshrq_n_u8(bgr.val[1], THRESH_SHIFT);
+        uint8x16_t r = vshrq_n_u8(bgr.val[2], THRESH_SHIFT);
+        //g << 4 | b fits in a byte; r goes in the high byte.
+        uint8x16x2_t gbr = vzipq_u8(vorrq_u8(vshlq_n_u8(g, 4), b), r);
+        for (int i = 0; i < 2; i++) {
+            uint16x8_t v = vreinterpretq_u16_u8(gbr.val[i]);
+            vst1q_u32(idx + 8*i, vmovl_u16(vget_low_u16(v)));
+            vst1q_u32(idx + 8*i + 4, vmovl_u16(vget_high_u16(v)));
+        }
+    }
+#endif
+};
+
+/**
+ * Lookup into the THRESH_FULL_SIZE bit table (one bit per 24-bit colour).
+ */
+struct FullTable {
+    static inline uint32_t Index(const uint8_t *p) {
+        return (p[2] << 16) | (p[1] << 8) | p[0];
+    }
+
+    static inline uint8_t Lookup(const uint8_t *lut, uint32_t idx) {
+        return static_cast<uint8_t>(-((lut[idx >> 3] >> (idx & 7)) & 1));
+    }
+
+#ifdef THRESH_HAVE_X86
+    __attribute__((target("sse2")))
+    static inline __m128i IndexSSE2(__m128i px) {
+        return _mm_and_si128(px, _mm_set1_epi32(0xFFFFFF));
+    }
+
+    /** Looks up 8 table bits, reading the table as aligned 32 bit words. **/
+    __attribute__((target("avx2")))
+    static inline __m256i LookupAVX2(__m256i px, const uint8_t *lut) {
+        __m256i idx = _mm256_and_si256(px, _mm256_set1_epi32(0xFFFFFF));
+        __m256i word = _mm256_i32gather_epi32(reinterpret_cast<const int*>(lut),
+            _mm256_slli_epi32(_mm256_srli_epi32(idx, 5), 2), 1);
+        __m256i bit = _mm256_srlv_epi32(word, _mm256_and_si256(idx, _mm256_set1_epi32(31)));
+        bit = _mm256_and_si256(bit, _mm256_set1_epi32(1));
+        return _mm256_and_si256(_mm256_sub_epi32(_mm256_setzero_si256(), bit),
+            _mm256_set1_epi32(0xFF));
+    }
+#endif
+
+#ifdef THRESH_HAVE_NEON
+    static inline void IndexNEON(uint8x16x3_t bgr, uint32_t *idx) {
+        uint8x16x2_t bg = vzipq_u8(bgr.val[0], bgr.val[1]);
+        uint16x8_t r[2] = {vmovl_u8(vget_low_u8(bgr.val[2])), vmovl_u8(vget_high_u8(bgr.val[2]))};
+        for (int i = 0; i < 2; i++) {
+            uint16x8_t v = vreinterpretq_u16_u8(bg.val[i]);
+            vst1q_u32(idx + 8*i, vorrq_u32(vmovl_u16(vget_low_u16(v)),
+                vshll_n_u16(vget_low_u16(r[i]), 16)));
+            vst1q_u32(idx + 8*i + 4, vorrq_u32(vmovl_u16(vget_high_u16(v)),
+                vshll_n_u16(vget_high_u16(r[i]), 16)));
+        }
+    }
+#endif
+};
+
+/**
+ * Portable thresholding kernel.
+ * @see ThresholdKernel
+ */
+template <typename Table>
+static void ThresholdRowScalar(const uint8_t *src, uint8_t *dst, int width, int stride, const uint8_t *lut) {
+    for (int i = 0; i < width; i++, src += stride) {
+        dst[i] = Table::Lookup(lut, Table::Index(src));
+    }
+}
+
+#ifdef THRESH_HAVE_X86
+/**
+ * Loads the (unaligned) 32 bits starting at a pixel.
+ * The fourth byte belongs to the next pixel and is ignored.
+ */
+static inline int LoadPixel32(const uint8_t *p) {
+    int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * SSE2 thresholding kernel. Computes 16 indices per iteration.
+ * @see ThresholdKernel
+ */
+template <typename Table>
+__attribute__((target("sse2")))
+static void ThresholdRowSSE2(const uint8_t *src, uint8_t *dst, int width, int stride, const uint8_t *lut) {
+    alignas(16) uint32_t idx[16];
+    int i = 0;
+
+    //Each pixel is read as 32 bits, so the last pixel is left to the
+    //scalar loop to avoid reading past the end of the image.
+    for (; i + 16 < width; i += 16) {
+        const uint8_t *p = src + i * stride;
+        for (int j = 0; j < 4; j++, p += 4 * stride) {
+            __m128i v = Table::IndexSSE2(_mm_setr_epi32(LoadPixel32(p),
+                LoadPixel32(p + stride), LoadPixel32(p + 2 * stride),
+                LoadPixel32(p + 3 * stride)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(idx + 4 * j), v);
+        }
+        for (int j = 0; j < 16; j++) {
+            dst[i + j] = Table::Lookup(lut, idx[j]);
+        }
+    }
+    ThresholdRowScalar<Table>(src + i * stride, dst + i, width - i, stride, lut);
+}
+
+/**
+ * AVX2 thresholding kernel. Gathers the source pixels and the table
+ * entries, producing 32 output pixels per iteration.
+ * @see ThresholdKernel
+ */
+template <typename Table>
+__attribute__((target("avx2")))
+static void ThresholdRowAVX2(const uint8_t *src, uint8_t *dst, int width, int stride, const uint8_t *lut) {
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(8 * stride);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i offsets = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(stride));
+    int i = 0;
+
+    //As for SSE2, the last pixel is always done by the scalar loop.
+    for (; i + 32 < width; i += 32) {
+        __m256i v[4];
+        for (int j = 0; j < 4; j++) {
+            __m256i px = _mm256_i32gather_epi32(reinterpret_cast<const int*>(src), offsets, 1);
+            v[j] = Table::LookupAVX2(px, lut);
+            offsets = _mm256_add_epi32(offsets, step);
+        }
+        //Packing works per 128 bit lane; the final permute restores order.
+        __m256i w = _mm256_packus_epi16(_mm256_packus_epi32(v[0], v[1]),
+                                        _mm256_packus_epi32(v[2], v[3]));
+        w = _mm256_permutevar8x32_epi32(w, order);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), w);
+    }
+    ThresholdRowScalar<Table>(src + i * stride, dst + i, width - i, stride, lut);
+}
+#endif //THRESH_HAVE_X86
+
+#ifdef THRESH_HAVE_NEON
+/**
+ * NEON thresholding kernel. Handles full resolution (stride 3) and half
+ * resolution (stride 6) input 16 pixels at a time; other strides use the
+ * scalar kernel.
+ * @see ThresholdKernel
+ */
+template <typename Table>
+static void ThresholdRowNEON(const uint8_t *src, uint8_t *dst, int width, int stride, const uint8_t *lut) {
+    uint32_t idx[16];
+    int i = 0;
+
+    if (stride == 3) {
+        for (; i + 16 <= width; i += 16) {
+            Table::IndexNEON(vld3q_u8(src + i * 3), idx);
+            for (int j = 0; j < 16; j++) {
+                dst[i + j] = Table::Lookup(lut, idx[j]);
+            }
+        }
+    } else if (stride == 6) {
+        //Load 32 pixels and keep every second one. The last load reads
+        //three bytes past the 16th pixel, so leave one pixel for scalar.
+        for (; i + 16 < width; i += 16) {
+            const uint8_t *p = src + i * 6;
+            uint8x16x3_t a = vld3q_u8(p);
+            uint8x16x3_t b = vld3q_u8(p + 48);
+            uint8x16x3_t bgr;
+            bgr.val[0] = vuzpq_u8(a.val[0], b.val[0]).val[0];
+            bgr.val[1] = vuzpq_u8(a.val[1], b.val[1]).val[0];
+            bgr.val[2] = vuzpq_u8(a.val[2], b.val[2]).val[0];
+            Table::IndexNEON(bgr, idx);
+            for (int j = 0; j < 16; j++) {
+                dst[i + j] = Table::Lookup(lut, idx[j]);
+            }
+        }
+    }
+    ThresholdRowScalar<Table>(src + i * stride, dst + i, width - i, stride, lut);
+}
+#endif //THRESH_HAVE_NEON
+
+/**
+ * Retrieves a kernel implementation for a given table layout.
+ * @param [in] type The kernel implementation.
+ * @return The kernel, or nullptr if it is not supported on this machine.
+ */
+template <typename Table>
+static ThresholdKernel GetKernel(ThresholdKernelType type) {
+    switch (type) {
+        case THRESH_KERNEL_SCALAR:
+            return ThresholdRowScalar<Table>;
+#ifdef THRESH_HAVE_X86
+        case THRESH_KERNEL_SSE2:
+            if (__builtin_cpu_supports("sse2")) {
+                return ThresholdRowSSE2<Table>;
+            }
+            break;
+        case THRESH_KERNEL_AVX2:
+            if (__builtin_cpu_supports("avx2")) {
+                return ThresholdRowAVX2<Table>;
+            }
+            break;
+#endif
+#ifdef THRESH_HAVE_NEON
+        case THRESH_KERNEL_NEON:
+#  if defined(__arm__) && defined(__linux__)
+            if (!(getauxval(AT_HWCAP) & HWCAP_NEON)) {
+                break;
+            }
+#  endif
+            return ThresholdRowNEON<Table>;
+#endif
+        default:
+            break;
+    }
+    return nullptr;
+}
+
+/**
+ * Retrieves a specific thresholding kernel.
+ * @param [in] type The kernel implementation.
+ * @param [in] table The layout of the lookup table the kernel will use.
+ * @return The kernel, or nullptr if it is not supported on this machine.
+ */
+ThresholdKernel picopter::GetThresholdKernel(ThresholdKernelType type, ThresholdTableType table) {
+    if (table == THRESH_TABLE_FULL) {
+        return GetKernel<FullTable>(type);
+    }
+    return GetKernel<BinnedTable>(type);
+}
+
+/**
+ * Determines the fastest thresholding kernel supported on this machine.
+ * @return The kernel type.
+ */
+ThresholdKernelType picopter::GetBestThresholdKernel(void) {
+    static const ThresholdKernelType preference[] = {
+        THRESH_KERNEL_AVX2, THRESH_KERNEL_NEON, THRESH_KERNEL_SSE2
+    };
+
+    for (ThresholdKernelType type : preference) {
+        if (GetThresholdKernel(type)) {
+            return type;
+        }
+    }
+    return THRESH_KERNEL_SCALAR;
+}
+
+/**
+ * Gets a human readable name for a thresholding kernel.
+ * @param [in] type The kernel type.
+ * @return The name of the kernel.
+ */
+const char* picopter::GetThresholdKernelName(ThresholdKernelType type) {
+    switch (type) {
+        case THRESH_KERNEL_SCALAR: return "scalar";
+        case THRESH_KERNEL_SSE2: return "SSE2";
+        case THRESH_KERNEL_AVX2: return "AVX2";
+        case THRESH_KERNEL_NEON: return "NEON";
+    }
+    return "unknown";
+}
+
+/**
+ * Converts from RGB to HSV colourspace.
+ * Uses the OpenCV convention of 0-180 for hue.
+ *
+ * @param [in] r The red value.
+ * @param [in] g The green value.
+ * @param [in] b The blue value;
+ * @param [out] h The hue value (0-180).
+ * @param [out] s The saturation value (0-255).
+ * @param [out] v The value value (0-255).
+ */
+void picopter::RGB2HSV(uint8_t r, uint8_t g, uint8_t b, uint8_t *h, uint8_t *s, uint8_t *v) {
+    uint8_t rgb_max = std::max(r, std::max(g, b));
+    uint8_t rgb_min = std::min(r, std::min(g, b));
+    uint8_t delta = rgb_max - rgb_min;
+
+    *v = rgb_max;
+    if (rgb_max != 0 && delta != 0) {
+        *s = ((int)255*delta)/rgb_max;
+    } else {
+        *s = 0;
+        *h = 0;
+        return;
+    }
+
+    if(r == rgb_max) {
+        *h = 43 * (g-b)/delta;
+    } else if(g == rgb_max) {
+        *h = 85 + 43 * (b-r)/delta;
+    } else {
+        *h = 171 + 43 * (r-g)/delta;
+    }
+
+    *h = (uint8_t)(((int)180*(*h))/255);
+}
+
+/**
+ * Converts to the Y'CbCr colourspace.
+ * @param [in] r The red value.
+ * @param [in] g The green value.
+ * @param [in] b The blue value.
+ * @param [in] y The luma component (0-255).
+ * @param [in] cb The blue difference component (0-255).
+ * @param [in] cr The red difference component (0-255).
+ */
+void picopter::RGB2YCbCr(uint8_t r, uint8_t g, uint8_t b, uint8_t *y, uint8_t *cb, uint8_t *cr) {
+    *y = 0.299 * r + 0.587 * g + 0.114 * b;
+    *cb = -0.168736 * r - 0.331264 * g + 0.500 * b + 128;
+    *cr = 0.500 * r - 0.418688 * g - 0.081312 * b + 128;
+}
+
+/**
+ * Converts a colour into the three channels of a thresholding colourspace.
+ * @param [in] colourspace The colourspace.
+ * @param [in] r The red value.
+ * @param [in] g The green value.
+ * @param [in] b The blue value.
+ * @param [out] c The converted channels.
+ */
+static inline void ConvertColour(ThresholdColourspace colourspace, uint8_t r, uint8_t g, uint8_t b, uint8_t c[3]) {
+    if (colourspace == THRESH_HSV) {
+        RGB2HSV(r, g, b, &c[0], &c[1], &c[2]);
+    } else {
+        RGB2YCbCr(r, g, b, &c[0], &c[1], &c[2]);
+    }
+}
+
+/**
+ * Edge length of the cubes the colour space is divided into when working
+ * out what needs to be rebuilt. 8 blue values are exactly one table byte.
+ */
+#define TILE_SIZE 8
+/** The number of tiles along each axis of the colour cube **/
+#define TILE_COUNT (256 / TILE_SIZE)
+
+/**
+ * Constructor. Starts the background builder. No table is available until
+ * Update has been called and the first build completes.
+ */
+ThresholdBitTable::ThresholdBitTable()
+: m_stop(false)
+, m_pending(false)
+, m_building(false)
+, m_next{}
+, m_tables{new uint8_t[THRESH_FULL_SIZE], new uint8_t[THRESH_FULL_SIZE]}
+, m_built{}
+, m_valid{false, false}
+, m_front{-1}
+, m_readers{{0}, {0}}
+{
+    m_builder = std::thread(&ThresholdBitTable::BuildLoop, this);
+}
+
+/**
+ * Destructor. Stops the builder thread. Any readers must have released
+ * their tables before this is called.
+ */
+ThresholdBitTable::~ThresholdBitTable() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_signal.notify_all();
+    m_builder.join();
+
+    delete [] m_tables[0];
+    delete [] m_tables[1];
+}
+
+/**
+ * Requests the table be rebuilt with new thresholds. This does not block;
+ * if several updates arrive while a build is in progress, only the most
+ * recent one is built.
+ * @param [in] channels The new thresholds.
+ */
+void ThresholdBitTable::Update(const ThresholdChannels &channels) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_next = channels;
+        m_pending = true;
+    }
+    m_signal.notify_one();
+}
+
+/**
+ * Waits until all requested updates have been built and swapped in.
+ */
+void ThresholdBitTable::Flush(void) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_stop || (!m_pending && !m_building); });
+}
+
+/**
+ * Gets the current table for reading. The table will not be modified until
+ * it is released.
+ * @param [out] handle Identifies the table; pass it to Release when done.
+ * @return The table, or nullptr if none has been built yet (in which case
+ *         Release must not be called).
+ */
+const uint8_t* ThresholdBitTable::Acquire(int *handle) {
+    for (;;) {
+        int front = m_front;
+        if (front < 0) {
+            return nullptr;
+        }
+        m_readers[front]++;
+        //Check that the builder did not swap buffers from under us.
+        if (m_front == front) {
+            *handle = front;
+            return m_tables[front];
+        }
+        m_readers[front]--;
+    }
+}
+
+/**
+ * Releases a table returned by Acquire.
+ * @param [in] handle The handle returned by Acquire.
+ */
+void ThresholdBitTable::Release(int handle) {
+    m_readers[handle]--;
+}
+
+/**
+ * The background builder loop.
+ */
+void ThresholdBitTable::BuildLoop(void) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+        if (!m_pending) {
+            m_signal.wait(lock);
+            continue;
+        }
+
+        ThresholdChannels channels = m_next;
+        m_pending = false;
+        m_building = true;
+        lock.unlock();
+
+        //Build into the buffer that readers aren't using, waiting for
+        //any stragglers that acquired it before the last swap.
+        int back = m_front < 0 ? 0 : 1 - m_front;
+        while (m_readers[back] > 0) {
+            std::this_thread::yield();
+        }
+
+        auto start = steady_clock::now();
+        Rebuild(back, channels);
+        m_front = back;
+        Log(LOG_DEBUG, "Rebuilt full threshold table in %d ms",
+            (int)duration_cast<milliseconds>(steady_clock::now() - start).count());
+
+        lock.lock();
+        m_building = false;
+        m_done.notify_all();
+    }
+    m_done.notify_all();
+}
+
+/**
+ * Computes the range of each converted channel within every tile of the
+ * colour cube. This is a one-off full pass over all colours, done the
+ * first time a colourspace is used.
+ * @param [in] colourspace The colourspace.
+ */
+void ThresholdBitTable::BuildRanges(ThresholdColourspace colourspace) {
+    std::vector<TileRange> &ranges = m_ranges[colourspace];
+    ranges.resize(TILE_COUNT * TILE_COUNT * TILE_COUNT);
+
+    for (int t = 0; t < (int)ranges.size(); t++) {
+        int r0 = (t >> 10) * TILE_SIZE;
+        int g0 = ((t >> 5) & (TILE_COUNT - 1)) * TILE_SIZE;
+        int b0 = (t & (TILE_COUNT - 1)) * TILE_SIZE;
+        TileRange &range = ranges[t];
+        uint8_t c[3];
+
+        memset(range.lo, 255, sizeof(range.lo));
+        memset(range.hi, 0, sizeof(range.hi));
+        for (int r = r0; r < r0 + TILE_SIZE; r++) {
+            for (int g = g0; g < g0 + TILE_SIZE; g++) {
+                for (int b = b0; b < b0 + TILE_SIZE; b++) {
+                    ConvertColour(colourspace, r, g, b, c);
+                    for (int i = 0; i < 3; i++) {
+                        range.lo[i] = std::min(range.lo[i], c[i]);
+                        range.hi[i] = std::max(range.hi[i], c[i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Brings a buffer up to date with the given thresholds. Tiles whose channel
+ * ranges do not touch any changed channel value are left alone. Of those
+ * that need work, tiles entirely inside or outside the thresholds are
+ * filled directly; only the remainder are evaluated colour by colour.
+ * @param [in] buffer The buffer to rebuild.
+ * @param [in] channels The thresholds.
+ */
+void ThresholdBitTable::Rebuild(int buffer, const ThresholdChannels &channels) {
+    //Prefix counts of accepted and changed values for each channel, so
+    //range tests are O(1): count[c][hi+1] - count[c][lo].
+    int accepted[3][257], changed[3][257];
+    bool full = !m_valid[buffer] || m_built[buffer].colourspace != channels.colourspace;
+    uint8_t *table = m_tables[buffer];
+
+    if (m_ranges[channels.colourspace].empty()) {
+        BuildRanges(channels.colourspace);
+    }
+    const std::vector<TileRange> &ranges = m_ranges[channels.colourspace];
+
+    for (int i = 0; i < 3; i++) {
+        accepted[i][0] = changed[i][0] = 0;
+        for (int v = 0; v < 256; v++) {
+            bool diff = full || channels.accept[i][v] != m_built[buffer].accept[i][v];
+            accepted[i][v+1] = accepted[i][v] + channels.accept[i][v];
+            changed[i][v+1] = changed[i][v] + diff;
+        }
+    }
+
+    for (int t = 0; t < (int)ranges.size(); t++) {
+        const TileRange &range = ranges[t];
+        bool dirty = false, inside = true, outside = false;
+
+        for (int i = 0; i < 3; i++) {
+            int lo = range.lo[i], hi = range.hi[i] + 1;
+            int count = accepted[i][hi] - accepted[i][lo];
+            dirty |= changed[i][hi] != changed[i][lo];
+            inside &= count == hi - lo;
+            outside |= count == 0;
+        }
+        if (!dirty) {
+            continue;
+        }
+
+        int r0 = (t >> 10) * TILE_SIZE;
+        int g0 = ((t >> 5) & (TILE_COUNT - 1)) * TILE_SIZE;
+        int b0 = (t & (TILE_COUNT - 1)) * TILE_SIZE;
+        for (int r = r0; r < r0 + TILE_SIZE; r++) {
+            for (int g = g0; g < g0 + TILE_SIZE; g++) {
+                uint8_t bits = 0;
+                if (inside && !outside) {
+                    bits = 0xFF;
+                } else if (!outside) {
+                    for (int b = 0; b < TILE_SIZE; b++) {
+                        uint8_t c[3];
+                        ConvertColour(channels.colourspace, r, g, b0 + b, c);
+                        if (channels.accept[0][c[0]] && channels.accept[1][c[1]] &&
+                            channels.accept[2][c[2]]) {
+                            bits |= 1 << b;
+                        }
+                    }
+                }
+                table[(r << 13) | (g << 5) | (b0 >> 3)] = bits;
+            }
+        }
+    }
+
+    m_built[buffer] = channels;
+    m_valid[buffer] = true;
+}
@@ -0,0 +1,459 @@
+/**
+ * @file distrib.cpp
+ * @brief Ellipsoidal (gaussian) uncertainty distributions and their algebra.
+ * Distributions are kept in information form, so combining independent
+ * measurements is a sum. Nothing is ever inverted: the few solves needed go
+ * through an LDL^T factorisation that copes with the singular (zero
+ * information) directions that monocular sightings have.
+ */
+
+#include "common.h"
+#include "navigation.h"
+#include "distrib.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace picopter;
+using cv::Matx33d;
+using cv::Vec3d;
+
+/** Pivots smaller than this (relative to the largest diagonal) are zero. **/
+static const double PIVOT_TOLERANCE = 1e-12;
+
+/**
+ * Constructs the symmetric part of a matrix.
+ * @param [in] m The matrix.
+ */
+SymMat3::SymMat3(const Matx33d &m)
+: xx(m(0,0)), yy(m(1,1)), zz(m(2,2))
+, yz((m(1,2) + m(2,1)) / 2)
+, xz((m(0,2) + m(2,0)) / 2)
+, xy((m(0,1) + m(1,0)) / 2)
+{
+}
+
+/**
+ * Converts to a full matrix.
+ */
+SymMat3::operator Matx33d() const {
+    return Matx33d(
+        xx, xy, xz,
+        xy, yy, yz,
+        xz, yz, zz);
+}
+
+/**
+ * Retrieves an element.
+ * @param [in] i The row.
+ * @param [in] j The column.
+ * @return The element.
+ */
+double SymMat3::operator()(int i, int j) const {
+    switch (i * 3 + j) {
+        case 0: return xx;
+        case 4: return yy;
+        case 8: return zz;
+        case 5: case 7: return yz;
+        case 2: case 6: return xz;
+        default: return xy;
+    }
+}
+
+/** Element-wise arithmetic on symmetric matrices. **/
+SymMat3 picopter::operator+(const SymMat3 &a, const SymMat3 &b) {
+    return SymMat3(a.xx + b.xx, a.yy + b.yy, a.zz + b.zz,
+                   a.yz + b.yz, a.xz + b.xz, a.xy + b.xy);
+}
+
+SymMat3 picopter::operator-(const SymMat3 &a, const SymMat3 &b) {
+    return SymMat3(a.xx - b.xx, a.yy - b.yy, a.zz - b.zz,
+                   a.yz - b.yz, a.xz - b.xz, a.xy - b.xy);
+}
+
+SymMat3 picopter::operator*(double s, const SymMat3 &a) {
+    return SymMat3(s * a.xx, s * a.yy, s * a.zz, s * a.yz, s * a.xz, s * a.xy);
+}
+
+Vec3d picopter::operator*(const SymMat3 &a, const Vec3d &v) {
+    return Vec3d(
+        a.xx * v(0) + a.xy * v(1) + a.xz * v(2),
+        a.xy * v(0) + a.yy * v(1) + a.yz * v(2),
+        a.xz * v(0) + a.yz * v(1) + a.zz * v(2));
+}
+
+/**
+ * Factorises a positive semi-definite matrix as L D L^T.
+ * @param [in] a The matrix.
+ * @return The factorisation.
+ */
+SymFactor picopter::factorSym(const SymMat3 &a) {
+    SymFactor f = {{0, 0, 0}, 0, 0, 0, 0};
+    double tol = PIVOT_TOLERANCE * std::max(std::fabs(a.xx),
+        std::max(std::fabs(a.yy), std::fabs(a.zz)));
+
+    if (a.xx > tol) {
+        f.d[0] = a.xx;
+        f.l10 = a.xy / f.d[0];
+        f.l20 = a.xz / f.d[0];
+        f.rank++;
+    }
+    double d1 = a.yy - f.l10 * f.l10 * f.d[0];
+    if (d1 > tol) {
+        f.d[1] = d1;
+        f.l21 = (a.yz - f.l20 * f.l10 * f.d[0]) / f.d[1];
+        f.rank++;
+    }
+    double d2 = a.zz - f.l20 * f.l20 * f.d[0] - f.l21 * f.l21 * f.d[1];
+    if (d2 > tol) {
+        f.d[2] = d2;
+        f.rank++;
+    }
+    return f;
+}
+
+/**
+ * Solves A x = b, given the factorisation of A. Components along directions
+ * that A has no information about are zero.
+ * @param [in] f The factorisation of A.
+ * @param [in] b The right hand side.
+ * @return The solution, x.
+ */
+Vec3d picopter::solveSym(const SymFactor &f, const Vec3d &b) {
+    double y0 = b(0);
+    double y1 = b(1) - f.l10 * y0;
+    double y2 = b(2) - f.l20 * y0 - f.l21 * y1;
+
+    double z0 = f.d[0] > 0 ? y0 / f.d[0] : 0;
+    double z1 = f.d[1] > 0 ? y1 / f.d[1] : 0;
+    double z2 = f.d[2] > 0 ? y2 / f.d[2] : 0;
+
+    double x2 = z2;
+    double x1 = z1 - f.l21 * x2;
+    double x0 = z0 - f.l10 * x1 - f.l20 * x2;
+    return Vec3d(x0, x1, x2);
+}
+
+/**
+ * Computes v^T A v.
+ * @param [in] a The matrix, A.
+ * @param [in] v The vector, v.
+ * @return The quadratic form.
+ */
+double picopter::quadForm(const SymMat3 &a, const Vec3d &v) {
+    return a.xx * v(0) * v(0) + a.yy * v(1) * v(1) + a.zz * v(2) * v(2) +
+        2 * (a.yz * v(1) * v(2) + a.xz * v(0) * v(2) + a.xy * v(0) * v(1));
+}
+
+/**
+ * Computes R A R^T.
+ * @param [in] a The matrix, A.
+ * @param [in] r The rotation, R.
+ * @return The rotated matrix.
+ */
+SymMat3 picopter::rotateSym(const SymMat3 &a, const Matx33d &r) {
+    double m[3][3]; //R A
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            m[i][j] = r(i,0) * a(0,j) + r(i,1) * a(1,j) + r(i,2) * a(2,j);
+        }
+    }
+
+    double c[3][3]; //(R A) R^T (upper triangle)
+    for (int i = 0; i < 3; i++) {
+        for (int j = i; j < 3; j++) {
+            c[i][j] = m[i][0] * r(j,0) + m[i][1] * r(j,1) + m[i][2] * r(j,2);
+        }
+    }
+    return SymMat3(c[0][0], c[1][1], c[2][2], c[1][2], c[0][2], c[0][1]);
+}
+
+/**
+ * Computes (A^-1 + B^-1)^-1, the information of the sum of two independent
+ * variables, without inverting anything. This is A - A (A+B)^-1 A, which
+ * stays well defined when A or B is singular.
+ * @param [in] a The information matrix, A.
+ * @param [in] b The information matrix, B.
+ * @return The combined information matrix.
+ */
+SymMat3 picopter::convolveSym(const SymMat3 &a, const SymMat3 &b) {
+    SymFactor f = factorSym(a + b);
+    Vec3d col[3], x[3];
+    for (int j = 0; j < 3; j++) {
+        col[j] = Vec3d(a(0,j), a(1,j), a(2,j));
+        x[j] = solveSym(f, col[j]);
+    }
+
+    double c[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = i; j < 3; j++) {
+            c[i][j] = a(i,j) - (col[i].dot(x[j]) + col[j].dot(x[i])) / 2;
+        }
+    }
+    return SymMat3(c[0][0], c[1][1], c[2][2], c[1][2], c[0][2], c[0][1]);
+}
+
+/**
+ * Generates a spherical distribution about the origin (sigma = 1).
+ * @return The distribution.
+ */
+Distrib picopter::generatedistrib(){
+    //= e^-(0.5x^2 + 0.5y^2 + 0.5 z^2)
+    Distrib primitive = {SymMat3(0.5, 0.5, 0.5, 0, 0, 0), Vec3d(0,0,0)};
+    return primitive;
+}
+
+/**
+ * Generates a distribution from its centre, widths and orientation.
+ * @param [in] params The parameters.
+ * @return The distribution.
+ */
+Distrib picopter::generatedistrib(DistribParams params){
+    Distrib primitive = generatedistrib();
+    Distrib dS = stretchDistrib(primitive, params.sigma_x, params.sigma_y, params.sigma_z);
+    Distrib dR = rotateDistribEuler(dS, params.yaw, params.pitch, params.roll);
+    Distrib dT = translateDistrib(dR, params.x, params.y, params.z);
+
+    return dT;
+}
+
+/**
+ * Calculates the centre of a distribution.
+ * @param [in] A The distribution.
+ * @return The parameters (only the centre is filled in).
+ * @todo The widths are the eigenvalues.
+ */
+DistribParams picopter::getdistribParams(Distrib A){
+    DistribParams D = {};
+    D.x = -A.vect(0);
+    D.y = -A.vect(1);
+    D.z = -A.vect(2);
+    return D;
+}
+
+/**
+ * Samples a distribution.
+ * @param [in] A The distribution.
+ * @param [in] B The point to sample at.
+ * @return The (unnormalised) density at B.
+ */
+double picopter::sampleDistrib(Distrib &A, Vec3d &B){
+    return exp(-quadForm(A.axes, A.vect - B));
+}
+
+/**
+ * Combines two distributions (as though statistically independent, so
+ * beware of biases). A distribution with zero axes cancels out entirely.
+ * @param [in] A The first distribution.
+ * @param [in] B The second distribution.
+ * @return The combination.
+ */
+Distrib picopter::combineDistribs(Distrib A, Distrib B){
+    Distrib C;
+    C.axes = A.axes + B.axes;
+    C.vect = solveSym(factorSym(C.axes), A.axes * A.vect + B.axes * B.vect);
+    return C;
+}
+
+/**
+ * Combines many distributions at once (as though statistically independent).
+ * @param [in] dists The distributions.
+ * @param [in] n The number of distributions.
+ * @return The combination.
+ */
+Distrib picopter::combineDistribs(const Distrib *dists, size_t n){
+    Distrib C;
+    Vec3d weighted(0, 0, 0);
+    for (size_t i = 0; i < n; i++) {
+        C.axes = C.axes + dists[i].axes;
+        weighted += dists[i].axes * dists[i].vect;
+    }
+    C.vect = solveSym(factorSym(C.axes), weighted);
+    return C;
+}
+
+/**
+ * Removes B from a combination C = combineDistribs(A, B), giving back A.
+ * @param [in] C The combination.
+ * @param [in] B The distribution to remove.
+ * @return The remainder.
+ */
+Distrib picopter::separateDistribs(Distrib C, Distrib B){
+    Distrib A;
+    A.axes = C.axes - B.axes;
+    SymFactor f = factorSym(A.axes);
+    if(f.rank == 0){
+        //B was all that was known (or nothing was); there's no centre to recover
+        A.vect = C.vect;
+        return A;
+    }
+
+    A.vect = solveSym(f, C.axes * C.vect - B.axes * B.vect);
+    return A;
+}
+
+/**
+ * Estimates how likely two distributions are of the same thing: the
+ * integral of their product, scaled so that it's 1 when the centres match.
+ * @param [in] A The first distribution.
+ * @param [in] B The second distribution.
+ * @return The overlap, between 0 and 1.
+ */
+double picopter::overlapDistribs(const Distrib &A, const Distrib &B){
+    return exp(-distanceDistribs(A, B) / 2);
+}
+
+/**
+ * Estimates the overlap of one distribution with each of many others.
+ * @param [in] A The distribution.
+ * @param [in] B The other distributions.
+ * @param [in] n The number of other distributions.
+ * @param [out] out The overlaps (n of them).
+ */
+void picopter::overlapDistribs(const Distrib &A, const Distrib *B, size_t n, double *out){
+    for (size_t i = 0; i < n; i++) {
+        out[i] = overlapDistribs(A, B[i]);
+    }
+}
+
+/**
+ * Calculates the squared Mahalanobis distance between the centres of two
+ * distributions, given the uncertainty of both. Directions that either has
+ * no information about don't count.
+ * @param [in] A The first distribution.
+ * @param [in] B The second distribution.
+ * @return The squared distance, in (combined) standard deviations.
+ */
+double picopter::distanceDistribs(const Distrib &A, const Distrib &B){
+    //The axes are 1/(2 sigma^2), hence the 2.
+    return 2 * quadForm(convolveSym(A.axes, B.axes), A.vect - B.vect);
+}
+
+/**
+ * Calculates the distance from one distribution to each of many others.
+ * @param [in] A The distribution.
+ * @param [in] B The other distributions.
+ * @param [in] n The number of other distributions.
+ * @param [out] out The squared distances (n of them).
+ */
+void picopter::distanceDistribs(const Distrib &A, const Distrib *B, size_t n, double *out){
+    for (size_t i = 0; i < n; i++) {
+        out[i] = distanceDistribs(A, B[i]);
+    }
+}
+
+/**
+ * Translates a distribution.
+ * @param [in] A The distribution.
+ * @param [in] offset The offset.
+ * @return The translated distribution.
+ */
+Distrib picopter::translateDistrib(Distrib A, Vec3d offset){
+    Distrib D;
+    D.axes = A.axes;
+    D.vect = A.vect + offset;
+    return D;
+}
+
+/**
+ * Rotates a distribution about the origin.
+ * @param [in] A The distribution.
+ * @param [in] roll The roll (degrees).
+ * @param [in] pitch The pitch (degrees).
+ * @param [in] yaw The yaw (degrees).
+ * @return The rotated distribution.
+ */
+Distrib picopter::rotateDistribEuler(Distrib A, double roll, double pitch, double yaw){
+    return rotateDistrib(A, rotationMatrix(roll, pitch, yaw));
+}
+
+/**
+ * Generates the rotation matrix for the given Euler angles.
+ * @param [in] roll The roll (degrees).
+ * @param [in] pitch The pitch (degrees).
+ * @param [in] yaw The yaw (degrees).
+ * @return The rotation matrix.
+ */
+Matx33d picopter::rotationMatrix(double roll, double pitch, double yaw){
+    double a;
+    a = DEG2RAD(roll);
+    Matx33d Rx(1,      0,       0,
+                    0, cos(a), -sin(a),
+                    0, sin(a),  cos(a));
+    a = DEG2RAD(pitch);
+    Matx33d Ry( cos(a), 0,  sin(a),
+                          0, 1,       0,
+                    -sin(a), 0,  cos(a));
+    a = DEG2RAD(yaw);
+    Matx33d Rz(cos(a), -sin(a), 0,
+                    sin(a),  cos(a), 0,
+                        0,        0, 1);
+    return Rz*Ry*Rx;
+}
+
+/**
+ * Rotates a distribution about the origin.
+ * @param [in] A The distribution.
+ * @param [in] Mrot The rotation matrix.
+ * @return The rotated distribution.
+ */
+Distrib picopter::rotateDistrib(Distrib A, Matx33d Mrot){
+    Distrib D;
+    D.axes = rotateSym(A.axes, Mrot);
+    D.vect = Mrot * A.vect;
+    return D;
+}
+
+/**
+ * Stretches a distribution about the origin.
+ * @param [in] A The distribution.
+ * @param [in] sx The stretch along x.
+ * @param [in] sy The stretch along y.
+ * @param [in] sz The stretch along z.
+ * @return The stretched distribution.
+ */
+Distrib picopter::stretchDistrib(Distrib A, double sx, double sy, double sz){
+    Distrib D;
+    D.vect = Vec3d(sx * A.vect(0), sy * A.vect(1), sz * A.vect(2));    //increase distance from origin
+    D.axes = SymMat3(                                                   //increase the size
+        A.axes.xx / (sx * sx), A.axes.yy / (sy * sy), A.axes.zz / (sz * sz),
+        A.axes.yz / (sy * sz), A.axes.xz / (sx * sz), A.axes.xy / (sx * sy));
+    return D;
+}
+
+/**
+ * Moves the centre of A by a distance described by B: the distribution of
+ * the sum (the convolution). Can be used to encode velocity uncertainty.
+ * If B has no information in some direction (e.g. an unknown velocity), A
+ * is returned unchanged.
+ * @param [in] A The distribution.
+ * @param [in] B The step.
+ * @return The moved distribution.
+ */
+Distrib picopter::vectorSum(Distrib A, Distrib B){
+    if(factorSym(B.axes).rank < 3){
+        return A;
+    }
+
+    Distrib C;
+    C.vect = A.vect + B.vect;
+    C.axes = convolveSym(A.axes, B.axes);
+    return C;
+}
+
+/**
+ * Estimates the velocity from two locations and a time difference (or the
+ * acceleration from two velocities). This won't make reversible
+ * transformations.
+ * @param [in] newLoc The later location.
+ * @param [in] oldLoc The earlier location.
+ * @param [in] timestep The time between them.
+ * @return The rate of change.
+ */
+Distrib picopter::changeStep(Distrib newLoc, Distrib oldLoc, TIME_TYPE timestep){
+    Distrib estVel;
+    estVel.vect = newLoc.vect - oldLoc.vect;    //difference in position
+    estVel.axes = convolveSym(newLoc.axes, oldLoc.axes);    //change in variance is same as vectorSum
+
+    estVel = stretchDistrib(estVel, TICKS_PER_SEC/(double)(timestep.count()));
+    return estVel;
+}
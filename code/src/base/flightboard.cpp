@@ -16,7 +16,9 @@ using namespace picopter::navigation;
 using picopter::FlightBoard;
 using picopter::GPS;
 using picopter::IMU;
-using std::this_thread::sleep_for;
+using picopter::MAVCommsStats;
+using picopter::MAVCommsQueue;
+using picopter::MAVCommsQueueStats;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
 using std::chrono::steady_clock;
@@ -39,10 +41,12 @@ FlightBoard::FlightBoard(Options *opts)
 , m_is_in_air{false}
 , m_is_armed{false}
 , m_has_home_position{false}
+, m_needs_refresh{true}
 , m_rel_watchdog(0)
-, m_gimbal{}
+, m_safety_watchdog(0)
+, m_safety_skip(100)
+, m_gimbal()
 , m_home_position{}
-, m_handler_table{}
 {
     if (opts) {
         opts->SetFamily("FLIGHTBOARD");
@@ -56,13 +60,29 @@ FlightBoard::FlightBoard(Options *opts)
         m_link = new MAVCommsSerial("/dev/ttyAMA0", 115200);
         Log(LOG_NOTICE, "Connected to the Pixhawk via /dev/ttyAMA0.");
     }
+    m_tx = new MAVCommsQueue(m_link);
+    m_telemetry = new TelemetryManager(m_tx, m_flightboard_id);
+    m_telemetry->Request(MAVLINK_MSG_ID_MOUNT_STATUS, MOUNT_STATUS_RATE);
     
     m_gps = new GPSMAV(this, opts);
     m_imu = new IMU(this, opts);
     
     //m_link = new MAVCommsSerial("/dev/virtualcom0", 57600);
-    m_input_thread = std::thread(&FlightBoard::InputLoop, this);
-    m_output_thread = std::thread(&FlightBoard::OutputLoop, this);
+    m_heartbeat = new Watchdog(&m_reactor, m_heartbeat_timeout*1000, [this] {
+        m_is_auto_mode = false;
+        if (!m_needs_refresh) {
+            Log(LOG_WARNING, "Heartbeat timeout, disabling auto mode!");
+            m_needs_refresh = true;
+        }
+    });
+    m_heartbeat->Start();
+    m_reactor.AddDescriptor(m_link->GetDescriptor(),
+        std::bind(&FlightBoard::InputHandler, this));
+    m_reactor.AddTimer(100, std::bind(&FlightBoard::OutputHandler, this));
+    m_reactor.AddTimer(TELEMETRY_CHECK_INTERVAL, [this] {
+        m_telemetry->Check();
+    });
+    m_reactor.Start();
 }
 
 /** 
@@ -77,10 +97,18 @@ FlightBoard::~FlightBoard() {
     SetBodyVel(Vec3D{});
     Stop();
     m_shutdown = true;
-    m_input_thread.join();
-    m_output_thread.join();
+    m_reactor.Stop();
+    m_bus.Stop();
+    delete m_heartbeat;
+    
+    MAVCommsStats stats;
+    m_link->GetStats(&stats);
+    Log(LOG_DEBUG, "MAVLink: %lu messages (%lu CRC drops) in %lu bytes over %lu reads",
+        stats.messages, stats.crc_drops, stats.bytes, stats.reads);
     delete m_gps;
     delete m_imu;
+    delete m_telemetry;
+    delete m_tx; //Sends anything still queued (e.g. the stop above)
     delete m_link;
 }
 
@@ -102,13 +130,24 @@ IMU* FlightBoard::GetIMUInstance() {
     return m_imu;
 }
 
+/**
+ * Get a hold of the event loop that runs the flight board's I/O. Other
+ * sensors may add their (non-blocking) handlers to it.
+ * Must not be freed by the user.
+ * @return The reactor.
+ */
+picopter::Reactor* FlightBoard::GetReactor() {
+    return &m_reactor;
+}
+
 /**
  * Retrieve the gimbal pose.
  * @param [out] p The gimbal pose, in degrees.
+ * @param [out] info The location to store when the pose was received
+ *                   (may be NULL).
  */
-void FlightBoard::GetGimbalPose(EulerAngle *p) {
-    std::lock_guard<std::mutex> lock(m_gimbal_mutex);
-    *p = m_gimbal;
+void FlightBoard::GetGimbalPose(EulerAngle *p, SampleInfo *info) {
+    m_gimbal.Load(p, info);
 }
 
 /**
@@ -131,202 +170,181 @@ bool FlightBoard::GetHomePosition(navigation::Coord3D *p) {
 }
 
 /**
- * Input loop to process MAVLink messages received from the copter (Pixhawk).
+ * Retrieves the statistics of the connection to the flight board.
+ * @param [out] stats The location to store the statistics.
  */
-void FlightBoard::InputLoop() {
-    mavlink_message_t msg;
-    mavlink_heartbeat_t heartbeat;
-    std::atomic<bool> needs_refresh{true};
+void FlightBoard::GetLinkStats(MAVCommsStats *stats) {
+    m_link->GetStats(stats);
+}
+
+/**
+ * Retrieves the statistics of the transmit queue.
+ * @param [out] stats The location to store the statistics.
+ */
+void FlightBoard::GetQueueStats(MAVCommsQueueStats *stats) {
+    m_tx->GetStats(stats);
+}
+
+/**
+ * Reads and dispatches the MAVLink messages received from the copter
+ * (Pixhawk). Called by the reactor when the link is readable; this reads
+ * what has arrived (without waiting) and returns.
+ */
+void FlightBoard::InputHandler() {
+    mavlink_message_t msgs[MAVLINK_READ_BATCH];
+    size_t count;
     
-    Watchdog wdog(m_heartbeat_timeout*1000, [this, &needs_refresh] {
-        m_is_auto_mode = false;
-        if (!needs_refresh) {
-            Log(LOG_WARNING, "Heartbeat timeout, disabling auto mode!");
-            needs_refresh = true;
+    do {
+        count = m_link->ReadMessages(msgs, MAVLINK_READ_BATCH, 0);
+        for (size_t i = 0; i < count && !m_shutdown; i++) {
+            HandleMessage(msgs[i]);
         }
-    });
+    } while (count == MAVLINK_READ_BATCH && !m_shutdown);
+}
+
+/**
+ * Processes a MAVLink message received from the copter (Pixhawk).
+ * @param [in] msg The message.
+ */
+void FlightBoard::HandleMessage(const mavlink_message_t &msg) {
+    mavlink_heartbeat_t heartbeat;
     
-    wdog.Start();
-    while (!m_shutdown) {
-        if (m_link->ReadMessage(&msg)) {
-            switch (msg.msgid) {
-                case MAVLINK_MSG_ID_HEARTBEAT: {
-                    mavlink_msg_heartbeat_decode(&msg, &heartbeat);
-                    
-                    //Skip heartbeats that aren't from the copter
-                    if (heartbeat.type != MAV_TYPE_GCS) {
-                        mavlink_message_t smsg;
-                        
-                        m_is_auto_mode = (heartbeat.custom_mode == GUIDED);
-                        m_is_rtl = (heartbeat.custom_mode == RTL);
-                        m_is_in_air = (heartbeat.system_status == MAV_STATE_ACTIVE);
-                        m_is_armed = static_cast<bool>(
-                            heartbeat.base_mode & MAV_MODE_FLAG_SAFETY_ARMED);
-                        //LogSimple(LOG_DEBUG, "Heartbeat! Mode: %d, %d, %d, %d, %d", 
-                        //heartbeat.type, heartbeat.base_mode, heartbeat.custom_mode, 
-                        //heartbeat.system_status, (int)m_is_auto_mode);
-                        
-                        if (heartbeat.base_mode & MAV_MODE_FLAG_SAFETY_ARMED) {
-                            if (!m_has_home_position) {
-                                //Apparently the home position is returned as
-                                //the first waypoint. For now, set the home
-                                //position as the current position, and request
-                                //the first waypoint. If we get that, use that
-                                //instead.
-                                GPSData d;
-                                m_gps->GetLatest(&d);
-                                if (!std::isnan(d.fix.lat) && !std::isnan(d.fix.lon)) {
-                                    m_home_position.lat = d.fix.lat;
-                                    m_home_position.lon = d.fix.lon;
-                                    std::atomic_thread_fence(std::memory_order_release);
-                                    m_has_home_position.store(true, std::memory_order_relaxed);
-                                    Log(LOG_NOTICE, "Home position set as: %.7f, %.7f",
-                                        d.fix.lat, d.fix.lon);
-                                }
-                                mavlink_msg_mission_request_pack(
-                                    m_system_id, m_flightboard_id, &smsg,
-                                    m_system_id, m_component_id, 0);
-                                m_link->WriteMessage(&smsg);
-                            }
-                        } else {
-                            //Need a new home position if we're not armed.
-                            m_has_home_position = false;
-                        }
-                        
-                        if (needs_refresh) {
-                            mavlink_request_data_stream_t stream{};
-
-                            m_system_id = msg.sysid;
-                            m_component_id = msg.compid;
-                            Log(LOG_INFO, "Initialisation: sysid: %d, compid: %d",
-                                msg.sysid, msg.compid);
-                            
-                            stream.target_system = m_system_id;
-                            stream.target_component = m_component_id;
-                            stream.start_stop = 1;
-                            stream.req_message_rate = 6;
-                            
-                            //GPS data at 6Hz
-                            stream.req_stream_id = MAV_DATA_STREAM_POSITION;
-                            mavlink_msg_request_data_stream_encode(
-                                m_system_id, m_flightboard_id, &smsg, &stream);
-                            m_link->WriteMessage(&smsg);
-                            //IMU data at 6Hz
-                            stream.req_stream_id = MAV_DATA_STREAM_EXTRA1;
-                            mavlink_msg_request_data_stream_encode(
-                                m_system_id, m_flightboard_id, &smsg, &stream);
-                            m_link->WriteMessage(&smsg);
-                            //HUD data at 1Hz
-                            stream.req_stream_id = MAV_DATA_STREAM_EXTRA2;
-                            stream.req_message_rate = 1;
-                            mavlink_msg_request_data_stream_encode(
-                                m_system_id, m_flightboard_id, &smsg, &stream);
-                            m_link->WriteMessage(&smsg);
-                            //Time at 1Hz - only for syncing w/ copter (GPS).
-                            stream.req_stream_id = MAV_DATA_STREAM_EXTRA3;
-                            mavlink_msg_request_data_stream_encode(
-                                m_system_id, m_flightboard_id, &smsg, &stream);
-                            m_link->WriteMessage(&smsg);
-                            //Battery info at 1Hz.
-                            stream.req_stream_id = MAV_DATA_STREAM_EXTENDED_STATUS;
-                            mavlink_msg_request_data_stream_encode(
-                                m_system_id, m_flightboard_id, &smsg, &stream);
-                            m_link->WriteMessage(&smsg);
-                            
-                            needs_refresh = false;
+    m_telemetry->Received(msg.msgid);
+    switch (msg.msgid) {
+        case MAVLINK_MSG_ID_HEARTBEAT: {
+            mavlink_msg_heartbeat_decode(&msg, &heartbeat);
+            
+            //Skip heartbeats that aren't from the copter
+            if (heartbeat.type != MAV_TYPE_GCS) {
+                mavlink_message_t smsg;
+                
+                m_is_auto_mode = (heartbeat.custom_mode == GUIDED);
+                m_is_rtl = (heartbeat.custom_mode == RTL);
+                m_is_in_air = (heartbeat.system_status == MAV_STATE_ACTIVE);
+                m_is_armed = static_cast<bool>(
+                    heartbeat.base_mode & MAV_MODE_FLAG_SAFETY_ARMED);
+                //LogSimple(LOG_DEBUG, "Heartbeat! Mode: %d, %d, %d, %d, %d", 
+                //heartbeat.type, heartbeat.base_mode, heartbeat.custom_mode, 
+                //heartbeat.system_status, (int)m_is_auto_mode);
+                
+                if (heartbeat.base_mode & MAV_MODE_FLAG_SAFETY_ARMED) {
+                    if (!m_has_home_position) {
+                        //Apparently the home position is returned as
+                        //the first waypoint. For now, set the home
+                        //position as the current position, and request
+                        //the first waypoint. If we get that, use that
+                        //instead.
+                        GPSData d;
+                        m_gps->GetLatest(&d);
+                        if (!std::isnan(d.fix.lat) && !std::isnan(d.fix.lon)) {
+                            m_home_position.lat = d.fix.lat;
+                            m_home_position.lon = d.fix.lon;
+                            std::atomic_thread_fence(std::memory_order_release);
+                            m_has_home_position.store(true, std::memory_order_relaxed);
+                            Log(LOG_NOTICE, "Home position set as: %.7f, %.7f",
+                                d.fix.lat, d.fix.lon);
                         }
-                        wdog.Touch();
-                    }
-                } break;
-                case MAVLINK_MSG_ID_MISSION_ITEM: {
-                    mavlink_mission_item_t item;
-                    mavlink_msg_mission_item_decode(&msg, &item);
-                    if (item.seq == 0) { //This is supposedly the home position.
-                        m_has_home_position = false;
-                        m_home_position.lat = item.x;
-                        m_home_position.lon = item.y;
-                        std::atomic_thread_fence(std::memory_order_release);
-                        m_has_home_position.store(true, std::memory_order_relaxed);
-                        Log(LOG_NOTICE, "Home position set via MI as: %.7f, %.7f",
-                            item.x, item.y);
-                        
-                    } else {
-                        Log(LOG_DEBUG, "Mission item! %d, %.7f, %.7f, %.1f",
-                            item.seq, item.x, item.y, item.z);
+                        mavlink_msg_mission_request_pack(
+                            m_system_id, m_flightboard_id, &smsg,
+                            m_system_id, m_component_id, 0);
+                        m_tx->Send(&smsg, MAV_PRIORITY_COMMAND);
                     }
-                } break;
-                //case MAVLINK_MSG_ID_SYS_STATUS: {
-                //    mavlink_sys_status_t status;
-                //    mavlink_msg_sys_status_decode(&msg, &status);
-                //    LogSimple(LOG_DEBUG, "BATTERY: %.2fV, Draw: %.2fA, Remain: %3d%%",
-                //        status.voltage_battery*1e-3,
-                //        status.current_battery*1e-2,
-                //        status.battery_remaining);
-                //} break;
-                case MAVLINK_MSG_ID_COMMAND_ACK: {
-                    mavlink_command_ack_t ack;
-                    mavlink_msg_command_ack_decode(&msg, &ack);
-                    if (ack.result != 0 || ack.command != 115)
-                        Log(LOG_DEBUG, "COMMAND: %d, RESULT: %d", ack.command, ack.result);
-                } break;
-                case MAVLINK_MSG_ID_MOUNT_STATUS: {
-                    mavlink_mount_status_t mnt;
-                    mavlink_msg_mount_status_decode(&msg, &mnt);
-                    std::lock_guard<std::mutex> lock(m_gimbal_mutex);
-                    m_gimbal.pitch = mnt.pointing_a/100.0;
-                    m_gimbal.roll = mnt.pointing_b/100.0;
-                    m_gimbal.yaw = mnt.pointing_c/100.0;
-                    //Log(LOG_DEBUG, "GOT MOUNT! %1f, %.1f, %.1f", m_gimbal.pitch, m_gimbal.roll, m_gimbal.yaw);
-                } break;
-            }
-            
-            //Call the event handler, if any.
-            if (msg.msgid >= 0 && msg.msgid < 255) {
-                EventHandler e = m_handler_table[msg.msgid];
-                if (e) {
-                    e(&msg);
+                } else {
+                    //Need a new home position if we're not armed.
+                    m_has_home_position = false;
                 }
+                
+                if (m_needs_refresh) {
+                    m_system_id = msg.sysid;
+                    m_component_id = msg.compid;
+                    Log(LOG_INFO, "Initialisation: sysid: %d, compid: %d",
+                        msg.sysid, msg.compid);
+                    
+                    //(Re)request the telemetry that's needed.
+                    m_telemetry->Connect(m_system_id, m_component_id);
+                    m_needs_refresh = false;
+                }
+                m_heartbeat->Touch();
             }
-        }
+        } break;
+        case MAVLINK_MSG_ID_MISSION_ITEM: {
+            mavlink_mission_item_t item;
+            mavlink_msg_mission_item_decode(&msg, &item);
+            if (item.seq == 0) { //This is supposedly the home position.
+                m_has_home_position = false;
+                m_home_position.lat = item.x;
+                m_home_position.lon = item.y;
+                std::atomic_thread_fence(std::memory_order_release);
+                m_has_home_position.store(true, std::memory_order_relaxed);
+                Log(LOG_NOTICE, "Home position set via MI as: %.7f, %.7f",
+                    item.x, item.y);
+                
+            } else {
+                Log(LOG_DEBUG, "Mission item! %d, %.7f, %.7f, %.1f",
+                    item.seq, item.x, item.y, item.z);
+            }
+        } break;
+        //case MAVLINK_MSG_ID_SYS_STATUS: {
+        //    mavlink_sys_status_t status;
+        //    mavlink_msg_sys_status_decode(&msg, &status);
+        //    LogSimple(LOG_DEBUG, "BATTERY: %.2fV, Draw: %.2fA, Remain: %3d%%",
+        //        status.voltage_battery*1e-3,
+        //        status.current_battery*1e-2,
+        //        status.battery_remaining);
+        //} break;
+        case MAVLINK_MSG_ID_COMMAND_ACK: {
+            mavlink_command_ack_t ack;
+            mavlink_msg_command_ack_decode(&msg, &ack);
+            m_telemetry->CommandAck(&ack);
+            if (ack.result != 0 || ack.command != 115)
+                Log(LOG_DEBUG, "COMMAND: %d, RESULT: %d", ack.command, ack.result);
+        } break;
+        case MAVLINK_MSG_ID_MOUNT_STATUS: {
+            mavlink_mount_status_t mnt;
+            mavlink_msg_mount_status_decode(&msg, &mnt);
+            EulerAngle gimbal;
+            gimbal.pitch = mnt.pointing_a/100.0;
+            gimbal.roll = mnt.pointing_b/100.0;
+            gimbal.yaw = mnt.pointing_c/100.0;
+            m_gimbal.Store(gimbal);
+            //Log(LOG_DEBUG, "GOT MOUNT! %1f, %.1f, %.1f", gimbal.pitch, gimbal.roll, gimbal.yaw);
+        } break;
     }
-    wdog.Stop();
+    
+    //Pass it on to any subscribers.
+    m_bus.Publish(&msg);
 }
 
 /**
- * Redundant safety loop to send an 'all stop' command continuously when
+ * Redundant safety check to send an 'all stop' command continuously when
  * the copter is in guided mode and is not actively sending commands.
+ * Called by the reactor every 100ms.
  * Note: ArduCopter already imposes a 2s safety limit, so this is an extra
  * safety on top of that. This only engages for when relative commands are sent.
  */
-void FlightBoard::OutputLoop() {
-    int last_watchdog = 0;
-    int skip_counter = 100;
-    
-    while (!m_shutdown) {
-        if (!m_disable_local && m_is_auto_mode) {
-            std::lock_guard<std::mutex> lock(m_output_mutex);
-            
-            //Must send a relative command at least at 1Hz
-            if (last_watchdog >= m_rel_watchdog) {
-                if (last_watchdog > m_rel_watchdog || skip_counter++ > 10) {
-                    mavlink_message_t msg;
-                    mavlink_set_position_target_local_ned_t sp = {};
-                    sp.type_mask = MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_VELOCITY;
-                    sp.coordinate_frame = MAV_FRAME_BODY_OFFSET_NED;
-                    sp.target_system = m_system_id;
-                    sp.target_component = m_component_id;   
+void FlightBoard::OutputHandler() {
+    if (!m_disable_local && m_is_auto_mode) {
+        std::lock_guard<std::mutex> lock(m_output_mutex);
+        
+        //Must send a relative command at least at 1Hz
+        if (m_safety_watchdog >= m_rel_watchdog) {
+            if (m_safety_watchdog > m_rel_watchdog || m_safety_skip++ > 10) {
+                mavlink_message_t msg;
+                mavlink_set_position_target_local_ned_t sp = {};
+                sp.type_mask = MAVLINK_MSG_SET_POSITION_TARGET_LOCAL_NED_VELOCITY;
+                sp.coordinate_frame = MAV_FRAME_BODY_OFFSET_NED;
+                sp.target_system = m_system_id;
+                sp.target_component = m_component_id;   
  
-                    //Log(LOG_DEBUG, "SAFETY");
-                    mavlink_msg_set_position_target_local_ned_encode(
-                        m_system_id, m_flightboard_id, &msg, &sp);
-                    m_link->WriteMessage(&msg);
-                }
-            } else {
-                skip_counter = 0;
+                //Log(LOG_DEBUG, "SAFETY");
+                mavlink_msg_set_position_target_local_ned_encode(
+                    m_system_id, m_flightboard_id, &msg, &sp);
+                m_tx->Send(&msg, MAV_PRIORITY_SAFETY);
             }
-            last_watchdog = m_rel_watchdog;
+        } else {
+            m_safety_skip = 0;
         }
-        sleep_for(milliseconds(100));
+        m_safety_watchdog = m_rel_watchdog;
     }
 }
 
@@ -352,7 +370,7 @@ bool FlightBoard::DoGuidedTakeoff(int alt) {
         cmd.param7 = std::max(alt, 0);
         
         mavlink_msg_command_long_encode(m_system_id, m_flightboard_id, &msg, &cmd);
-        m_link->WriteMessage(&msg);
+        m_tx->Send(&msg, MAV_PRIORITY_COMMAND);
         return true;
     }
     return false;
@@ -370,7 +388,7 @@ bool FlightBoard::DoReturnToLaunch() {
     Stop();
     cmd.command = MAV_CMD_NAV_RETURN_TO_LAUNCH;
     mavlink_msg_command_long_encode(m_system_id, m_flightboard_id, &msg, &cmd);
-    m_link->WriteMessage(&msg);
+    m_tx->Send(&msg, MAV_PRIORITY_SAFETY);
     return true;
 }
 
@@ -411,7 +429,7 @@ bool FlightBoard::SetGuidedWaypoint(int seq, float radius, float wait, navigatio
         
         m_disable_local = true; //Disable watchdog
         mavlink_msg_mission_item_encode(m_system_id, m_flightboard_id, &msg, &mi);
-        m_link->WriteMessage(&msg);
+        m_tx->Send(&msg, MAV_PRIORITY_COMMAND);
         return true;
     }
     return false;
@@ -436,7 +454,7 @@ bool FlightBoard::SetWaypointSpeed(int sp) {
         cmd.param2 = sp;
         
         mavlink_msg_command_long_encode(m_system_id, m_flightboard_id, &msg, &cmd);
-        m_link->WriteMessage(&msg);
+        m_tx->Send(&msg, MAV_PRIORITY_COMMAND);
         return true;
     }
     return false;
@@ -477,7 +495,7 @@ bool FlightBoard::SetBodyVel(Vec3D v) {
         SetYaw(0, true); //Lock yaw
         mavlink_msg_set_position_target_local_ned_encode(
             m_system_id, m_flightboard_id, &msg, &sp);
-        m_link->WriteMessage(&msg);
+        m_tx->Send(&msg, MAV_PRIORITY_SETPOINT);
         return true;
     }
     return false;
@@ -519,7 +537,7 @@ bool FlightBoard::SetBodyPos(Vec3D p) {
         SetYaw(0, true); //Lock yaw
         mavlink_msg_set_position_target_local_ned_encode(
             m_system_id, m_flightboard_id, &msg, &sp);
-        m_link->WriteMessage(&msg);
+        m_tx->Send(&msg, MAV_PRIORITY_SETPOINT);
         return true;
     }
     return false;
@@ -546,7 +564,7 @@ bool FlightBoard::SetRegionOfInterest(Coord3D roi) {
         cmd.param7 = roi.alt;
         
         mavlink_msg_command_long_encode(m_system_id, m_flightboard_id, &msg, &cmd);
-        m_link->WriteMessage(&msg);
+        m_tx->Send(&msg, MAV_PRIORITY_COMMAND);
         return true;
     }
     return false;
@@ -585,7 +603,7 @@ bool FlightBoard::SetYaw(int bearing, bool relative) {
         yaw_sp.param3 = bearing < 0 ? -1 : 1; //Yaw direction (CCW or CW)
         yaw_sp.param4 = relative ? 1 : 0; //Relative
         mavlink_msg_command_long_encode(m_system_id, m_flightboard_id, &msg, &yaw_sp);
-        m_link->WriteMessage(&msg);
+        m_tx->Send(&msg, MAV_PRIORITY_SETPOINT);
         return true;
     }
     return false;
@@ -612,7 +630,7 @@ bool FlightBoard::SetGimbalPose(EulerAngle pose) {
 
     mavlink_msg_mount_control_encode(m_system_id,  m_flightboard_id, &msg, &gimbal);
     //mavlink_msg_command_long_encode(m_system_id, m_flightboard_id, &msg, &gimbal);
-    m_link->WriteMessage(&msg);
+    m_tx->Send(&msg, MAV_PRIORITY_SETPOINT);
     return true;
 }
 
@@ -642,7 +660,7 @@ bool FlightBoard::ConfigureGimbal() {
     gimbal.stab_yaw = 0; //don't stabilize
     mavlink_msg_mount_configure_encode(m_system_id, m_flightboard_id, &msg, &gimbal);
    
-    m_link->WriteMessage(&msg);
+    m_tx->Send(&msg, MAV_PRIORITY_COMMAND);
     return true;
 }
 
@@ -693,26 +711,19 @@ void FlightBoard::Stop() {
 
 /**
  * Registers an event handler, which will be called when a message with
- * the given message id is received. The current implementation will only allow
- * up to one function to respond to a specific message at any one time. If a
- * callback function already exists for the given msgid, it will be replaced.
- * A more versatile implementation would maintain some sort of list per msgid
- * to allow for more than one function to be called at any one time. Or, if
- * more than one function really must be called, then a callback function that
- * then itself delegates to these functions can be used instead.
+ * the given message id is received. Any number of handlers may be
+ * registered for the same message.
+ * Inline handlers are called on the input thread, which they hold up, so
+ * they must be quick. Anything slow (e.g. taking locks that are held for a
+ * while, or formatting strings) should be queued instead.
  *  
  * @param [in] msgid The message id to respond to.
  * @param [in] handler The event handler to call.
- * @return -1 on error, or the unique handler id. At present this is just equal
- *         to msgid. 
- */
-int FlightBoard::RegisterHandler(int msgid, EventHandler handler) {
-    if (msgid < 0 || msgid > 255) {
-        return -1;
-    } else {
-        m_handler_table[msgid] = handler;
-        return msgid;
-    }
+ * @param [in] mode How the handler is called.
+ * @return -1 on error, or the unique handler id.
+ */
+int FlightBoard::RegisterHandler(int msgid, EventHandler handler, DeliveryMode mode) {
+    return m_bus.Subscribe(msgid, handler, mode);
 }
 
 /**
@@ -720,7 +731,50 @@ int FlightBoard::RegisterHandler(int msgid, EventHandler handler) {
  * @param [in] handlerid The unique handler id as returned from RegisterHandler.
  */
 void FlightBoard::DeregisterHandler(int handlerid) {
-    if (handlerid >= 0 && handlerid <= 255) {
-        m_handler_table[handlerid] = nullptr;
-    }
+    m_bus.Unsubscribe(handlerid);
+}
+
+/**
+ * Retrieves the delivery statistics for a received message.
+ * @param [in] msgid The message id.
+ * @param [out] stats The location to store the statistics.
+ */
+void FlightBoard::GetMessageStats(int msgid, MessageBusStats *stats) {
+    m_bus.GetStats(msgid, stats);
+}
+
+/**
+ * Requests a telemetry message at (at least) the given rate. Telemetry is
+ * only sent by the autopilot if it's been requested.
+ * @param [in] msgid The message id.
+ * @param [in] rate The rate, in Hz.
+ * @return The request id (to release it), or -1 on error.
+ */
+int FlightBoard::RequestTelemetry(int msgid, double rate) {
+    return m_telemetry->Request(msgid, rate);
+}
+
+/**
+ * Releases a telemetry request.
+ * @param [in] id The request id, as returned from RequestTelemetry.
+ */
+void FlightBoard::ReleaseTelemetry(int id) {
+    m_telemetry->Release(id);
+}
+
+/**
+ * Retrieves the requested and achieved rates of a telemetry message.
+ * @param [in] msgid The message id.
+ * @param [out] rate The location to store the rates.
+ */
+void FlightBoard::GetTelemetryRate(int msgid, TelemetryRate *rate) {
+    m_telemetry->GetRate(msgid, rate);
+}
+
+/**
+ * Queues a message to be sent to the flight board, as a command.
+ * @param [in] msg The message to send.
+ */
+void FlightBoard::SendMessage(mavlink_message_t *msg) {
+    m_tx->Send(msg, MAV_PRIORITY_COMMAND);
 }
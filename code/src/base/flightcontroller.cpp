@@ -28,13 +28,14 @@ const int FlightController::SLEEP_PERIOD;
  * @param b The buzzer.
  * @param required Indicated if this module is required.
  * @param tries The number of tries to make.
+ * @param args Any further constructor arguments (after the options).
  */
-template <typename Item>
-void InitialiseItem(const char *what, Item* &pt, Options *opts, Buzzer *b, bool required, int tries = -1) {
+template <typename Item, typename... Args>
+void InitialiseItem(const char *what, Item* &pt, Options *opts, Buzzer *b, bool required, int tries = -1, Args... args) {
     pt = nullptr;
     for (int i = 0; !pt && (tries < 0 || i < tries); i++) {
         try {
-            pt = new Item(opts);
+            pt = new Item(opts, args...);
         } catch (const std::invalid_argument &e) {
             if (i+1 < tries) {
                 Log(LOG_WARNING, "Failed to initialise %s (%s); retrying in 1 second...", what, e.what());
@@ -71,13 +72,14 @@ FlightController::FlightController(Options *opts)
 , m_state{STATE_STOPPED}
 , m_task_id{TASK_NONE}
 , m_hud{}
+, m_latest_hud()
 , m_fb_status_counter(0)
 {
     //GPSGPSD *gps;
     m_buzzer = new Buzzer();
     
     InitialiseItem("flight board", m_fb, opts, m_buzzer, true, 3);
-    InitialiseItem("LIDAR", m_lidar, opts, m_buzzer, false, 1);
+    InitialiseItem("LIDAR", m_lidar, opts, m_buzzer, false, 1, m_fb->GetReactor());
     //InitialiseItem("GPS", gps, opts, m_buzzer, true, 3);
     //m_gps = gps;
     m_imu = m_fb->GetIMUInstance();    
@@ -85,17 +87,21 @@ FlightController::FlightController(Options *opts)
     InitialiseItem("Camera", m_camera, opts, m_buzzer, false, 1);
     if (m_camera) {
         m_camera->SetMode(CameraStream::MODE_CONNECTED_COMPONENTS);
+        m_camera->SetPoseSource(
+            std::bind(&FlightController::SampleCameraPose, this, _1));
     }
     
-    //Register the HUD parser.
-    m_fb->RegisterHandler(MAVLINK_MSG_ID_VFR_HUD,
-        std::bind(&FlightController::HUDParser, this, _1));
-    m_fb->RegisterHandler(MAVLINK_MSG_ID_SYSTEM_TIME,
-        std::bind(&FlightController::HUDParser, this, _1));
-    m_fb->RegisterHandler(MAVLINK_MSG_ID_STATUSTEXT,
-        std::bind(&FlightController::HUDParser, this, _1));
-    m_fb->RegisterHandler(MAVLINK_MSG_ID_SYS_STATUS,
-        std::bind(&FlightController::HUDParser, this, _1));
+    //Register the HUD parser. It takes the control lock, so it's queued.
+    const int hud_messages[] = {MAVLINK_MSG_ID_VFR_HUD,
+        MAVLINK_MSG_ID_SYSTEM_TIME, MAVLINK_MSG_ID_STATUSTEXT,
+        MAVLINK_MSG_ID_SYS_STATUS};
+    for (int i = 0; i < 4; i++) {
+        m_hud_handlers[i] = m_fb->RegisterHandler(hud_messages[i],
+            std::bind(&FlightController::HUDParser, this, _1), DELIVER_QUEUED);
+    }
+    m_fb->RequestTelemetry(MAVLINK_MSG_ID_VFR_HUD, 1);
+    m_fb->RequestTelemetry(MAVLINK_MSG_ID_SYSTEM_TIME, 1);
+    m_fb->RequestTelemetry(MAVLINK_MSG_ID_SYS_STATUS, 1);
 
     Log(LOG_INFO, "Initialised components!"); 
     m_buzzer->PlayWait(200, 200, 100);
@@ -117,12 +123,26 @@ FlightController::~FlightController() {
         Stop();
         m_task_thread.wait();
     }
+    //The HUD parser uses the LIDAR; make sure it's done.
+    for (int i = 0; i < 4; i++) {
+        m_fb->DeregisterHandler(m_hud_handlers[i]);
+    }
     delete m_camera;
+    delete m_lidar; //Polled by the flight board's reactor
     delete m_fb;
     //delete m_imu; //Part of the FlightBoard now
     //delete m_gps; //Part of the FlightBoard now
     delete m_buzzer;
-    delete m_lidar;
+}
+
+/**
+ * Samples the gimbal and copter orientation, for stamping camera frames.
+ * Called from the camera capture thread.
+ * @param [out] pose Location to store the pose.
+ */
+void FlightController::SampleCameraPose(CapturePose *pose) {
+    m_fb->GetGimbalPose(&pose->gimbal);
+    m_imu->GetLatest(&pose->imu);
 }
 
 /**
@@ -151,11 +171,12 @@ void FlightController::HUDParser(const mavlink_message_t *msg) {
                 m_hud.lidar = m_lidar->GetLatest() / 100.0f;
             }
             m_hud.pos = Coord3D{d.fix.lat, d.fix.lon, d.fix.alt-d.fix.groundalt};
-            m_hud.status1 = ss.str();
+            snprintf(m_hud.status1, sizeof(m_hud.status1), "%s", ss.str().c_str());
             if (m_fb_status_counter < 14 && m_fb_status_text.size() > 0) {
-                m_hud.status2 = m_fb_status_text;
+                snprintf(m_hud.status2, sizeof(m_hud.status2), "%s",
+                    m_fb_status_text.c_str());
             } else {
-                m_hud.status2.clear();
+                m_hud.status2[0] = '\0';
             }
             m_fb->GetGimbalPose(&m_hud.gimbal);
             m_camera->SetHUDInfo(&m_hud);
@@ -188,6 +209,7 @@ void FlightController::HUDParser(const mavlink_message_t *msg) {
         m_hud.batt_remaining = status.battery_remaining;
     }
     m_fb_status_counter++;
+    m_latest_hud.Store(m_hud);
 }
 
 /**
@@ -234,6 +256,8 @@ bool FlightController::ReloadSettings(Options *opts) {
     InitialiseItem("Camera", m_camera, opts, m_buzzer, false, 1);
     if (m_camera) {
         m_camera->SetMode(CameraStream::MODE_CONNECTED_COMPONENTS);
+        m_camera->SetPoseSource(
+            std::bind(&FlightController::SampleCameraPose, this, _1));
     }
     return static_cast<bool>(m_camera);
 }
@@ -267,6 +291,16 @@ TaskIdentifier FlightController::GetCurrentTaskId() {
     return m_task_id.load(std::memory_order_relaxed);
 }
 
+/**
+ * Returns the latest heads-up display info.
+ * @param [out] i The location to store the info.
+ * @param [out] info The location to store when it was last updated (may
+ *                   be NULL).
+ */
+void FlightController::GetLatestHUD(HUDInfo *i, SampleInfo *info) {
+    m_latest_hud.Load(i, info);
+}
+
 /**
  * Perform a checked sleep which can be interrupted by the stop signal.
  * @param ms The sleep time, in milliseconds.
@@ -5,6 +5,7 @@
 
 #include "common.h"
 #include "gps_feed.h"
+#include <algorithm>
 
 using namespace picopter;
 using std::chrono::duration_cast;
@@ -14,14 +15,15 @@ using steady_clock = std::chrono::steady_clock;
 using std::this_thread::sleep_for;
 
 const int GPS::WAIT_PERIOD;
+const int GPS::NO_FIX;
 
 /**
  * Constructor. Intialises default stuff.
  */
 GPS::GPS(Options *opts)
 : m_fix_timeout(FIX_TIMEOUT_DEFAULT)
-, m_data{{NAN,NAN,NAN,NAN,NAN,NAN},{NAN,NAN,NAN,NAN,NAN,NAN}, NAN}
-, m_last_fix(999)
+, m_data{{NAN,NAN,NAN,NAN,NAN,NAN,NAN},{NAN,NAN,NAN,NAN,NAN,NAN,NAN}, NAN}
+, m_latest(m_data)
 , m_quit(false)
 {
     if (opts) {
@@ -44,10 +46,14 @@ GPS::~GPS() {
 
 /**
  * Returns the amount of time since the last GPS fix was acquired.
- * @return The time (in seconds) since the last GPS fix
+ * @return The time (in seconds) since the last GPS fix, or NO_FIX if there
+ *         has never been one.
  */
 int GPS::TimeSinceLastFix() {
-    return m_last_fix;
+    if (m_latest.Sequence() == 0) {
+        return NO_FIX;
+    }
+    return std::min<long>(duration_cast<seconds>(m_latest.Age()).count(), NO_FIX);
 }
 
 /**
@@ -55,7 +61,7 @@ int GPS::TimeSinceLastFix() {
  * @return true iff there is a GPS fix.
  */
 bool GPS::HasFix() {
-    return m_last_fix < m_fix_timeout;
+    return !m_latest.IsStale(seconds(m_fix_timeout));
 }
 
 /**
@@ -79,10 +85,11 @@ bool GPS::WaitForFix(int timeout) {
  * Returns the latest GPS fix, if any.
  * @param d A pointer to the output location. If no value is present for that
  *          parameter, then that value is filled with NaN.
+ * @param info Location to store when the fix was received (may be NULL).
+ *             Its sequence number is 0 if there has never been a fix.
  */
-void GPS::GetLatest(GPSData *d) {
-    std::lock_guard<std::mutex> lock(m_worker_mutex);
-    *d = m_data;
+void GPS::GetLatest(GPSData *d, SampleInfo *info) {
+    m_latest.Load(d, info);
 }
 
 /**
@@ -90,6 +97,7 @@ void GPS::GetLatest(GPSData *d) {
  * @return The current relative altitude or NaN if currently unavailable.
  */
 double GPS::GetLatestRelAlt() {
-    std::lock_guard<std::mutex> lock(m_worker_mutex);
-    return m_data.fix.alt - m_data.fix.groundalt;
-}
\ No newline at end of file
+    GPSData d;
+    m_latest.Load(&d);
+    return d.fix.alt - d.fix.groundalt;
+}
\ No newline at end of file
@@ -58,15 +58,13 @@ GPSGPSD::~GPSGPSD() {
  * Main worker thread. Polls gpsd for new GPS data and updates as necessary.
  */
 void GPSGPSD::GPSLoop() {
-    auto last_fix = steady_clock::now() - seconds(m_fix_timeout);
     bool read_fail = false;
     
     Log(LOG_INFO, "GPS Started!");
     while (!m_quit) {
-        m_last_fix = duration_cast<seconds>(steady_clock::now() - last_fix).count();
         if (m_had_fix && !HasFix()) {
             Log(LOG_WARNING, "Lost the GPS fix. Last fix: %d seconds ago.",
-                m_last_fix.load());
+                TimeSinceLastFix());
             m_log.Write(": Lost fix");
             m_had_fix = false;
         }
@@ -80,7 +78,6 @@ void GPSGPSD::GPSLoop() {
                 }
                 sleep_for(milliseconds(200));
             } else if ((data->set & LATLON_SET) && (data->set & SPEED_SET)) {
-                std::unique_lock<std::mutex> lock(m_worker_mutex);
                 GPSData &d = m_data;
                 //GPSData d2 = d;
                 d.fix.lat = data->fix.latitude;
@@ -114,13 +111,11 @@ void GPSGPSD::GPSLoop() {
                 if (data->set & TIME_SET) {
                     d.timestamp = data->fix.time;
                 }
-                lock.unlock();
+                m_latest.Store(d);
                 
                 m_log.Write(": (%.6f +/- %.1fm, %.6f +/- %.1fm) [%.2f +/- %.2f at %.2f +/- %.2f]",
                     d.fix.lat, d.err.lat, d.fix.lon, d.err.lon,
                     d.fix.speed, d.err.speed, d.fix.heading, d.err.heading);
-                
-                last_fix = steady_clock::now();
                 m_had_fix = true;
                 read_fail = false;
             }
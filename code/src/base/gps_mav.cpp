@@ -25,10 +25,18 @@ GPSMAV::GPSMAV(FlightBoard *fb, Options *opts)
 , m_had_fix(false)
 , m_log("gps_mav")
 {
+    int rate = RATE_DEFAULT;
+    if (opts) {
+        opts->SetFamily("GPS");
+        rate = opts->GetInt("RATE", RATE_DEFAULT);
+    }
+    
     fb->RegisterHandler(MAVLINK_MSG_ID_GLOBAL_POSITION_INT,
         std::bind(&GPSMAV::GPSInput, this, _1));
     fb->RegisterHandler(MAVLINK_MSG_ID_GPS_RAW_INT,
         std::bind(&GPSMAV::GPSInput, this, _1));
+    fb->RequestTelemetry(MAVLINK_MSG_ID_GLOBAL_POSITION_INT, rate);
+    fb->RequestTelemetry(MAVLINK_MSG_ID_GPS_RAW_INT, rate);
     Log(LOG_INFO, "GPS Started!");
 }
 
@@ -47,13 +55,9 @@ GPSMAV::~GPSMAV() {
  * Main worker callback.
  */
 void GPSMAV::GPSInput(const mavlink_message_t *msg) {
-    //Fixme...
-    static auto last_fix = steady_clock::now() - seconds(m_fix_timeout);
-    
-    m_last_fix = duration_cast<seconds>(steady_clock::now() - last_fix).count();
     if (m_had_fix && !HasFix()) {
         Log(LOG_WARNING, "Lost the GPS fix. Last fix: %d seconds ago.",
-            m_last_fix.load());
+            TimeSinceLastFix());
         m_log.Write(": Lost fix");
         m_had_fix = false;
     }
@@ -61,7 +65,6 @@ void GPSMAV::GPSInput(const mavlink_message_t *msg) {
     if (msg->msgid == MAVLINK_MSG_ID_GLOBAL_POSITION_INT) {
         mavlink_global_position_int_t pos;
         mavlink_msg_global_position_int_decode(msg, &pos);
-        std::unique_lock<std::mutex> lock(m_worker_mutex);
         
         GPSData &d = m_data;
         d.fix.lat = pos.lat*1e-7;
@@ -71,12 +74,10 @@ void GPSMAV::GPSInput(const mavlink_message_t *msg) {
         if (pos.hdg != UINT16_MAX) {
             d.fix.heading = pos.hdg*1e-2;
         }
-        lock.unlock();
+        m_latest.Store(d);
 
         m_log.Write(": (%.7f, %.7f, %.3f) [%.3f]",
             d.fix.lat, d.fix.lon, pos.relative_alt*1e-3, d.fix.heading);
-        
-        last_fix = steady_clock::now();
         m_had_fix = true;
     }
 }
\ No newline at end of file
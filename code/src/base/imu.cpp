@@ -18,10 +18,17 @@ using namespace std::placeholders;
  * @throws std::invalid_argument if IMU intialisation fails (e.g. disconnected)
  */
 IMU::IMU(FlightBoard *fb, Options *opts)
-: m_data{NAN,NAN,NAN}
+: m_data(IMUData{NAN,NAN,NAN})
 { 
+    int rate = RATE_DEFAULT;
+    if (opts) {
+        opts->SetFamily("IMU");
+        rate = opts->GetInt("RATE", RATE_DEFAULT);
+    }
+    
     fb->RegisterHandler(MAVLINK_MSG_ID_ATTITUDE,
         std::bind(&IMU::ParseInput, this, _1));
+    fb->RequestTelemetry(MAVLINK_MSG_ID_ATTITUDE, rate);
 }
 
 /**
@@ -38,25 +45,30 @@ IMU::~IMU() {
 /**
  * Get the latest IMU data, if available.
  * Unavailable values are indicated with NaN.
+ * @param [out] d The location to store the data.
+ * @param [out] info The location to store when the data was received
+ *                   (may be NULL).
  */
-void IMU::GetLatest(IMUData *d) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    *d = m_data;
+void IMU::GetLatest(IMUData *d, SampleInfo *info) {
+    m_data.Load(d, info);
 }
 
 double IMU::GetLatestRoll() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return m_data.roll;
+    IMUData d;
+    m_data.Load(&d);
+    return d.roll;
 }
 
 double IMU::GetLatestPitch() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return m_data.pitch;
+    IMUData d;
+    m_data.Load(&d);
+    return d.pitch;
 }
 
 double IMU::GetLatestYaw() {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    return m_data.yaw;
+    IMUData d;
+    m_data.Load(&d);
+    return d.yaw;
 }
 
 /**
@@ -66,10 +78,5 @@ double IMU::GetLatestYaw() {
 void IMU::ParseInput(const mavlink_message_t *msg) {
     mavlink_attitude_t att;
     mavlink_msg_attitude_decode(msg, &att);
-    {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_data.roll = RAD2DEG(att.roll);
-        m_data.pitch = RAD2DEG(att.pitch);
-        m_data.yaw = RAD2DEG(att.yaw);
-    }
+    m_data.Store(IMUData{RAD2DEG(att.roll), RAD2DEG(att.pitch), RAD2DEG(att.yaw)});
 }
\ No newline at end of file
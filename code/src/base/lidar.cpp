@@ -15,28 +15,44 @@
 #define    READ_HIGH         0x0f // Register to get the high byte.
 #define    READ_LOW          0x10 // Register to get the low byte.
 using picopter::Lidar;
-using std::this_thread::sleep_for;
-using std::chrono::milliseconds;
+using picopter::Reactor;
 
 /**
- * Initiates the connection to the LIDAR sensor.
+ * Initiates the connection to the LIDAR sensor, polling it on the given
+ * event loop.
  * @param [in] opts A pointer to options, if any (NULL for defaults)
+ * @param [in] reactor The event loop to poll on (NULL to use our own).
  * @throws std::invalid_argument If connection fails to the LIDAR.
  */
-Lidar::Lidar(Options *opts)
+Lidar::Lidar(Options *opts, Reactor *reactor)
 : m_fd(-1)
 , m_distance(-1)
 , m_log("lidar")
-, m_stop{false}
+, m_own_reactor(nullptr)
+, m_reactor(reactor)
+, m_timer(-1)
+, m_measuring(false)
+, m_counter(0)
 {
     m_fd = wiringPiI2CSetup(LIDARLITE_ADDRESS);
     if (m_fd == -1) {
         throw std::invalid_argument("Cannot connect to LIDAR-Lite.");
     }
-    m_worker = std::thread(&Lidar::Worker, this);
+    if (!m_reactor) {
+        m_reactor = m_own_reactor = new Reactor();
+        m_reactor->Start();
+    }
+    m_timer = m_reactor->AddTimer(50, std::bind(&Lidar::Poll, this)); //20Hz
     Log(LOG_INFO, "LIDAR intialised!");
 }
 
+/**
+ * Initiates the connection to the LIDAR sensor.
+ * @param [in] opts A pointer to options, if any (NULL for defaults)
+ * @throws std::invalid_argument If connection fails to the LIDAR.
+ */
+Lidar::Lidar(Options *opts) : Lidar(opts, NULL) {}
+
 /**
  * Constructor. Shortcut to Lidar(NULL)
  */
@@ -46,8 +62,8 @@ Lidar::Lidar() : Lidar(NULL) {}
  * Destructor.
  */
 Lidar::~Lidar() {
-    m_stop = true;
-    m_worker.join();
+    m_reactor->Remove(m_timer);
+    delete m_own_reactor;
 }
 
 /**
@@ -58,15 +74,13 @@ int Lidar::GetLatest() {
     return m_distance;
 }
 
-void Lidar::Worker() {
-    int counter = 0;
-    while (!m_stop) {
-        while (wiringPiI2CWriteReg8(m_fd, 
-            MEASURE_REGISTER, MEASURE_VALUE) < 0 && !m_stop) {
-            sleep_for(milliseconds(100));
-            //Log(LOG_DEBUG, "WAITING FOR LIDARLITE");
-        }
-
+/**
+ * Reads the result of the last measurement (if any) and starts the next
+ * one. Called by the reactor every 50ms, which is ample time for the
+ * sensor to finish measuring, so this never waits on it.
+ */
+void Lidar::Poll() {
+    if (m_measuring) {
         int high = wiringPiI2CReadReg8(m_fd, READ_HIGH);
         int low = wiringPiI2CReadReg8(m_fd, READ_LOW);
         if (high < 0 || low < 0) {
@@ -74,12 +88,14 @@ void Lidar::Worker() {
         } else {
             low |= (high<<8);
             m_distance = low;
-            if ((++counter % 20) == 0) { //Restrict log to ~1Hz.
+            if ((++m_counter % 20) == 0) { //Restrict log to ~1Hz.
                 m_log.Write(": %d", low);
             }
             //Log(LOG_DEBUG, "DIST: %d", low));
         }
-        
-        sleep_for(milliseconds(50)); //20Hz update speed
     }
+    
+    //If the sensor is busy, try again next time.
+    m_measuring = wiringPiI2CWriteReg8(m_fd,
+        MEASURE_REGISTER, MEASURE_VALUE) >= 0;
 }
@@ -0,0 +1,120 @@
+/**
+ * @file mavcommslink.cpp
+ * @brief Buffered message reading common to all MAVLink connections.
+ */
+
+#include "common.h"
+#include "mavcommslink.h"
+
+using namespace picopter;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+/**
+ * Constructor.
+ */
+MAVCommsLink::MAVCommsLink()
+: m_rx_start(0)
+, m_rx_end(0)
+, m_stats{}
+, m_sample_start(steady_clock::now())
+, m_sample_bytes(0)
+, m_sample_messages(0)
+{
+}
+
+/**
+ * Destructor.
+ */
+MAVCommsLink::~MAVCommsLink() {
+}
+
+/**
+ * Reads a message. If no complete message is buffered, this waits for
+ * more data (at most one read system call).
+ * @param [out] ret The location to store the read message, if any.
+ * @return true iff a message was read.
+ */
+bool MAVCommsLink::ReadMessage(mavlink_message_t *ret) {
+    return ReadMessages(ret, 1) == 1;
+}
+
+/**
+ * Reads a batch of messages. All complete messages that are buffered (up
+ * to the maximum) are returned. If there are none, this waits for more
+ * data (at most one read system call) and parses that.
+ * @param [out] ret The location to store the read messages.
+ * @param [in] max The maximum number of messages to read.
+ * @param [in] timeout How long to wait for data, in ms (0 to not wait,
+ *                     negative for the link's default).
+ * @return The number of messages read.
+ */
+size_t MAVCommsLink::ReadMessages(mavlink_message_t *ret, size_t max, int timeout) {
+    unsigned long crc_drops = 0, bytes = 0, total_drops = 0;
+    size_t count = Parse(ret, max, &crc_drops);
+
+    if (count == 0) {
+        bytes = ReadBytes(m_rx_buffer, sizeof(m_rx_buffer), timeout);
+        m_rx_start = 0;
+        m_rx_end = bytes;
+        count = Parse(ret, max, &crc_drops);
+    }
+
+    if (bytes > 0 || count > 0) {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        m_stats.bytes += bytes;
+        m_stats.reads += bytes > 0;
+        m_stats.messages += count;
+        m_stats.crc_drops += crc_drops;
+        total_drops = m_stats.crc_drops;
+
+        auto now = steady_clock::now();
+        int elapsed = duration_cast<milliseconds>(now - m_sample_start).count();
+        if (elapsed >= 1000) {
+            m_stats.bytes_per_second =
+                ((m_stats.bytes - m_sample_bytes) * 1000.0) / elapsed;
+            m_stats.messages_per_second =
+                ((m_stats.messages - m_sample_messages) * 1000.0) / elapsed;
+            m_sample_bytes = m_stats.bytes;
+            m_sample_messages = m_stats.messages;
+            m_sample_start = now;
+        }
+    }
+    if (crc_drops > 0) {
+        Log(LOG_DEBUG, "Dropped packets (CRC fail), count: %lu", total_drops);
+    }
+    return count;
+}
+
+/**
+ * Retrieves the link statistics.
+ * @param [out] stats The location to store the statistics.
+ */
+void MAVCommsLink::GetStats(MAVCommsStats *stats) {
+    std::lock_guard<std::mutex> lock(m_stats_mutex);
+    *stats = m_stats;
+}
+
+/**
+ * Parses buffered data until the buffer is empty or enough messages are
+ * read. A partially received message is carried over to the next read.
+ * @param [out] ret The location to store the parsed messages.
+ * @param [in] max The maximum number of messages to parse.
+ * @param [in,out] crc_drops Incremented for each message that failed the CRC.
+ * @return The number of messages parsed.
+ */
+size_t MAVCommsLink::Parse(mavlink_message_t *ret, size_t max, unsigned long *crc_drops) {
+    mavlink_status_t status;
+    size_t count = 0;
+
+    while (count < max && m_rx_start < m_rx_end) {
+        if (mavlink_parse_char(MAVLINK_COMM_0, m_rx_buffer[m_rx_start++],
+            &ret[count], &status)) {
+            count++;
+        } else if (status.msg_received == MAVLINK_FRAMING_BAD_CRC) {
+            (*crc_drops)++;
+        }
+    }
+    return count;
+}
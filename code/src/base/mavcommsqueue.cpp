@@ -0,0 +1,199 @@
+/**
+ * @file mavcommsqueue.cpp
+ * @brief Queues MAVLink messages to be sent by a dedicated thread.
+ */
+
+#include "common.h"
+#include "mavcommsqueue.h"
+
+using namespace picopter;
+
+/**
+ * Constructor. Starts the transmit thread.
+ * @param [in] link The link to send messages on. Must outlive the queue.
+ */
+MAVCommsQueue::MAVCommsQueue(MAVCommsLink *link)
+: m_link(link)
+, m_next_id(0)
+, m_stats{}
+, m_stop(false)
+{
+    m_thread = std::thread(&MAVCommsQueue::Run, this);
+}
+
+/**
+ * Destructor. Sends anything still queued, then stops the transmit thread.
+ */
+MAVCommsQueue::~MAVCommsQueue() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_queued.notify_all();
+    m_thread.join();
+}
+
+/**
+ * Queues a message to be sent.
+ * @param [in] msg The message.
+ * @param [in] priority The message priority. Setpoints replace a queued
+ *                      message of the same kind (if any).
+ * @param [in] wait Wait for the message to be sent before returning.
+ * @return true iff the message was queued (and sent, if waiting). A
+ *         waited-on message that is dropped or discarded unsent gives false.
+ */
+bool MAVCommsQueue::Send(const mavlink_message_t *msg, MAVPriority priority, bool wait) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::deque<Entry> &queue = m_queues[priority];
+    uint32_t kind = Kind(msg);
+    uint64_t id = 0;
+    bool queued = false;
+
+    if (m_stop) {
+        return false;
+    }
+
+    //A safety message overrides any setpoint of the same kind still queued;
+    //otherwise the stale setpoint would be sent after it and undo it.
+    if (priority == MAV_PRIORITY_SAFETY) {
+        std::deque<Entry> &setpoints = m_queues[MAV_PRIORITY_SETPOINT];
+        for (auto it = setpoints.begin(); it != setpoints.end();) {
+            if (it->kind == kind) {
+                Discard(*it);
+                it = setpoints.erase(it);
+                m_stats.coalesced++;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    //Overwrite a superseded setpoint in place; it keeps its turn.
+    if (priority == MAV_PRIORITY_SETPOINT) {
+        for (Entry &entry : queue) {
+            if (entry.kind == kind) {
+                entry.msg = *msg;
+                id = entry.id;
+                queued = true;
+                m_stats.coalesced++;
+                break;
+            }
+        }
+    }
+
+    if (!queued) {
+        //Make room, but never at the expense of a more important message.
+        if (m_pending.size() >= MAV_TX_QUEUE_SIZE && !Drop(priority) &&
+            priority >= MAV_PRIORITY_SETPOINT) {
+            m_stats.dropped++;
+            return false;
+        }
+        id = m_next_id++;
+        queue.push_back(Entry{*msg, kind, id});
+        m_pending.insert(id);
+        m_queued.notify_one();
+    }
+
+    if (wait) {
+        m_waiting.insert(id);
+        m_sent.wait(lock, [this, id] {
+            return m_pending.count(id) == 0;
+        });
+        m_waiting.erase(m_waiting.find(id));
+        bool sent = m_discarded.count(id) == 0;
+        if (m_waiting.count(id) == 0) {
+            m_discarded.erase(id);
+        }
+        return sent;
+    }
+    return true;
+}
+
+/**
+ * Retrieves the queue statistics.
+ * @param [out] stats The location to store the statistics.
+ */
+void MAVCommsQueue::GetStats(MAVCommsQueueStats *stats) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    *stats = m_stats;
+    stats->queued = m_pending.size();
+}
+
+/**
+ * The transmit thread. Sends the highest priority message until told to
+ * stop and the queues are empty.
+ */
+void MAVCommsQueue::Run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        m_queued.wait(lock, [this] {
+            return m_stop || !m_pending.empty();
+        });
+        if (m_pending.empty()) {
+            break;
+        }
+
+        for (std::deque<Entry> &queue : m_queues) {
+            if (!queue.empty()) {
+                Entry entry = queue.front();
+                queue.pop_front();
+
+                //Don't hold anyone up while the link is busy.
+                lock.unlock();
+                m_link->WriteMessage(&entry.msg);
+                lock.lock();
+
+                m_pending.erase(entry.id);
+                m_stats.sent++;
+                m_sent.notify_all();
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Drops the oldest message of the lowest droppable priority, if any.
+ * @param [in] priority Don't drop messages of a higher priority than this.
+ * @return true iff a message was dropped.
+ */
+bool MAVCommsQueue::Drop(MAVPriority priority) {
+    int floor = std::max<int>(priority, MAV_PRIORITY_SETPOINT);
+    for (int p = MAV_PRIORITY_COUNT - 1; p >= floor; p--) {
+        if (!m_queues[p].empty()) {
+            Discard(m_queues[p].front());
+            m_queues[p].pop_front();
+            m_stats.dropped++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Forgets a message that won't be sent, so that anyone waiting on it is
+ * woken (and told it wasn't sent). The caller removes it from its queue.
+ * @param [in] entry The message.
+ */
+void MAVCommsQueue::Discard(const Entry &entry) {
+    m_pending.erase(entry.id);
+    if (m_waiting.count(entry.id)) {
+        m_discarded.insert(entry.id);
+    }
+    m_sent.notify_all();
+}
+
+/**
+ * Determines what kind of message this is. Messages of the same kind
+ * supersede each other.
+ * @param [in] msg The message.
+ * @return The kind (the message id, and the command for COMMAND_LONG).
+ */
+uint32_t MAVCommsQueue::Kind(const mavlink_message_t *msg) {
+    uint32_t kind = msg->msgid;
+    if (msg->msgid == MAVLINK_MSG_ID_COMMAND_LONG) {
+        kind |= static_cast<uint32_t>(mavlink_msg_command_long_get_command(msg)) << 8;
+    }
+    return kind;
+}
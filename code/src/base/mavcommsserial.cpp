@@ -9,6 +9,7 @@
 #include "mavcommslink.h"
 
 #include <unistd.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <termios.h>
 
@@ -40,7 +41,6 @@ MAVCommsSerial::MAVCommsSerial(const char *device, int baudrate)
 : m_device(device)
 , m_baudrate(baudrate)
 , m_fd(-1)
-, m_packet_drop_count(0)
 {
     struct termios config;
 
@@ -117,35 +117,36 @@ MAVCommsSerial::~MAVCommsSerial() {
 }
 
 /**
- * Potentially reads a message from the serial stream.
- * @param [in] ret The location to store the read message, if any.
- * @return true iff a message was read.
+ * Retrieves the serial port descriptor.
+ * @return The descriptor.
  */
-bool MAVCommsSerial::ReadMessage(mavlink_message_t *ret) {
-    std::lock_guard<std::mutex> lock(m_io_mutex);
-    struct timeval timeout = {3,0}; //3 second timeout
-    mavlink_status_t status;
-    bool received;
-    uint8_t cp;
-    fd_set read_set;
-
-    FD_ZERO(&read_set);
-    FD_SET(m_fd, &read_set);
+int MAVCommsSerial::GetDescriptor() {
+    return m_fd;
+}
 
-    if (select(m_fd+1, &read_set, NULL, NULL, &timeout) <= 0) {
-        Log(LOG_WARNING, "Select error ocurred.");
-        return false;
-    } else if (read(m_fd, &cp, 1) < 1) {
+/**
+ * Waits for data from the serial port and reads as much as is available.
+ * @param [out] buffer The buffer to read into.
+ * @param [in] length The size of the buffer.
+ * @param [in] timeout How long to wait, in ms (0 to not wait, negative for
+ *                     the default of 3 seconds).
+ * @return The number of bytes read (0 on timeout or error).
+ */
+size_t MAVCommsSerial::ReadBytes(uint8_t *buffer, size_t length, int timeout) {
+    struct pollfd fd = {m_fd, POLLIN, 0};
+    ssize_t ret;
+
+    //Only this thread reads, so there's no need to hold up writers.
+    if (poll(&fd, 1, timeout < 0 ? 3000 : timeout) <= 0) {
+        if (timeout != 0) {
+            Log(LOG_WARNING, "Select error ocurred.");
+        }
+        return 0;
+    } else if ((ret = read(m_fd, buffer, length)) < 1) {
         Log(LOG_DEBUG, "Could not read from stream: %s", strerror(errno));
-        return false;
-    }
-
-    received = mavlink_parse_char(MAVLINK_COMM_0, cp, ret, &status);
-    if (status.msg_received == MAVLINK_FRAMING_BAD_CRC) {
-        m_packet_drop_count++;
-        Log(LOG_DEBUG, "Dropped packets (CRC fail), count: %d", m_packet_drop_count);
+        return 0;
     }
-    return received;
+    return static_cast<size_t>(ret);
 }
 
 /**
@@ -7,6 +7,7 @@
 #include "mavcommslink.h"
 
 #include <unistd.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 
@@ -24,7 +25,6 @@ MAVCommsTCP::MAVCommsTCP(const char *address, uint16_t port)
 : m_address(address)
 , m_port(port)
 , m_fd(-1)
-, m_packet_drop_count(0)
 {
     struct sockaddr_in addr = {0};
 
@@ -52,34 +52,35 @@ MAVCommsTCP::~MAVCommsTCP() {
 }
 
 /**
- * Reads a MAVLink message.
- * @param [in] ret The location to store the read message, if any.
- * @return true iff a message was read.
+ * Retrieves the socket descriptor.
+ * @return The descriptor.
  */
-bool MAVCommsTCP::ReadMessage(mavlink_message_t *ret) {
-    struct timeval timeout = {5,0}; //5 second timeout
-    mavlink_status_t status;
-    bool received;
-    uint8_t cp;
-    fd_set read_set;
-    
-    FD_ZERO(&read_set);
-    FD_SET(m_fd, &read_set);
-    
-    if (select(m_fd+1, &read_set, NULL, NULL, &timeout) <= 0) {
-        Log(LOG_WARNING, "Select error ocurred.");
-        return false;
-    } else if (read(m_fd, &cp, 1) < 1) {
-        Log(LOG_DEBUG, "Could not read from stream: %s", strerror(errno));
-        return false;
-    }
+int MAVCommsTCP::GetDescriptor() {
+    return m_fd;
+}
 
-    received = mavlink_parse_char(MAVLINK_COMM_0, cp, ret, &status);
-    if (status.msg_received == MAVLINK_FRAMING_BAD_CRC) {
-        m_packet_drop_count++;
-        Log(LOG_DEBUG, "Dropped packets (CRC fail), count: %d", m_packet_drop_count);
+/**
+ * Waits for data from the socket and reads as much as is available.
+ * @param [out] buffer The buffer to read into.
+ * @param [in] length The size of the buffer.
+ * @param [in] timeout How long to wait, in ms (0 to not wait, negative for
+ *                     the default of 5 seconds).
+ * @return The number of bytes read (0 on timeout or error).
+ */
+size_t MAVCommsTCP::ReadBytes(uint8_t *buffer, size_t length, int timeout) {
+    struct pollfd fd = {m_fd, POLLIN, 0};
+    ssize_t ret;
+
+    if (poll(&fd, 1, timeout < 0 ? 5000 : timeout) <= 0) {
+        if (timeout != 0) {
+            Log(LOG_WARNING, "Select error ocurred.");
+        }
+        return 0;
+    } else if ((ret = read(m_fd, buffer, length)) < 1) {
+        Log(LOG_DEBUG, "Could not read from stream: %s", strerror(errno));
+        return 0;
     }
-    return received;
+    return static_cast<size_t>(ret);
 }
 
 /**
@@ -0,0 +1,229 @@
+/**
+ * @file message_bus.cpp
+ * @brief Publish/subscribe dispatch of received MAVLink messages.
+ */
+
+#include "common.h"
+#include "message_bus.h"
+#include <algorithm>
+
+using namespace picopter;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+/** The subscribers whose handlers this thread is in the middle of calling **/
+static thread_local std::vector<const void*> t_delivering;
+
+/**
+ * Constructor. Starts the worker thread for queued deliveries.
+ */
+MessageBus::MessageBus()
+: m_next_id(0)
+, m_counters{}
+, m_stop(false)
+{
+    m_worker = std::thread(&MessageBus::Worker, this);
+}
+
+/**
+ * Destructor. Queued deliveries that haven't been made are discarded.
+ */
+MessageBus::~MessageBus() {
+    Stop();
+}
+
+/**
+ * Subscribes to a message.
+ * @param [in] msgid The message id.
+ * @param [in] handler The handler to call with each message.
+ * @param [in] mode How to deliver messages to the handler.
+ * @return The subscription id, or -1 if the message id is invalid.
+ */
+int MessageBus::Subscribe(int msgid, Handler handler, DeliveryMode mode) {
+    if (msgid < 0 || msgid >= MESSAGE_BUS_TOPICS || !handler) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_subscribe_mutex);
+    std::shared_ptr<Subscriber> s = std::make_shared<Subscriber>();
+    s->id = m_next_id++;
+    s->msgid = msgid;
+    s->mode = mode;
+    s->handler = handler;
+    s->active = true;
+    s->calls = 0;
+
+    //Copy, update, then publish the new list.
+    std::shared_ptr<const SubscriberList> old = std::atomic_load(&m_topics[msgid]);
+    std::shared_ptr<SubscriberList> list = old ?
+        std::make_shared<SubscriberList>(*old) : std::make_shared<SubscriberList>();
+    list->push_back(s);
+    std::atomic_store(&m_topics[msgid], std::shared_ptr<const SubscriberList>(list));
+    return s->id;
+}
+
+/**
+ * Unsubscribes. The handler won't be called again, and any calls to it that
+ * are running (inline or queued) have finished by the time this returns.
+ * The exception is a call on this thread (a handler unsubscribing itself),
+ * which can only finish after this returns.
+ * @param [in] id The subscription id, as returned by Subscribe.
+ */
+void MessageBus::Unsubscribe(int id) {
+    std::shared_ptr<Subscriber> s;
+    {
+        std::lock_guard<std::mutex> lock(m_subscribe_mutex);
+        for (int msgid = 0; msgid < MESSAGE_BUS_TOPICS && !s; msgid++) {
+            std::shared_ptr<const SubscriberList> old = std::atomic_load(&m_topics[msgid]);
+            if (!old) {
+                continue;
+            }
+
+            for (size_t i = 0; i < old->size(); i++) {
+                if ((*old)[i]->id == id) {
+                    std::shared_ptr<SubscriberList> list =
+                        std::make_shared<SubscriberList>(*old);
+                    s = (*old)[i];
+                    list->erase(list->begin() + i);
+                    std::atomic_store(&m_topics[msgid],
+                        std::shared_ptr<const SubscriberList>(list));
+                    break;
+                }
+            }
+        }
+    }
+    if (!s) {
+        return;
+    }
+
+    //A publisher holding the old list either sees this, or has already
+    //counted its call, so waiting for the count covers every call.
+    s->active = false;
+    int own = std::count(t_delivering.begin(), t_delivering.end(), s.get());
+    std::unique_lock<std::mutex> lock(m_calls_mutex);
+    m_calls_cv.wait(lock, [&s, own] { return s->calls <= own; });
+}
+
+/**
+ * Publishes a message to its subscribers. Inline subscribers are called
+ * before this returns; queued subscribers are called later.
+ * @param [in] msg The message.
+ */
+void MessageBus::Publish(const mavlink_message_t *msg) {
+    int msgid = msg->msgid;
+    if (msgid < 0 || msgid >= MESSAGE_BUS_TOPICS) {
+        return;
+    }
+
+    TimePoint now = steady_clock::now();
+    m_counters[msgid].published++;
+    std::shared_ptr<const SubscriberList> list = std::atomic_load(&m_topics[msgid]);
+    if (!list) {
+        return;
+    }
+
+    bool queued = false;
+    for (const std::shared_ptr<Subscriber> &s : *list) {
+        if (s->mode == DELIVER_INLINE) {
+            Deliver(*s, msg, now);
+        } else {
+            std::lock_guard<std::mutex> lock(m_queue_mutex);
+            if (m_queue.size() >= MESSAGE_BUS_QUEUE_SIZE) {
+                m_counters[m_queue.front().subscriber->msgid].dropped++;
+                m_queue.pop_front();
+            }
+            m_queue.push_back(Delivery{s, *msg, now});
+            queued = true;
+        }
+    }
+    if (queued) {
+        m_queue_cv.notify_one();
+    }
+}
+
+/**
+ * Retrieves the delivery statistics for a message.
+ * @param [in] msgid The message id.
+ * @param [out] stats The location to store the statistics.
+ */
+void MessageBus::GetStats(int msgid, MessageBusStats *stats) {
+    *stats = MessageBusStats{};
+    if (msgid >= 0 && msgid < MESSAGE_BUS_TOPICS) {
+        Counters &c = m_counters[msgid];
+        stats->published = c.published;
+        stats->delivered = c.delivered;
+        stats->dropped = c.dropped;
+        stats->max_latency = c.latency_max / 1000.0;
+        if (stats->delivered > 0) {
+            stats->mean_latency = (c.latency_total / 1000.0) / stats->delivered;
+        }
+    }
+}
+
+/**
+ * Stops the worker thread. Queued deliveries that haven't been made are
+ * discarded, and no more will be made.
+ */
+void MessageBus::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_queue_mutex);
+        m_stop = true;
+    }
+    m_queue_cv.notify_all();
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+}
+
+/**
+ * Calls a subscriber's handler, unless it has been unsubscribed, and records
+ * the latency. The call is counted so that Unsubscribe can wait for it.
+ * @param [in] s The subscriber.
+ * @param [in] msg The message.
+ * @param [in] published When the message was published.
+ */
+void MessageBus::Deliver(Subscriber &s, const mavlink_message_t *msg, TimePoint published) {
+    s.calls++;
+    if (s.active) {
+        t_delivering.push_back(&s);
+        s.handler(msg);
+        t_delivering.pop_back();
+
+        Counters &c = m_counters[s.msgid];
+        uint64_t latency = duration_cast<microseconds>(
+            steady_clock::now() - published).count();
+        uint64_t worst = c.latency_max;
+        c.delivered++;
+        c.latency_total += latency;
+        while (latency > worst && !c.latency_max.compare_exchange_weak(worst, latency));
+    }
+    s.calls--;
+
+    //Only an unsubscription waits on the count, so only wake it then.
+    if (!s.active) {
+        std::lock_guard<std::mutex> lock(m_calls_mutex);
+        m_calls_cv.notify_all();
+    }
+}
+
+/**
+ * The worker thread. Makes the queued deliveries, in order.
+ */
+void MessageBus::Worker() {
+    std::unique_lock<std::mutex> lock(m_queue_mutex);
+    while (true) {
+        m_queue_cv.wait(lock, [this] {
+            return m_stop || !m_queue.empty();
+        });
+        if (m_stop) {
+            break;
+        }
+
+        Delivery d = m_queue.front();
+        m_queue.pop_front();
+        lock.unlock();
+        Deliver(*d.subscriber, &d.msg, d.published);
+        lock.lock();
+    }
+}
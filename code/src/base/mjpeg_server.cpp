@@ -0,0 +1,425 @@
+/**
+ * @file mjpeg_server.cpp
+ * @brief A minimal HTTP server for streaming JPEG frames (MJPEG).
+ */
+
+#include "common.h"
+#include "mjpeg_server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+using namespace picopter;
+
+/** The multipart boundary between frames **/
+#define MJPEG_BOUNDARY "picopterframe"
+/** The maximum length of a request **/
+#define MJPEG_MAX_REQUEST 4096
+
+static const char STREAM_HEADER[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Connection: close\r\n"
+    "Server: picopter\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n"
+    "Pragma: no-cache\r\n"
+    "Content-Type: multipart/x-mixed-replace;boundary=" MJPEG_BOUNDARY "\r\n"
+    "\r\n";
+
+static const char SNAPSHOT_HEADER[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Connection: close\r\n"
+    "Server: picopter\r\n"
+    "Access-Control-Allow-Origin: *\r\n"
+    "Cache-Control: no-store, no-cache, must-revalidate, max-age=0\r\n"
+    "Pragma: no-cache\r\n"
+    "Content-Type: image/jpeg\r\n"
+    "Content-Length: ";
+
+static const char NOT_FOUND[] =
+    "HTTP/1.0 404 Not Found\r\n"
+    "Connection: close\r\n"
+    "Content-Length: 0\r\n"
+    "\r\n";
+
+/**
+ * Constructor. Starts listening for clients.
+ * @param [in] port The port to listen on (0 to pick any free port).
+ * @throws std::invalid_argument on error.
+ */
+MJPEGServer::MJPEGServer(uint16_t port)
+: m_listen_fd(-1)
+, m_event_fd(-1)
+, m_port(port)
+, m_stop{false}
+, m_client_count{0}
+, m_dropped{0}
+{
+    struct sockaddr_in addr = {0};
+    socklen_t length = sizeof(addr);
+    int reuse = 1;
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    m_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listen_fd == -1) {
+        throw std::invalid_argument("Could not create socket.");
+    }
+    setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(m_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+        listen(m_listen_fd, MJPEG_MAX_CLIENTS) == -1 ||
+        getsockname(m_listen_fd, (struct sockaddr *)&addr, &length) == -1) {
+        close(m_listen_fd);
+        throw std::invalid_argument("Could not listen on port.");
+    }
+    m_port = ntohs(addr.sin_port);
+
+    m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_event_fd == -1) {
+        close(m_listen_fd);
+        throw std::invalid_argument("Could not create event.");
+    }
+
+    m_clients.reserve(MJPEG_MAX_CLIENTS);
+    m_thread = std::async(std::launch::async, &MJPEGServer::Run, this);
+}
+
+/**
+ * Destructor. Disconnects all clients and stops the server.
+ */
+MJPEGServer::~MJPEGServer() {
+    uint64_t one = 1;
+    m_stop = true;
+    if (write(m_event_fd, &one, sizeof(one)) != sizeof(one)) {
+        Log(LOG_WARNING, "Could not signal the stream server to stop.");
+    }
+    m_thread.wait();
+
+    for (Client &client : m_clients) {
+        close(client.fd);
+    }
+    close(m_listen_fd);
+    close(m_event_fd);
+}
+
+/**
+ * Retrieves the port being listened on.
+ * @return The port.
+ */
+uint16_t MJPEGServer::GetPort() {
+    return m_port;
+}
+
+/**
+ * Retrieves the number of connected clients. If there are none, there's no
+ * need to encode frames for streaming.
+ * @return The number of connected clients.
+ */
+int MJPEGServer::GetClientCount() {
+    return m_client_count;
+}
+
+/**
+ * Retrieves the number of frames clients skipped because they were slow.
+ * @return The number of dropped frames (summed over all clients).
+ */
+unsigned long MJPEGServer::GetDroppedFrames() {
+    return m_dropped;
+}
+
+/**
+ * Publishes a frame to all clients. The frame is swapped (not copied) into
+ * one of the server's buffers, and the caller gets back a buffer that is
+ * no longer in use, so that it can encode into it without allocating.
+ * @param [in,out] jpeg The JPEG encoded frame. On return, the contents are
+ *                      unspecified.
+ */
+void MJPEGServer::Publish(std::vector<uint8_t> *jpeg) {
+    uint64_t one = 1;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Buffer free;
+
+    //A buffer only referenced by this list is not held by any client.
+    for (Buffer &buffer : m_buffers) {
+        if (buffer.unique()) {
+            free = buffer;
+            break;
+        }
+    }
+    if (!free) {
+        if (m_buffers.size() >= MJPEG_BUFFERS) {
+            m_dropped++;
+            return;
+        }
+        free = std::make_shared<std::vector<uint8_t>>();
+        m_buffers.push_back(free);
+    }
+
+    free->swap(*jpeg);
+    m_latest = free;
+    lock.unlock();
+
+    if (write(m_event_fd, &one, sizeof(one)) != sizeof(one)) {
+        Log(LOG_DEBUG, "Could not signal a new frame: %s", strerror(errno));
+    }
+}
+
+/**
+ * The server thread. Waits for clients, requests and published frames,
+ * and sends frames to clients as fast as each one can take them.
+ */
+void MJPEGServer::Run() {
+    std::vector<struct pollfd> fds;
+    fds.reserve(MJPEG_MAX_CLIENTS + 2);
+
+    while (!m_stop) {
+        fds.clear();
+        fds.push_back(pollfd{m_event_fd, POLLIN, 0});
+        fds.push_back(pollfd{m_listen_fd, POLLIN, 0});
+        for (Client &client : m_clients) {
+            short events = POLLIN;
+            if (!client.head.empty() || client.frame) {
+                events |= POLLOUT;
+            }
+            fds.push_back(pollfd{client.fd, events, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), 1000) <= 0) {
+            continue;
+        }
+
+        //A new frame was published.
+        if (fds[0].revents & POLLIN) {
+            uint64_t count;
+            Buffer frame;
+            if (read(m_event_fd, &count, sizeof(count)) == sizeof(count)) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                frame = m_latest;
+            }
+            if (frame) {
+                Dispatch(frame);
+            }
+        }
+
+        //Service the clients that were polled.
+        for (size_t i = 0; i < fds.size() - 2; i++) {
+            Client &client = m_clients[i];
+            short revents = fds[i + 2].revents;
+            bool keep = !(revents & (POLLERR | POLLNVAL));
+
+            if (keep && (revents & (POLLIN | POLLHUP))) {
+                keep = ReadRequest(&client);
+            }
+            if (keep && (!client.head.empty() || client.frame)) {
+                keep = Send(&client);
+            }
+            if (!keep) {
+                close(client.fd);
+                client.fd = -1;
+            }
+        }
+        m_clients.erase(std::remove_if(m_clients.begin(), m_clients.end(),
+            [] (const Client &c) { return c.fd == -1; }), m_clients.end());
+
+        if (fds[1].revents & POLLIN) {
+            Accept();
+        }
+        m_client_count = static_cast<int>(m_clients.size());
+    }
+}
+
+/**
+ * Accepts pending connections, up to the maximum number of clients.
+ */
+void MJPEGServer::Accept() {
+    int fd;
+    while ((fd = accept4(m_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+        if (m_clients.size() >= MJPEG_MAX_CLIENTS) {
+            Log(LOG_DEBUG, "Too many stream clients; refusing connection.");
+            close(fd);
+            continue;
+        }
+        Client client{};
+        client.fd = fd;
+        m_clients.push_back(std::move(client));
+    }
+}
+
+/**
+ * Gives a newly published frame to every client waiting for one.
+ * @param [in] frame The frame.
+ */
+void MJPEGServer::Dispatch(const Buffer &frame) {
+    for (Client &client : m_clients) {
+        if (client.stream ||
+            (client.requested && !client.close && !client.frame)) {
+            Queue(&client, frame);
+        }
+    }
+}
+
+/**
+ * Reads (and, once complete, handles) a client's request. Anything sent
+ * after the request is ignored.
+ * @param [in] client The client.
+ * @return false iff the client disconnected or sent a bad request.
+ */
+bool MJPEGServer::ReadRequest(Client *client) {
+    char buffer[512];
+    ssize_t ret = recv(client->fd, buffer, sizeof(buffer), 0);
+    if (ret == 0) {
+        return false;
+    } else if (ret < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    } else if (client->requested) {
+        return true;
+    }
+
+    client->request.append(buffer, ret);
+    size_t end = client->request.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        end = client->request.find("\n\n");
+    }
+    if (end == std::string::npos) {
+        return client->request.size() < MJPEG_MAX_REQUEST;
+    }
+
+    //Only the request line matters, e.g. "GET /?action=stream HTTP/1.1".
+    const std::string &request = client->request;
+    size_t start = request.find(' ');
+    size_t stop = start == std::string::npos ?
+        std::string::npos : request.find(' ', start + 1);
+    bool get = request.compare(0, 4, "GET ") == 0 && stop != std::string::npos;
+    std::string path = get ? request.substr(start + 1, stop - start - 1) : "";
+    client->requested = true;
+    client->request.clear();
+
+    if (!get) {
+        client->head = NOT_FOUND;
+        client->close = true;
+    } else if (path.find("action=snapshot") != std::string::npos) {
+        //Wait for the next frame, so the snapshot is current.
+        client->stream = false;
+    } else if (path == "/" || path.find("action=stream") != std::string::npos) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        client->stream = true;
+        client->head = STREAM_HEADER;
+        if (m_latest) {
+            client->next = m_latest;
+        }
+    } else {
+        client->head = NOT_FOUND;
+        client->close = true;
+    }
+    return true;
+}
+
+/**
+ * Queues a frame to be sent to a client. A client only ever has one frame
+ * waiting; if it is still sending when a newer frame arrives, the waiting
+ * frame is dropped.
+ * @param [in] client The client.
+ * @param [in] frame The frame.
+ */
+void MJPEGServer::Queue(Client *client, const Buffer &frame) {
+    if (!client->head.empty() || client->frame) {
+        if (client->next) {
+            m_dropped++;
+        }
+        client->next = frame;
+    } else {
+        StartFrame(client, frame);
+    }
+}
+
+/**
+ * Sets up the headers for sending a frame to a client.
+ * @param [in] client The client.
+ * @param [in] frame The frame.
+ */
+void MJPEGServer::StartFrame(Client *client, const Buffer &frame) {
+    std::string length = std::to_string(frame->size());
+    if (client->stream) {
+        client->head.append("--" MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\n"
+            "Content-Length: ");
+    } else {
+        client->head.assign(SNAPSHOT_HEADER);
+        client->close = true;
+    }
+    client->head.append(length);
+    client->head.append("\r\n\r\n");
+    client->frame = frame;
+    client->sent = 0;
+}
+
+/**
+ * Sends as much of the current headers and frame as the client will take
+ * without blocking, moving on to the next frame if there is one.
+ * @param [in] client The client.
+ * @return false iff the connection should be closed.
+ */
+bool MJPEGServer::Send(Client *client) {
+    static const char trailer[] = "\r\n";
+
+    while (!client->head.empty() || client->frame) {
+        struct iovec iov[3];
+        size_t parts[3] = {client->head.size(),
+            client->frame ? client->frame->size() : 0,
+            client->frame && client->stream ? sizeof(trailer) - 1 : 0};
+        const char *data[3] = {client->head.data(),
+            client->frame ? reinterpret_cast<const char*>(client->frame->data()) : NULL,
+            trailer};
+
+        //Gather what's left of each part.
+        size_t skip = client->sent, total = 0;
+        int count = 0;
+        for (int i = 0; i < 3; i++) {
+            total += parts[i];
+            if (skip >= parts[i]) {
+                skip -= parts[i];
+            } else {
+                iov[count].iov_base = const_cast<char*>(data[i]) + skip;
+                iov[count].iov_len = parts[i] - skip;
+                skip = 0;
+                count++;
+            }
+        }
+
+        if (count > 0) {
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = count;
+            ssize_t ret = sendmsg(client->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (ret < 0) {
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            }
+            client->sent += ret;
+        }
+        if (client->sent < total) {
+            return true;
+        }
+
+        //Finished; move on to the next frame, if any.
+        client->head.clear();
+        client->frame.reset();
+        client->sent = 0;
+        if (client->close) {
+            return false;
+        } else if (client->next) {
+            Buffer next;
+            next.swap(client->next);
+            StartFrame(client, next);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,228 @@
+/**
+ * @file reactor.cpp
+ * @brief Single-threaded event loop for descriptors and timers.
+ */
+
+#include "common.h"
+#include "reactor.h"
+
+#include <cerrno>
+#include <stdexcept>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+using picopter::Reactor;
+
+/** The maximum number of events handled per wakeup **/
+#define REACTOR_MAX_EVENTS 16
+/** The id used for the wakeup event **/
+#define REACTOR_WAKEUP_ID 0
+
+/**
+ * Constructor. The reactor doesn't run until Start is called.
+ * @throws std::invalid_argument if the event loop cannot be created.
+ */
+Reactor::Reactor()
+: m_epoll_fd(-1)
+, m_event_fd(-1)
+, m_next_id(REACTOR_WAKEUP_ID + 1)
+, m_stop{false}
+{
+    struct epoll_event ev = {};
+
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.events = EPOLLIN;
+    ev.data.u32 = REACTOR_WAKEUP_ID;
+    if (m_epoll_fd == -1 || m_event_fd == -1 ||
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_event_fd, &ev) == -1) {
+        if (m_epoll_fd != -1) close(m_epoll_fd);
+        if (m_event_fd != -1) close(m_event_fd);
+        throw std::invalid_argument("Could not create the event loop.");
+    }
+}
+
+/**
+ * Destructor. Stops the reactor and closes any timers. Registered
+ * descriptors are not closed.
+ */
+Reactor::~Reactor() {
+    Stop();
+    for (auto &it : m_entries) {
+        if (it.second.period > 0) {
+            close(it.second.fd);
+        }
+    }
+    close(m_event_fd);
+    close(m_epoll_fd);
+}
+
+/**
+ * Starts the reactor thread. Not threadsafe.
+ */
+void Reactor::Start() {
+    if (!m_stop && !m_worker.joinable()) {
+        m_worker = std::thread(&Reactor::Run, this);
+    }
+}
+
+/**
+ * Stops the reactor thread, waiting for the running handler (if any) to
+ * return. Must not be called from a handler.
+ */
+void Reactor::Stop() {
+    uint64_t one = 1;
+    m_stop = true;
+    if (write(m_event_fd, &one, sizeof(one)) != sizeof(one)) {
+        Log(LOG_WARNING, "Could not wake the event loop.");
+    }
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+}
+
+/**
+ * Calls a handler whenever a descriptor is readable (level triggered).
+ * The handler should read what it can without blocking. If the other end
+ * hangs up, the handler is called one last time and then removed.
+ * @param [in] fd The descriptor. Must stay open until it is removed.
+ * @param [in] handler The handler.
+ * @return The registration id, or -1 on error.
+ */
+int Reactor::AddDescriptor(int fd, Handler handler) {
+    return Add(fd, 0, handler);
+}
+
+/**
+ * Calls a handler periodically.
+ * @param [in] period The period, in milliseconds.
+ * @param [in] handler The handler.
+ * @return The registration id, or -1 on error.
+ */
+int Reactor::AddTimer(int period, Handler handler) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int id;
+    if (fd == -1 || period <= 0 || !Arm(fd, period) ||
+        (id = Add(fd, period, handler)) == -1) {
+        if (fd != -1) close(fd);
+        return -1;
+    }
+    return id;
+}
+
+/**
+ * Restarts a timer, so that it next expires a full period from now.
+ * @param [in] id The registration id of the timer.
+ * @return true iff the timer was restarted.
+ */
+bool Reactor::ResetTimer(int id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(id);
+    if (it == m_entries.end() || it->second.period <= 0) {
+        return false;
+    }
+    return Arm(it->second.fd, it->second.period);
+}
+
+/**
+ * Removes a descriptor or timer. Unless called from a handler, this
+ * waits for the handler to return if it is running.
+ * @param [in] id The registration id.
+ */
+void Reactor::Remove(int id) {
+    std::unique_lock<std::mutex> dispatch(m_dispatch_mutex, std::defer_lock);
+    if (std::this_thread::get_id() != m_worker.get_id()) {
+        dispatch.lock();
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(id);
+    if (it != m_entries.end()) {
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, it->second.fd, NULL);
+        if (it->second.period > 0) {
+            close(it->second.fd);
+        }
+        m_entries.erase(it);
+    }
+}
+
+/**
+ * Registers a descriptor with the event loop.
+ * @param [in] fd The descriptor.
+ * @param [in] period The timer period (0 if not a timer).
+ * @param [in] handler The handler.
+ * @return The registration id, or -1 on error.
+ */
+int Reactor::Add(int fd, int period, Handler handler) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    struct epoll_event ev = {};
+    int id = m_next_id++;
+
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.u32 = id;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        Log(LOG_WARNING, "Could not watch descriptor %d: %s", fd, strerror(errno));
+        return -1;
+    }
+    m_entries[id] = Entry{fd, period, handler};
+    return id;
+}
+
+/**
+ * (Re)arms a periodic timer.
+ * @param [in] fd The timer descriptor.
+ * @param [in] period The period, in milliseconds.
+ * @return true iff the timer was armed.
+ */
+bool Reactor::Arm(int fd, int period) {
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = period / 1000;
+    spec.it_interval.tv_nsec = (period % 1000) * 1000000L;
+    spec.it_value = spec.it_interval;
+    return timerfd_settime(fd, 0, &spec, NULL) == 0;
+}
+
+/**
+ * The reactor loop. Waits for events and calls their handlers in turn.
+ */
+void Reactor::Run() {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    while (!m_stop) {
+        int count = epoll_wait(m_epoll_fd, events, REACTOR_MAX_EVENTS, -1);
+        if (count == -1 && errno != EINTR) {
+            Log(LOG_WARNING, "Event loop error: %s", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < count && !m_stop; i++) {
+            std::lock_guard<std::mutex> dispatch(m_dispatch_mutex);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto it = m_entries.find(events[i].data.u32);
+            if (it == m_entries.end()) {
+                continue; //Wakeup, or removed by an earlier handler.
+            }
+
+            if (it->second.period > 0) {
+                uint64_t expiries;
+                //Nothing to read if the timer was reset in the meantime.
+                if (read(it->second.fd, &expiries, sizeof(expiries)) !=
+                    sizeof(expiries)) {
+                    continue;
+                }
+            }
+
+            Handler handler = it->second.handler;
+            if (events[i].events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
+                //It would be readable forever; give it one last read.
+                Log(LOG_WARNING, "Descriptor %d was closed.", it->second.fd);
+                epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, it->second.fd, NULL);
+                m_entries.erase(it);
+            }
+            lock.unlock();
+            handler();
+        }
+    }
+}
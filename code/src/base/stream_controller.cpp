@@ -0,0 +1,197 @@
+/**
+ * @file stream_controller.cpp
+ * @brief Adapts the web stream's frame rate, size and quality to the load.
+ */
+
+#include "stream_controller.h"
+#include <algorithm>
+
+using namespace picopter;
+
+/** The frame skip used when the stream isn't adaptive **/
+#define STREAM_FIXED_SKIP 5
+/** Frame rate headroom (over the floor) needed to improve the stream **/
+#define STREAM_FPS_HEADROOM 1.2
+/** Fraction of the frame budget an improved stream may use **/
+#define STREAM_LOAD_HEADROOM 0.8
+
+/**
+ * The settings ladder, from the best looking to the cheapest stream.
+ * Encoding cost is roughly proportional to scale^2 / skip.
+ */
+static const StreamSettings g_ladder[] = {
+    {1, 100, 80},
+    {2, 100, 75},
+    {3, 100, 70},
+    {3, 75, 65},
+    {5, 75, 60},
+    {5, 50, 55},
+    {8, 50, 50},
+    {15, 50, 40}
+};
+static const int g_levels = sizeof(g_ladder) / sizeof(g_ladder[0]);
+
+/**
+ * Estimates the relative encoding cost (per processed frame) of a level.
+ * @param [in] level The level.
+ * @return The relative cost.
+ */
+static double LevelCost(int level) {
+    const StreamSettings &s = g_ladder[level];
+    return (s.scale * s.scale) / (10000.0 * s.skip);
+}
+
+/**
+ * Constructor.
+ * @param [in] min_fps The detection frame rate floor.
+ * @param [in] max_quality The maximum JPEG quality.
+ * @param [in] adaptive Whether the settings adapt to the load.
+ */
+StreamController::StreamController(double min_fps, int max_quality, bool adaptive)
+: m_adaptive(adaptive)
+, m_min_fps(std::max(1.0, min_fps))
+, m_max_quality(std::min(100, std::max(10, max_quality)))
+, m_level(g_levels / 2)
+, m_good(0)
+, m_frames(0)
+, m_start(-1)
+, m_process(0)
+, m_streamed(0)
+, m_stream(0)
+{
+}
+
+/**
+ * Destructor.
+ */
+StreamController::~StreamController() {
+}
+
+/**
+ * Sets whether the settings adapt to the load.
+ * @param [in] adaptive true to adapt, false for fixed settings.
+ */
+void StreamController::SetAdaptive(bool adaptive) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_adaptive = adaptive;
+    m_good = 0;
+}
+
+/**
+ * Retrieves whether the settings adapt to the load.
+ * @return true iff adaptive.
+ */
+bool StreamController::GetAdaptive() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_adaptive;
+}
+
+/**
+ * Sets the detection frame rate floor.
+ * @param [in] min_fps The minimum frame rate.
+ */
+void StreamController::SetMinimumFPS(double min_fps) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_min_fps = std::max(1.0, min_fps);
+    m_good = 0;
+}
+
+/**
+ * Retrieves the detection frame rate floor.
+ * @return The minimum frame rate.
+ */
+double StreamController::GetMinimumFPS() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_min_fps;
+}
+
+/**
+ * Sets the maximum JPEG quality.
+ * @param [in] quality The maximum quality (10-100).
+ */
+void StreamController::SetMaximumQuality(int quality) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_quality = std::min(100, std::max(10, quality));
+}
+
+/**
+ * Retrieves the current stream settings.
+ * @return The settings.
+ */
+StreamSettings StreamController::GetSettings() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_adaptive) {
+        return StreamSettings{STREAM_FIXED_SKIP, 100, m_max_quality};
+    }
+    StreamSettings ret = g_ladder[m_level];
+    ret.quality = std::min(ret.quality, m_max_quality);
+    return ret;
+}
+
+/**
+ * Records that a frame was processed.
+ * @param [in] timestamp_ms When processing finished (any monotonic clock).
+ * @param [in] process_ms How long processing took.
+ */
+void StreamController::AddProcessed(double timestamp_ms, double process_ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_start < 0) {
+        m_start = timestamp_ms;
+        return;
+    }
+
+    m_process += process_ms;
+    if (++m_frames >= STREAM_CONTROL_WINDOW) {
+        Evaluate(timestamp_ms);
+        m_start = timestamp_ms;
+        m_frames = 0;
+        m_process = 0;
+        m_streamed = 0;
+        m_stream = 0;
+    }
+}
+
+/**
+ * Records that a frame was streamed.
+ * @param [in] stream_ms How long encoding and sending took.
+ */
+void StreamController::AddStreamed(double stream_ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_streamed++;
+    m_stream += stream_ms;
+}
+
+/**
+ * Decides whether to change the stream settings, at the end of a window.
+ * @param [in] timestamp_ms The end of the window.
+ */
+void StreamController::Evaluate(double timestamp_ms) {
+    if (!m_adaptive || timestamp_ms <= m_start) {
+        return;
+    }
+
+    double fps = (m_frames * 1000.0) / (timestamp_ms - m_start);
+    double budget = 1000.0 / m_min_fps;
+    double process = m_process / m_frames;
+    double encode = m_streamed > 0 ? m_stream / m_streamed : 0;
+    //Encode time per processed frame at the current level.
+    double stream = encode / g_ladder[m_level].skip;
+
+    if (fps < m_min_fps || process + stream > budget) {
+        //Starving the detector; back off straight away.
+        m_level = std::min(g_levels - 1, m_level + 1);
+        m_good = 0;
+    } else if (m_level > 0 && m_streamed > 0) {
+        //Improve once there's been room for the next level for a while.
+        double next = stream * LevelCost(m_level - 1) / LevelCost(m_level);
+        if (fps >= m_min_fps * STREAM_FPS_HEADROOM &&
+            process + next < budget * STREAM_LOAD_HEADROOM) {
+            if (++m_good >= STREAM_CONTROL_HOLD) {
+                m_level--;
+                m_good = 0;
+            }
+        } else {
+            m_good = 0;
+        }
+    }
+}
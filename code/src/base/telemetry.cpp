@@ -0,0 +1,355 @@
+/**
+ * @file telemetry.cpp
+ * @brief Requests the telemetry that modules need, at the rates they need.
+ */
+
+#include "common.h"
+#include "telemetry.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace picopter;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+/**
+ * Which data stream each message is sent in (by ArduCopter), for when
+ * message intervals aren't supported.
+ */
+static const struct {
+    int msgid;
+    int stream;
+} g_stream_groups[] = {
+    {MAVLINK_MSG_ID_GLOBAL_POSITION_INT, MAV_DATA_STREAM_POSITION},
+    {MAVLINK_MSG_ID_ATTITUDE, MAV_DATA_STREAM_EXTRA1},
+    {MAVLINK_MSG_ID_VFR_HUD, MAV_DATA_STREAM_EXTRA2},
+    {MAVLINK_MSG_ID_SYSTEM_TIME, MAV_DATA_STREAM_EXTRA3},
+    {MAVLINK_MSG_ID_MOUNT_STATUS, MAV_DATA_STREAM_EXTRA3},
+    {MAVLINK_MSG_ID_SYS_STATUS, MAV_DATA_STREAM_EXTENDED_STATUS},
+    {MAVLINK_MSG_ID_GPS_RAW_INT, MAV_DATA_STREAM_EXTENDED_STATUS}
+};
+static const int g_streams[] = {
+    MAV_DATA_STREAM_POSITION, MAV_DATA_STREAM_EXTRA1, MAV_DATA_STREAM_EXTRA2,
+    MAV_DATA_STREAM_EXTRA3, MAV_DATA_STREAM_EXTENDED_STATUS
+};
+
+/**
+ * Constructor. Nothing is requested until Connect is called.
+ * @param [in] tx The queue to send requests on.
+ * @param [in] component_id Our component id.
+ */
+TelemetryManager::TelemetryManager(MAVCommsQueue *tx, int component_id)
+: m_tx(tx)
+, m_component_id(component_id)
+, m_target_system(0)
+, m_target_component(0)
+, m_connected(false)
+, m_use_streams(false)
+, m_intervals_acked(false)
+, m_ack_attempts(0)
+, m_next_id(0)
+, m_requested{}
+, m_counts{}
+, m_achieved{}
+, m_window_start(steady_clock::now())
+{
+}
+
+/**
+ * Destructor.
+ */
+TelemetryManager::~TelemetryManager() {
+}
+
+/**
+ * Requests a message at (at least) the given rate.
+ * @param [in] msgid The message id.
+ * @param [in] rate The rate, in Hz (capped to TELEMETRY_MAX_RATE).
+ * @return The request id (to release it), or -1 on error.
+ */
+int TelemetryManager::Request(int msgid, double rate) {
+    if (msgid < 0 || msgid >= TELEMETRY_MESSAGES || !(rate > 0)) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int id = m_next_id++;
+    m_subscriptions[id] = Subscription{msgid, std::min<double>(rate, TELEMETRY_MAX_RATE)};
+    Update(msgid);
+    return id;
+}
+
+/**
+ * Releases a request. If nobody else needs the message, it is stopped (or
+ * slowed down, if others need it less often).
+ * @param [in] id The request id, as returned by Request.
+ */
+void TelemetryManager::Release(int id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_subscriptions.find(id);
+    if (it != m_subscriptions.end()) {
+        int msgid = it->second.msgid;
+        m_subscriptions.erase(it);
+        Update(msgid);
+    }
+}
+
+/**
+ * (Re)initialises the connection to the autopilot, requesting everything
+ * that is needed. Must be called whenever the link is (re)established.
+ * @param [in] system_id The autopilot's system id.
+ * @param [in] target_component The autopilot's component id.
+ */
+void TelemetryManager::Connect(int system_id, int target_component) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_target_system = system_id;
+    m_target_component = target_component;
+    m_connected = true;
+
+    if (m_use_streams) {
+        std::fill(m_requested, m_requested + TELEMETRY_MESSAGES, 0.0);
+        SendStreams();
+    } else {
+        //The default streams keep running until the intervals are
+        //acknowledged (see CommandAck).
+        m_intervals_acked = false;
+        m_ack_attempts = 1;
+        RequestAll(steady_clock::now());
+    }
+}
+
+/**
+ * Handles a command acknowledgement. Once message intervals are accepted,
+ * the default streams are stopped. If they were refused, this falls back to
+ * requesting data streams.
+ * @param [in] ack The acknowledgement.
+ */
+void TelemetryManager::CommandAck(const mavlink_command_ack_t *ack) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (ack->command != TELEMETRY_CMD_SET_MESSAGE_INTERVAL || m_use_streams) {
+        return;
+    }
+
+    if (ack->result != MAV_RESULT_ACCEPTED) {
+        Log(LOG_WARNING, "Message intervals not supported (%d); "
+            "requesting data streams instead.", ack->result);
+        m_use_streams = true;
+        if (m_connected) {
+            SendStreams();
+        }
+    } else if (!m_intervals_acked && m_connected) {
+        //Only now is it safe to stop the default streams; we'll ask for
+        //what we need again in case stopping them stops those too.
+        m_intervals_acked = true;
+        StopDefaultStreams();
+        RequestAll(steady_clock::now());
+    }
+}
+
+/**
+ * Records that a message was received.
+ * @param [in] msgid The message id.
+ */
+void TelemetryManager::Received(int msgid) {
+    if (msgid >= 0 && msgid < TELEMETRY_MESSAGES) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Roll(steady_clock::now());
+        m_counts[msgid]++;
+    }
+}
+
+/**
+ * Checks that the telemetry that was asked for is arriving. Should be
+ * called every TELEMETRY_CHECK_INTERVAL ms.
+ *
+ * If message intervals go unacknowledged (the autopilot ignores them, or
+ * the acknowledgement was lost), they are asked for again and eventually
+ * given up on in favour of data streams. A needed message that stops
+ * arriving is asked for again.
+ */
+void TelemetryManager::Check() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    TimePoint now = steady_clock::now();
+    Roll(now);
+    if (!m_connected) {
+        return;
+    }
+
+    if (!m_use_streams && !m_intervals_acked) {
+        if (now - m_ack_start < milliseconds(TELEMETRY_ACK_TIMEOUT)) {
+            return;
+        } else if (m_ack_attempts < TELEMETRY_ACK_ATTEMPTS) {
+            Log(LOG_DEBUG, "Message intervals not acknowledged; asking again.");
+            m_ack_attempts++;
+            RequestAll(now);
+        } else {
+            Log(LOG_WARNING, "Message intervals never acknowledged; "
+                "requesting data streams instead.");
+            m_use_streams = true;
+            SendStreams();
+        }
+        return;
+    }
+
+    bool resend_streams = false;
+    for (int msgid = 0; msgid < TELEMETRY_MESSAGES; msgid++) {
+        if (m_requested[msgid] > 0 && m_achieved[msgid] == 0 &&
+            now - m_requested_at[msgid] > milliseconds(TELEMETRY_ARRIVAL_TIMEOUT)) {
+            Log(LOG_DEBUG, "Message %d isn't arriving; asking again.", msgid);
+            if (m_use_streams) {
+                resend_streams = true;
+            } else {
+                SendInterval(msgid, m_requested[msgid]);
+                m_requested_at[msgid] = now;
+            }
+        }
+    }
+    if (resend_streams) {
+        SendStreams();
+    }
+}
+
+/**
+ * Retrieves the requested and achieved rate of a message.
+ * @param [in] msgid The message id.
+ * @param [out] rate The location to store the rates.
+ */
+void TelemetryManager::GetRate(int msgid, TelemetryRate *rate) {
+    *rate = TelemetryRate{};
+    if (msgid >= 0 && msgid < TELEMETRY_MESSAGES) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Roll(steady_clock::now());
+        rate->requested = Needed(msgid);
+        rate->achieved = m_achieved[msgid];
+    }
+}
+
+/**
+ * Determines the rate a message is needed at.
+ * @param [in] msgid The message id.
+ * @return The highest requested rate (0 if not needed).
+ */
+double TelemetryManager::Needed(int msgid) {
+    double rate = 0;
+    for (const auto &it : m_subscriptions) {
+        if (it.second.msgid == msgid) {
+            rate = std::max(rate, it.second.rate);
+        }
+    }
+    return rate;
+}
+
+/**
+ * Asks the autopilot for a message at the rate it's needed, if that's not
+ * what was last asked for.
+ * @param [in] msgid The message id.
+ */
+void TelemetryManager::Update(int msgid) {
+    double rate = Needed(msgid);
+    if (!m_connected || rate == m_requested[msgid]) {
+        return;
+    }
+
+    m_requested[msgid] = rate;
+    m_requested_at[msgid] = steady_clock::now();
+    if (m_use_streams) {
+        SendStreams();
+    } else {
+        SendInterval(msgid, rate);
+    }
+}
+
+/**
+ * Sends a message interval request.
+ * @param [in] msgid The message id.
+ * @param [in] rate The rate, in Hz (0 to stop it).
+ */
+void TelemetryManager::SendInterval(int msgid, double rate) {
+    mavlink_command_long_t cmd = {};
+    mavlink_message_t msg;
+
+    cmd.target_system = m_target_system;
+    cmd.target_component = m_target_component;
+    cmd.command = TELEMETRY_CMD_SET_MESSAGE_INTERVAL;
+    cmd.param1 = msgid;
+    cmd.param2 = rate > 0 ? std::round(1e6 / rate) : -1; //Interval in us
+    mavlink_msg_command_long_encode(m_target_system, m_component_id, &msg, &cmd);
+    m_tx->Send(&msg, MAV_PRIORITY_COMMAND);
+    Log(LOG_DEBUG, "Requested message %d at %.1f Hz", msgid, rate);
+}
+
+/**
+ * Requests each data stream at the highest rate needed of any message in
+ * it. Streams that nothing needs are stopped.
+ */
+void TelemetryManager::SendStreams() {
+    mavlink_request_data_stream_t stream = {};
+    mavlink_message_t msg;
+
+    stream.target_system = m_target_system;
+    stream.target_component = m_target_component;
+    for (int id : g_streams) {
+        double rate = 0;
+        for (const auto &group : g_stream_groups) {
+            if (group.stream == id) {
+                rate = std::max(rate, Needed(group.msgid));
+            }
+        }
+
+        stream.req_stream_id = id;
+        stream.req_message_rate = static_cast<uint16_t>(std::ceil(rate));
+        stream.start_stop = rate > 0 ? 1 : 0;
+        mavlink_msg_request_data_stream_encode(
+            m_target_system, m_component_id, &msg, &stream);
+        m_tx->Send(&msg, MAV_PRIORITY_COMMAND);
+    }
+
+    TimePoint now = steady_clock::now();
+    for (int msgid = 0; msgid < TELEMETRY_MESSAGES; msgid++) {
+        m_requested[msgid] = Needed(msgid);
+        m_requested_at[msgid] = now;
+    }
+}
+
+/**
+ * Stops the data streams the autopilot sends by default.
+ */
+void TelemetryManager::StopDefaultStreams() {
+    mavlink_request_data_stream_t stream = {};
+    mavlink_message_t msg;
+    stream.target_system = m_target_system;
+    stream.target_component = m_target_component;
+    stream.req_stream_id = MAV_DATA_STREAM_ALL;
+    stream.start_stop = 0;
+    mavlink_msg_request_data_stream_encode(
+        m_target_system, m_component_id, &msg, &stream);
+    m_tx->Send(&msg, MAV_PRIORITY_COMMAND);
+}
+
+/**
+ * Asks for every needed message afresh, with message intervals.
+ * @param [in] now The current time.
+ */
+void TelemetryManager::RequestAll(TimePoint now) {
+    m_ack_start = now;
+    std::fill(m_requested, m_requested + TELEMETRY_MESSAGES, 0.0);
+    for (int msgid = 0; msgid < TELEMETRY_MESSAGES; msgid++) {
+        Update(msgid);
+    }
+}
+
+/**
+ * Starts a new rate measurement window, once the current one is over.
+ * @param [in] now The current time.
+ */
+void TelemetryManager::Roll(TimePoint now) {
+    int elapsed = duration_cast<milliseconds>(now - m_window_start).count();
+    if (elapsed >= 1000) {
+        for (int i = 0; i < TELEMETRY_MESSAGES; i++) {
+            m_achieved[i] = (m_counts[i] * 1000.0) / elapsed;
+            m_counts[i] = 0;
+        }
+        m_window_start = now;
+    }
+}
@@ -6,18 +6,19 @@
 #include "common.h"
 #include "watchdog.h"
 
+using picopter::Reactor;
 using picopter::Watchdog;
-using std::this_thread::sleep_for;
-using std::chrono::milliseconds;
 
 /**
  * Constructor. Creates a new watchdog.
+ * @param [in] reactor The reactor to run the watchdog timer on.
  * @param [in] timeout The timeout in milliseconds.
- * @param [in] cb The callback to call if it times out.
+ * @param [in] cb The callback to call if it times out. It is called on the
+ *                reactor thread, and again every timeout until touched.
  */
-Watchdog::Watchdog(int timeout, std::function<void()> cb)
-: m_stop{false}
-, m_index{0}
+Watchdog::Watchdog(Reactor *reactor, int timeout, std::function<void()> cb)
+: m_reactor(reactor)
+, m_timer{-1}
 , m_timeout(timeout)
 , m_callback(cb)
 {
@@ -34,8 +35,8 @@ Watchdog::~Watchdog() {
  * Starts the watchdog. Not threadsafe.
  */
 void Watchdog::Start() {
-    if (!m_stop && !m_worker.joinable()) {
-        m_worker = std::thread(&Watchdog::Worker, this);
+    if (m_timer < 0) {
+        m_timer = m_reactor->AddTimer(m_timeout, m_callback);
     }
 }
 
@@ -43,28 +44,9 @@ void Watchdog::Start() {
  * Stops the watchdog.
  */
 void Watchdog::Stop() {
-    m_stop = true;
-    if (m_worker.joinable()) {
-        m_worker.join();
-    }    
-}
-
-/**
- * Watchdog loop.
- */
-void Watchdog::Worker() {
-    int last_index = 0;
-    while (true) {
-        sleep_for(milliseconds(m_timeout));
-        if (m_stop) {
-            break;
-        } else {
-            int cur_index = m_index;
-            if (cur_index <= last_index) {
-                m_callback();
-            }
-            last_index = cur_index;
-        }
+    int timer = m_timer.exchange(-1);
+    if (timer >= 0) {
+        m_reactor->Remove(timer);
     }
 }
 
@@ -72,5 +54,8 @@ void Watchdog::Worker() {
  * Resets the watchdog timer.
  */
 void Watchdog::Touch() {
-    m_index++;
-}
\ No newline at end of file
+    int timer = m_timer;
+    if (timer >= 0) {
+        m_reactor->ResetTimer(timer);
+    }
+}
@@ -29,6 +29,8 @@ ObjectTracker::ObjectTracker(Options *opts, TrackMethod method)
 , m_track_method{method}
 , m_finished{false}
 , SEARCH_GIMBAL_LIMIT(60)
+, m_sighting_log(NULL)
+, m_map_pool(NULL)
 {
     Options clear;
     if (!opts) {
@@ -70,6 +72,12 @@ ObjectTracker::ObjectTracker(Options *opts, TrackMethod method)
     observation_image_rows = opts->GetReal("OBS_IMAGE_ROWS",240);
     observation_image_cols = opts->GetReal("OBS_IMAGE_COLS",320);
     print_observation_map = opts->GetBool("PRINT_OBS_MAP",false);
+    observation_map_workers = std::max(1, opts->GetInt("OBS_MAP_WORKERS", std::thread::hardware_concurrency()));
+    log_sightings = opts->GetBool("LOG_SIGHTINGS",false);
+    association_gate = opts->GetReal("ASSOCIATION_GATE",11.34); //99% of a 3D gaussian
+    track_confirm_detections = opts->GetInt("TRACK_CONFIRM_DETECTIONS",3);
+    track_tentative_timeout = opts->GetInt("TRACK_TENTATIVE_TIMEOUT",1000);
+    track_lost_timeout = opts->GetInt("TRACK_LOST_TIMEOUT",10000);
     
 
     m_pidw.SetTunings(TRACK_Kpw, TRACK_TauIw, TRACK_TauDw);
@@ -167,6 +175,9 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
     //Point2D input_limits = {m_camwidth/2.0, m_camheight/2.0};
 
     std::vector<ObjectInfo> locations;
+    DetectionSet detections{};
+    DetectionQueue detection_queue;
+    int subscription = fc->cam->Subscribe(&detection_queue);
 
     std::vector<Observation> visibles; //things we can currently see
     std::vector<Observations> knownThings; //things we know of
@@ -185,6 +196,12 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
     //launch_point = Coord3D{gps_position.fix.lat, gps_position.fix.lon, gps_position.fix.alt};
 
     Mat observation_map(observation_image_rows, observation_image_cols, CV_8UC4);
+    if(log_sightings){
+        m_sighting_log = new DataLog("sightings");
+    }
+    if(print_observation_map){
+        m_map_pool = new ThreadPool(observation_map_workers);
+    }
 
     EulerAngle pose;
     pose.roll = 0;
@@ -195,22 +212,37 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
     while (!fc->CheckForStop()) {
         fc->fb->SetGimbalPose(pose);
 
+        //Run once per camera frame; each frame's detections arrive exactly once.
+        if (detection_queue.Wait(FRAME_TIMEOUT) && detection_queue.Pop(&detections)) {
+            locations.assign(detections.objects, detections.objects + detections.count);
+        } else {
+            locations.clear();
+        }
+
         last_loop = loop_start;
         loop_start = steady_clock::now() - m_task_start;
         TIME_TYPE loop_period = (loop_start - last_loop);
 
         //clear the printable map
-        observation_map = Mat::zeros(observation_map.rows, observation_map.cols, CV_8UC4);
+        if(print_observation_map){
+            observation_map.setTo(Scalar(0,0,0,UCHAR_MAX));
+        }
 
         double update_rate = 1.0 / fc->cam->GetFramerate();
-        TIME_TYPE sleep_time = microseconds((int)(1000000*update_rate));    //how long to wait for the next frame (FIXME)
 
-
-        fc->cam->GetDetectedObjects(&locations);
         fc->fb->GetGimbalPose(&gimbal);
         fc->gps->GetLatest(&gps_position);
         fc->imu->GetLatest(&imu_data);
 
+        //Detections are timed from, and posed as at, the frame's capture.
+        TIME_TYPE detection_time = detections.timestamp - m_task_start;
+        EulerAngle frame_gimbal = gimbal;
+        IMUData frame_imu = imu_data;
+        if (detections.pose.valid) {
+            frame_gimbal = detections.pose.gimbal;
+            frame_imu = detections.pose.imu;
+        }
+
         //LogSimple(LOG_DEBUG, "Copter is at: lat: %.4f, lon: %.4f, alt %.4f", gps_position.fix.lat, gps_position.fix.lon, gps_position.fix.alt);
         //LogSimple(LOG_DEBUG, "IMU is at: roll: %.4f, pitch: %.4f, yaw %.4f", imu_data.roll, imu_data.pitch, imu_data.yaw);
         //LogSimple(LOG_DEBUG, "Gimbal is at: roll: %.4f, pitch: %.4f, yaw %.4f", gimbal.roll, gimbal.pitch, gimbal.yaw);
@@ -223,6 +255,7 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
 
         
         //Now would be a good time to use the velocity and acceleration handler
+        bool seen_confirmed = false;   //the first confirmed object is the target
         for(uint i=0; i<knownThings.size(); i++){
             //LogSimple(LOG_DEBUG, "object %d observed %uuS ago", i, duration_cast<microseconds>(loop_start - knownThings.at(i).lastObservation()).count());
             //LogSimple(LOG_DEBUG, "object %d observed at %u", i, duration_cast<microseconds>(knownThings.at(i).lastObservation()).count());
@@ -231,20 +264,25 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
             //LogSimple(LOG_DEBUG, " at ground coords [%.4f,%.4f,%.4f]", V(0),V(1),V(2));
             //LogSimple(LOG_DEBUG, " with covariance\n\t\t\t\t[%.4f,%.4f,%.4f\n\t\t\t\t %.4f,%.4f,%.4f\n\t\t\t\t %.4f,%.4f,%.4f]", A(0,0),A(1,0),A(2,0),A(0,1),A(1,1),A(2,1),A(0,2),A(1,2),A(2,2));
 
-            if( (loop_start - knownThings.at(i).lastObservation()) < seconds(10) ){
+            //objects that haven't been seen enough to be confirmed are forgotten sooner
+            bool confirmed = knownThings.at(i).detectionCount() >= (unsigned long)track_confirm_detections;
+            milliseconds timeout(confirmed ? track_lost_timeout : track_tentative_timeout);
+            if( (loop_start - knownThings.at(i).lastObservation()) < timeout ){
+                seen_confirmed = seen_confirmed || confirmed;
 
                 knownThings.at(i).updateObject(loop_period);
 
                 if(print_observation_map){  //plot the objects on the map
                     Distrib tmp = knownThings[i].getLocation();
-                    rasterDistrib(&observation_map, &tmp, Vec4b(0,0,UCHAR_MAX,UCHAR_MAX), 1.0);  //red
+                    rasterDistrib(&observation_map, &tmp, Vec4b(0,0,UCHAR_MAX,UCHAR_MAX), 1.0, m_map_pool, observation_map_workers);  //red
                 }
 
             }else{
                 LogSimple(LOG_DEBUG,"Removing Lost Object %d", i);
-                if((i==0) && (knownThings.size()>1)){
+                if(confirmed && !seen_confirmed){
                     Log(LOG_WARNING, "Switching targets");
                 }
+                knownThings.at(i).spillSightings();
                 knownThings.erase(knownThings.begin()+i);
                 i--;
             }
@@ -253,50 +291,50 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
 
         //start making observation structures
         Observation lidarObservation = ObservationFromLidar(loop_start, &gps_position, &gimbal, &imu_data, lidar_range);
-        rasterDistrib(&observation_map, &lidarObservation.location, Vec4b(UCHAR_MAX,0,0,UCHAR_MAX), 1.0);  //blue
+        if(print_observation_map){
+            rasterDistrib(&observation_map, &lidarObservation.location, Vec4b(UCHAR_MAX,0,0,UCHAR_MAX), 1.0, m_map_pool, observation_map_workers);  //blue
+        }
 
 
         //Did the camera see anything?
+        visibles.clear();
         if (locations.size() > 0) {
             detected_object = locations.front();
 
             //build observations for each
-            std::vector<Observation> visibles; //things we can currently see
-            visibles.reserve(locations.size()); //save multiple reallocations
-            for(uint i=0; i<locations.size(); i++){
-                visibles.push_back(ObservationFromImageCoords(loop_start, &gps_position, &gimbal, &imu_data, &detected_object));
-                
-                //Vec3d V = visibles.back().location.vect;
-                //Matx33d A = visibles.back().location.axes;
-                //LogSimple(LOG_DEBUG, " detection:");
-                //LogSimple(LOG_DEBUG, " at ground coords [%.4f,%.4f,%.4f]", V(0),V(1),V(2));
-                //LogSimple(LOG_DEBUG, " with covariance\n\t\t\t\t[%.4f,%.4f,%.4f\n\t\t\t\t %.4f,%.4f,%.4f\n\t\t\t\t %.4f,%.4f,%.4f]", A(0,0),A(1,0),A(2,0),A(0,1),A(1,1),A(2,1),A(0,2),A(1,2),A(2,2));
-
-            }
-
-            if(print_observation_map){
-                //print the observations and objects
-                std::string filename = "tracker"+std::to_string(observation_map_count++)+".png";
-                storeDistrib(&observation_map, filename);
-            }
+            ObservationsFromImageCoords(detection_time, &gps_position, &frame_gimbal, &frame_imu, locations, &visibles);
 
 
             //distinguish between many objects
-            //matchObsToObj(visibles, knownThings);
+            matchObsToObj(visibles, knownThings);
             //ChooseObsToObj(visibles, knownThings);
-            NoObjectMemory(visibles, knownThings);
+            //NoObjectMemory(visibles, knownThings);
         }
 
         //Now we have some things to track with known locations, without needing to see them.
 
         if(print_observation_map){
             for(uint j=0; j<visibles.size(); j++){
-                rasterDistrib(&observation_map, &(visibles[j].location), Vec4b(0,UCHAR_MAX,0,UCHAR_MAX), 1.0);
+                rasterDistrib(&observation_map, &(visibles[j].location), Vec4b(0,UCHAR_MAX,0,UCHAR_MAX), 1.0, m_map_pool, observation_map_workers);
+            }
+            if(visibles.size() > 0){
+                //print the observations and objects
+                StoreObservationMap(observation_map);
             }
         }
          
-        if(knownThings.size() > 0){   
-            Coord3D object_gps_location = GPSFromGround(knownThings.front().getLocation().vect);
+        //Which one do we track?  The first confirmed thing it saw sounds right.
+        //Tentative tracks may just be clutter, so they are never flown towards.
+        Observations *target = NULL;
+        for(uint i=0; i<knownThings.size(); i++){
+            if(knownThings[i].detectionCount() >= (unsigned long)track_confirm_detections){
+                target = &knownThings[i];
+                break;
+            }
+        }
+
+        if(target != NULL){   
+            Coord3D object_gps_location = GPSFromGround(target->getLocation().vect);
             
             //LogSimple(LOG_DEBUG, "last observation at: %u", duration_cast<microseconds>(loop_start).count());
             //LogSimple(LOG_DEBUG, "Object %d observed %uuS ago", 0, duration_cast<microseconds>(loop_start - knownThings.at(0).lastObservation()).count());
@@ -306,12 +344,11 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
 
 //        if(true){
 
-        //Which one do we track?  The first thing it saw sounds right.
-        if(knownThings.size() <= 0){
-            LogSimple(LOG_WARNING, "No object detected. Waiting.");
+        if(target == NULL){
+            LogSimple(LOG_WARNING, "No confirmed object. Waiting.");
 
-        //had_fix && knownThings.front().lastObservation() < seconds(2)
-        } else if((loop_start - knownThings.front().lastObservation()) <= milliseconds(500)){    //Did we see the thing this loop?
+        //had_fix && target->lastObservation() < seconds(2)
+        } else if((loop_start - target->lastObservation()) <= milliseconds(500)){    //Did we see the thing this loop?
 
             SetCurrentState(fc, STATE_TRACKING_LOCKED);
 
@@ -329,8 +366,8 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
             //poi_point.lon -= 0.01;
             //poi_point.alt = 0;
             //Observations testThing(ObservationFromRemote(poi_point));
-            Coord3D vantage = CalculateVantagePoint(&gps_position, &knownThings.front(), true);
-            Coord3D poi_point = GPSFromGround(knownThings.front().getLocation().vect);
+            Coord3D vantage = CalculateVantagePoint(&gps_position, target, true);
+            Coord3D poi_point = GPSFromGround(target->getLocation().vect);
             //Coord3D vantage = CalculateVantagePoint(&gps_position, &testThing, true);
             if (!m_observation_mode) {
                 PathWaypoint(fc, &gps_position, &imu_data, vantage, poi_point);
@@ -345,14 +382,14 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
 
 
     //There's probably a use for this code segment other than holding the phone for a while, but I can't think of one.
-        } else if (had_fix && (loop_start - knownThings.front().lastObservation()) < seconds(2)) {
+        } else if (had_fix && (loop_start - target->lastObservation()) < seconds(2)) {
             
             m_pidw.SetInterval(update_rate);
             m_pidx.SetInterval(update_rate);
             m_pidy.SetInterval(update_rate);
 
-            Coord3D vantage = CalculateVantagePoint(&gps_position, &knownThings.front(), true);
-            Coord3D poi_point = GPSFromGround(knownThings.front().getLocation().vect);
+            Coord3D vantage = CalculateVantagePoint(&gps_position, target, true);
+            Coord3D poi_point = GPSFromGround(target->getLocation().vect);
             if (!m_observation_mode) {
                 PathWaypoint(fc, &gps_position, &imu_data, vantage, poi_point);
                 //CalculatePath(fc, &gps_position, &imu_data, vantage, poi_point, &course);
@@ -380,10 +417,19 @@ void ObjectTracker::Run(FlightController *fc, void *opts) {
                 had_fix = false;
             }
         }
-        
-        sleep_for(sleep_time);
     }
+    fc->cam->Unsubscribe(subscription);
     fc->cam->SetTrackingArrow({0,0,0});
+    for(uint i=0; i<knownThings.size(); i++){
+        knownThings.at(i).spillSightings();
+    }
+    delete m_sighting_log;
+    m_sighting_log = NULL;
+    if(m_map_write.valid()){
+        m_map_write.wait();
+    }
+    delete m_map_pool;
+    m_map_pool = NULL;
     Log(LOG_INFO, "Object detection ended.");
     fc->fb->Stop();
     m_finished = true;
@@ -410,6 +456,36 @@ Matx33d ObjectTracker::BodyToLevel(IMUData *imu_data){
 Matx33d ObjectTracker::LevelToGround(IMUData *imu_data){
     return rotationMatrix(0,0,imu_data->yaw);
 }
+//the transformation from the camera (or anything on the gimbal) to ground
+Matx33d ObjectTracker::CameraToGround(EulerAngle *gimbal, IMUData *imu_data){
+    Matx33d MGnd;
+    if(m_demo_mode){
+        MGnd = LevelToGround(imu_data);    //Disable the pitch and roll in simulation
+    }else{
+        MGnd = BodyToGround(imu_data);      //Enable them during live tests
+    }
+    //Matx33d Mstable = BodyToLevel(imu_data);
+    //Matx33d MYaw = LevelToGround(imu_data);
+    //Matx33d MGnd = BodyToGround(imu_data);
+    return MGnd * GimbalToBody(gimbal);
+}
+
+/**
+ * Writes a copy of the observation map to the next trackerN.png, in the background.
+ * If the last map is still being written, this one is dropped rather than holding up the loop.
+ * @param [in] map The map.
+ */
+void ObjectTracker::StoreObservationMap(const Mat &map){
+    if(m_map_write.valid() && m_map_write.wait_for(seconds(0)) != std::future_status::ready){
+        LogSimple(LOG_DEBUG, "Still writing the last observation map, skipping this one");
+        return;
+    }
+    std::string filename = "tracker"+std::to_string(observation_map_count++)+".png";
+    Mat copy = map.clone();
+    m_map_write = m_map_pool->enqueue([copy, filename]() mutable {
+        storeDistrib(&copy, filename);
+    });
+}
 
 /**
  * determines whether or not the object in frame overlaps the lidar
@@ -435,47 +511,55 @@ bool ObjectTracker::UseLidar(ObjectInfo *object, double lidar_range){
  * @param [in] object The detected object.
  */
 Observation ObjectTracker::ObservationFromImageCoords(TIME_TYPE sample_time, GPSData *pos, EulerAngle *gimbal, IMUData *imu_data, ObjectInfo *object){
-    
-    double L = FOCAL_LENGTH * object->image_width;     
-    Vec3d RelCam(object->position.y, object->position.x, L);    
-    double phi   = RAD2DEG(-atan2(RelCam[1],RelCam[2])); //Roll angle of target in camera frame from vertical
-    double theta = RAD2DEG( atan2(RelCam[0],RelCam[2])); //Pitch angle of target in camera frame from vertical
-    
-    Matx33d Mblob = rotationMatrix(phi,theta,0);   //the angle between the camera normal and the blob (deg)
-    //find the transformation matrix from camera frame to ground.
-    Matx33d Mbody = GimbalToBody(gimbal);
-
-    Matx33d MGnd;
-    if(m_demo_mode){
-        MGnd = LevelToGround(imu_data);    //Disable the pitch and roll in simulation
-    }else{
-        MGnd = BodyToGround(imu_data);      //Enable them during live tests
-    }
-    //Matx33d Mstable = BodyToLevel(imu_data);
-    //Matx33d MYaw = LevelToGround(imu_data);
-    //Matx33d MGnd = BodyToGround(imu_data);
-
-    Matx33d axes (
-        0.5, 0,   0,
-        0,   0.5, 0,
-        0,   0,   0.0); //totally unknown depth
-    Vec3d vect (0,0,0);
-    Distrib occular_ray = {axes,vect};
-
-    occular_ray = stretchDistrib(occular_ray, 10);   //how big? we can't have conical distributions yet.
-
-    occular_ray = rotateDistrib(occular_ray, Mblob);
-    occular_ray = rotateDistrib(occular_ray, Mbody);
-    occular_ray = rotateDistrib(occular_ray, MGnd);
+    Coord3D copterloc = {pos->fix.lat, pos->fix.lon, pos->fix.alt};
+    return ObservationFromRay(sample_time, GroundFromGPS(copterloc), CameraToGround(gimbal, imu_data), object);
+}
 
+/**
+ * Create observation structures for all the blobs of colour seen in one frame.
+ * The pose of the camera is only worked out once for the frame.
+ * 
+ * @param [in] pos The position of the copter.
+ * @param [in] gimbal The gimbal angle.
+ * @param [in] imu_data The pitch and roll of the copter
+ * @param [in] objects The detected objects.
+ * @param [out] observations The observations (one per object, in order). Reuses the vector's storage.
+ */
+void ObjectTracker::ObservationsFromImageCoords(TIME_TYPE sample_time, GPSData *pos, EulerAngle *gimbal, IMUData *imu_data, const std::vector<ObjectInfo> &objects, std::vector<Observation> *observations){
     Coord3D copterloc = {pos->fix.lat, pos->fix.lon, pos->fix.alt};
-    occular_ray = translateDistrib(occular_ray, GroundFromGPS(copterloc));
+    Vec3d origin = GroundFromGPS(copterloc);
+    Matx33d Mcam = CameraToGround(gimbal, imu_data);
 
-    Matx33d zeroAxes ( 
-        0, 0, 0,
-        0, 0, 0,
-        0, 0, 0); //totally unknown
-    Distrib zeroDistrib = {zeroAxes,vect};
+    observations->resize(objects.size());
+    for(size_t i=0; i<objects.size(); i++){
+        (*observations)[i] = ObservationFromRay(sample_time, origin, Mcam, &objects[i]);
+    }
+}
+
+/**
+ * Create an observation structure from the ray through a blob of colour.
+ * 
+ * @param [in] origin Where the camera is, in ground coordinates.
+ * @param [in] Mcam The transformation from camera to ground coordinates.
+ * @param [in] object The detected object.
+ */
+Observation ObjectTracker::ObservationFromRay(TIME_TYPE sample_time, const Vec3d &origin, const Matx33d &Mcam, const ObjectInfo *object){
+    //The direction to the blob in the camera frame. This is the camera normal rotated by
+    //phi = -atan2(x, L) (roll) then theta = atan2(y, L) (pitch), without the trig.
+    double L = FOCAL_LENGTH * object->image_width;
+    double hx = sqrt(object->position.x*object->position.x + L*L);
+    double hy = sqrt(object->position.y*object->position.y + L*L);
+    Vec3d dir = Mcam * Vec3d((object->position.y/hy) * (L/hx), object->position.x/hx, (L/hy) * (L/hx));
+
+    //totally unknown depth, sigma of 10 across the ray (we can't have conical distributions yet)
+    double across = 0.5/(10*10);
+    Distrib occular_ray;
+    occular_ray.axes = across * SymMat3(
+        1 - dir(0)*dir(0), 1 - dir(1)*dir(1), 1 - dir(2)*dir(2),
+        -dir(1)*dir(2), -dir(0)*dir(2), -dir(0)*dir(1));
+    occular_ray.vect = origin;
+
+    Distrib zeroDistrib = {SymMat3(), Vec3d(0,0,0)};   //totally unknown
 
     Observation imageObservation;
     imageObservation.location = occular_ray;
@@ -484,22 +568,7 @@ Observation ObjectTracker::ObservationFromImageCoords(TIME_TYPE sample_time, GPS
     imageObservation.source = CAMERA_BLOB;
     imageObservation.camDetection = *object;
     imageObservation.sample_time = sample_time;
-
-
-    //Distrib estLocation = combineDistribs(occular_ray, AssumptionGroundLevel().location);
-    //Vec3d C = GroundFromGPS(copterloc);
-    //Vec3d B = estLocation.vect;
-    //Vec3d V = B-C;
-    //Matx33d &A = estLocation.axes;
-    //LogSimple(LOG_DEBUG, " detection:");
-    //LogSimple(LOG_DEBUG, " at copter [%.4f,%.4f,%.4f]", B(0),B(1),B(2));
-    //LogSimple(LOG_DEBUG, " at object [%.4f,%.4f,%.4f]", C(0),C(1),C(2));
-    //LogSimple(LOG_DEBUG, " at relative [%.4f,%.4f,%.4f]", V(0),V(1),V(2));
-    //LogSimple(LOG_DEBUG, " with covariance\n\t\t\t\t[%.4f,%.4f,%.4f\n\t\t\t\t %.4f,%.4f,%.4f\n\t\t\t\t %.4f,%.4f,%.4f]", A(0,0),A(1,0),A(2,0),A(0,1),A(1,1),A(2,1),A(0,2),A(1,2),A(2,2));
-
-
     return imageObservation;
-
 }
 
 /**
@@ -513,26 +582,14 @@ Observation ObjectTracker::ObservationFromImageCoords(TIME_TYPE sample_time, GPS
 Observation ObjectTracker::ObservationFromLidar(TIME_TYPE sample_time, GPSData *pos, EulerAngle *gimbal, IMUData *imu_data, double lidar_range){
     Matx33d MLidar = rotationMatrix(-6,-3,0);   //the angle between the camera and the lidar (deg)
     //find the transformation matrix from camera frame to ground.
-    Matx33d Mbody = GimbalToBody(gimbal);
-    
-    Matx33d MGnd;
-    if(m_demo_mode){
-        MGnd = LevelToGround(imu_data);    //Disable the pitch and roll in simulation
-    }else{
-        MGnd = BodyToGround(imu_data);      //Enable them during live tests
-    }
-    //Matx33d Mstable = BodyToLevel(imu_data);
-    //Matx33d MYaw = LevelToGround(imu_data);
-    //Matx33d MGnd = BodyToGround(imu_data);
+    Matx33d Mcam = CameraToGround(gimbal, imu_data);
 
     Distrib lidarspot = generatedistrib();
     
     double spotWidth = lidar_range*sin(DEG2RAD(3));
     lidarspot = stretchDistrib(lidarspot, spotWidth, spotWidth, 0.02);
     lidarspot = translateDistrib(lidarspot, 0,0,lidar_range);
-    lidarspot = rotateDistrib(lidarspot, MLidar);
-    lidarspot = rotateDistrib(lidarspot, Mbody);
-    lidarspot = rotateDistrib(lidarspot, MGnd);
+    lidarspot = rotateDistrib(lidarspot, Mcam * MLidar);
     Coord3D copterloc = {pos->fix.lat, pos->fix.lon, pos->fix.alt};
     lidarspot = translateDistrib(lidarspot, GroundFromGPS( copterloc ));
 
@@ -598,83 +655,55 @@ Observation ObjectTracker::AssumptionGroundLevel(){
 }
 
 /**
- * Try to match observations to objects.
- * @param [in] visibles The observations, 
- * @param [in] knownThings The objects.
+ * Match observations to objects, making new objects of the observations that don't match.
+ * Observations are only considered for objects within the association gate (Mahalanobis
+ * distance), and the matching minimises the total distance over all the pairs, so the
+ * labels stay consistent when several objects are in view.
+ * @param [in] visibles The observations.
+ * @param [in, out] knownThings The objects.
+ * @return true.
  */
 bool ObjectTracker::matchObsToObj(std::vector<Observation> &visibles, std::vector<Observations> &knownThings){
     Observation theGround = AssumptionGroundLevel();
 
-    uint n_obj = knownThings.size();
-    uint n_obs = visibles.size();
-    uint m_obs = n_obs;
-    LogSimple(LOG_DEBUG,"Sorting out %d objects and %d observations", n_obj, n_obs);
-//************ Warning, Coding Tired.
-//              Sorry about the segfaults and memory leaks
-//              I'm using integers were I should have pointers.
-    double *fits = new double [n_obj * n_obs];
-    if(fits==NULL) return false;
-    uint *obj_index = new uint [n_obj];
-    if(obj_index==NULL) {
-        delete[] fits;
-        return false;
-    }
-    uint *obs_index = new uint [n_obs];
-    if(obs_index==NULL){
-        delete[] fits;
-        delete[] obj_index;
-        return false;
-    }
+    size_t n_obj = knownThings.size();
+    size_t n_obs = visibles.size();
+    LogSimple(LOG_DEBUG,"Sorting out %d objects and %d observations", (int)n_obj, (int)n_obs);
 
-    uint best_obj = 0;  //the index of the best fitting object
-    uint best_obs = 0;  //the index of the best fitting observation
-    double fit;
-    
-    //compute all the fit factors
-    for(uint j=0; j<n_obs; j++){
-        obs_index[j] = j;
-    }
-    for(uint i=0; i<n_obj; i++){
-        obj_index[i] = i;
-        for(uint j=0; j<visibles.size(); j++){
-            fits[i*m_obs + j] = knownThings.at(i).getSameProbability(visibles.at(j));
-        }
+    m_assoc_locations.resize(n_obs);
+    m_assoc_distances.resize(n_obs);
+    for(size_t j=0; j<n_obs; j++){
+        m_assoc_locations[j] = visibles[j].location;
     }
 
-    while((n_obj>0) && (n_obs>0)){
-        //LogSimple(LOG_DEBUG,"Remainder: %d objects and %d observations", n_obj, n_obs);
-        fit = 0;
-        for(uint i=0; i<n_obj; i++){
-            for(uint j=0; j<n_obs; j++){
-                if( fit < fits[obj_index[i]*m_obs + obs_index[j]]){
-                    fit = fits[obj_index[i]*m_obs + obs_index[j]];     //take only the best fit
-                    best_obj = obj_index[i];
-                    best_obs = obs_index[j];
-                }
+    //only the pairs inside the gate are candidates
+    m_assoc.Reset(n_obj, n_obs);
+    for(size_t i=0; i<n_obj; i++){
+        knownThings[i].getDistances(m_assoc_locations.data(), n_obs, m_assoc_distances.data());
+        for(size_t j=0; j<n_obs; j++){
+            if(m_assoc_distances[j] < association_gate){
+                m_assoc.Set(i, j, m_assoc_distances[j]);
             }
         }
-        if(fit>OVERLAP_CONFIDENCE){
-            LogSimple(LOG_DEBUG,"Matching observation %d to object %d", best_obs, best_obj);
-            knownThings.at(best_obj).appendObservation(visibles.at(best_obs));
-            knownThings.at(best_obj).appendObservation(theGround);   //maintain the assertion that the object is on or near the ground.
-            best_obj = obj_index[--n_obj];  //remove one of each (put the tail in the gap)
-            best_obs = obs_index[--n_obs];
-        }else{
-            LogSimple(LOG_DEBUG,"Confidence below threshold, creating %d objects", n_obs);
-            break;
+    }
+    m_assoc.Solve();
+
+    for(size_t i=0; i<n_obj; i++){
+        int j = m_assoc.RowMatch(i);
+        if(j >= 0){
+            LogSimple(LOG_DEBUG,"Matching observation %d to object %d", j, (int)i);
+            knownThings[i].appendObservation(visibles[j]);
+            knownThings[i].appendObservation(theGround);   //maintain the assertion that the object is on or near the ground.
         }
     }
-    if(n_obj == 0) LogSimple(LOG_DEBUG,"Run out of objects, Creating %d objects", n_obs);
-    for(uint j=0; j<n_obs; j++){
-        LogSimple(LOG_DEBUG,"Adding new object from obs %d", obs_index[j]);
-        Observations newThing(theGround);   //starting assumption
-        newThing.appendObservation(visibles.at(obs_index[j]));
-        knownThings.push_back(newThing);
-        LogSimple(LOG_DEBUG,"Done sorting");
+    for(size_t j=0; j<n_obs; j++){
+        if(m_assoc.ColMatch(j) < 0){
+            LogSimple(LOG_DEBUG,"Adding new object from obs %d", (int)j);
+            Observations newThing(theGround, m_sighting_log);   //starting assumption
+            newThing.appendObservation(visibles[j]);
+            knownThings.push_back(newThing);
+        }
     }
-    delete[] fits;
-    delete[] obj_index;
-    delete[] obs_index;
     return true;
 }
 
@@ -683,7 +712,7 @@ bool ObjectTracker::ChooseObsToObj(std::vector<Observation> &visibles, std::vect
     if(knownThings.size() <= 0){
         if(visibles.size() > 0){    //add the first thing on the list
             LogSimple(LOG_DEBUG,"Adding new object from obs %d", 0);
-            Observations newThing(theGround);   //starting assumption
+            Observations newThing(theGround, m_sighting_log);   //starting assumption
             newThing.appendObservation(visibles.at(0));
             knownThings.push_back(newThing);
         }
@@ -707,8 +736,11 @@ bool ObjectTracker::ChooseObsToObj(std::vector<Observation> &visibles, std::vect
 bool ObjectTracker::NoObjectMemory(std::vector<Observation> &visibles, std::vector<Observations> &knownThings){
     Observation theGround = AssumptionGroundLevel();
     if(visibles.size() > 0){    //add the first thing on the list
+        for(uint i=0; i<knownThings.size(); i++){
+            knownThings.at(i).spillSightings();
+        }
         knownThings.clear();    //destroy previous objects
-        Observations newThing(theGround);   //starting assumption
+        Observations newThing(theGround, m_sighting_log);   //starting assumption
         newThing.appendObservation(visibles.at(0));
         knownThings.push_back(newThing);
     }
@@ -20,10 +20,16 @@ using std::this_thread::sleep_for;
 
 namespace picopter{
 
-Observations::Observations(Observation firstSighting) {
-
+Observations::Observations(Observation firstSighting, DataLog *log)
+: sightings(SIGHTING_HISTORY)
+, sightings_head(0)
+, sightings_count(0)
+, sightings_total(0)
+, detections_total(0)
+, sightings_log(log)
+{
     accumulator = firstSighting;
-    sightings.push_back(firstSighting);
+    pushSighting(firstSighting);
 
 //    appendObservation(firstSighting);
 }
@@ -32,21 +38,22 @@ Observations::Observations(Observation firstSighting) {
 //estimate the probability the given observation is of the same object
 //return the integral of  e^((x-l1).t()*A*(x-l1)) * e^((x-l2).t()*B*(x-l2))
 double Observations::getSameProbability(Observation observation){ 
-    //In many cases, we can't invert the matrices, directly sample them instead.
-    Distrib C;
-    C.axes = (accumulator.location.axes.inv() + observation.location.axes.inv()).inv();
-    C.vect = accumulator.location.vect - observation.location.vect;
-    double retval = exp(-(((C.vect).t() * (C.axes * C.vect))(0)));
-    //double retval;
-    //retval  = sampleDistrib(observation.location, accumulator.location.vect);
-    //retval *= sampleDistrib(accumulator.location, observation.location.vect);
-    
-    return retval;
+    return overlapDistribs(accumulator.location, observation.location);
+}
+
+//estimate the probability that each of the given observation locations is of this object
+void Observations::getSameProbabilities(const Distrib *locations, size_t n, double *out){
+    overlapDistribs(accumulator.location, locations, n, out);
+}
+
+//how far (in standard deviations, squared) each of the given observation locations is from this object
+void Observations::getDistances(const Distrib *locations, size_t n, double *out){
+    distanceDistribs(accumulator.location, locations, n, out);
 }
 
 //add another sighting to this object
 void Observations::appendObservation(Observation observation){
-    sightings.push_back(observation);
+    pushSighting(observation);
 
     accumulator.location = combineDistribs(accumulator.location, observation.location);
     accumulator.velocity = combineDistribs(accumulator.velocity, observation.velocity);
@@ -72,212 +79,169 @@ void Observations::updateObject(TIME_TYPE timestep){
 
 
 //remove an observation from this object
-void Observations::removeObservation(Observation observation){     
-    //riffle through the sightings until we find an identical pointer to this observation?
-        //remove it, replace with the tail?
-        //sightings.at(n) = pop_back(); //fast, breaks order
-        //sightings.erase(n);   //slow, preserves order
-
-}
-
-TIME_TYPE Observations::lastObservation(){
-    return accumulator.sample_time;
-}
-
-Distrib Observations::getLocation(){
-    return accumulator.location;
+//Only the remembered (recent) sightings can be removed. The removal is exact unless the
+//object has been moved on (updateObject) since the sighting was added.
+bool Observations::removeObservation(Observation observation){
+    //riffle through the sightings, newest first, until we find this observation
+    for(size_t k=0; k<sightings_count; k++){
+        size_t i = (sightings_head + SIGHTING_HISTORY - 1 - k) % SIGHTING_HISTORY;
+        Sighting &sighting = sightings[i];
+        if((sighting.sample_time == observation.sample_time) &&
+           (sighting.source == observation.source) &&
+           (sighting.location.vect == observation.location.vect)){
+
+            accumulator.location = separateDistribs(accumulator.location, sighting.location);
+            accumulator.velocity = separateDistribs(accumulator.velocity, sighting.velocity);
+
+            //close the gap, preserving the order
+            for(; k>0; k--){
+                size_t next = (i + 1) % SIGHTING_HISTORY;
+                sightings[i] = sightings[next];
+                i = next;
+            }
+            sightings_head = (sightings_head + SIGHTING_HISTORY - 1) % SIGHTING_HISTORY;
+            sightings_count--;
+            return true;
+        }
+    }
+    return false;
 }
 
-
-//generate an distrib struct from a primitive and operators
-
-Distrib generatedistrib(){
-    Matx33d axes ( 
-        0.5, 0, 0,
-        0, 0.5, 0,
-        0, 0, 0.5);
-    Vec3d vect (0,0,0);
-    Distrib primitive = {axes,vect};
-    return primitive;
-}
-Distrib generateDistrib(DistribParams params){
-    //primitive is a, spherical distribution sigma=1
-    // = e^-(0.5x^2 + 0.5y^2 + 0.5 z^2 + 0yz + 0xz + 0yx + 0x + 0y + 0z + 0);
-
-    Distrib primitive = generatedistrib();
-//    for (int i = 0; i < 3; i++) {
-//        primitive.coeffs[i] = 0.5;
-//    }
-//    for (int i = 3; i < _distrib_coeffs; i++) {
-//        primitive.coeffs[i] = 0;
-//    }
-    Distrib dS = stretchDistrib(primitive, params.sigma_x, params.sigma_y, params.sigma_z);
-    Distrib dR = rotateDistribEuler(dS, params.yaw, params.pitch, params.roll);
-    Distrib dT = translateDistrib(dR, params.x, params.y, params.z);
-
-    return dT;
+//write the remembered sightings to the log, oldest first, and forget them
+void Observations::spillSightings(){
+    for(size_t k=sightings_count; k>0; k--){
+        spillSighting(sightings[(sightings_head + SIGHTING_HISTORY - k) % SIGHTING_HISTORY]);
+    }
+    sightings_count = 0;
 }
 
+//remember a sighting, evicting (and logging) the oldest if the ring is full
+void Observations::pushSighting(const Observation &observation){
+    if(sightings_count == SIGHTING_HISTORY){
+        spillSighting(sightings[sightings_head]);
+    }else{
+        sightings_count++;
+    }
 
-//calculate the centre and covariance widths of this object
-DistribParams getDistribParams(Distrib A){
-    DistribParams D;
-    //sigma values are the eigenvalues
-    D.x = -A.vect(0);
-    D.y = -A.vect(1);
-    D.y = -A.vect(2);
-    return D;
-}
-double sampleDistrib(Distrib &A, Vec3d &B){
-    return exp(-(((A.vect-B).t() * (A.axes * (A.vect-B)))(0)));
+    Sighting &sighting = sightings[sightings_head];
+    sighting.sample_time = observation.sample_time;
+    sighting.source = observation.source;
+    sighting.location = observation.location;
+    sighting.velocity = observation.velocity;
+    sighting.bounds = (observation.source == CAMERA_BLOB) ? observation.camDetection.bounds : Rect();
+
+    sightings_head = (sightings_head + 1) % SIGHTING_HISTORY;
+    sightings_total++;
+    if(observation.source != ASSUMPTION){
+        detections_total++;
+    }
 }
 
-//combine two distributions (as though statistically independent, so beware of biases)
-Distrib combineDistribs(Distrib A, Distrib B){
-    Distrib C;
-    C.axes = A.axes + B.axes;
-    if(determinant(C.axes) <= DBL_MIN){
-        std::cout << "Combine result is a non-invertible matrix!" << std::endl;
+//log a sighting: time (s), source, centre, the location's axes and the camera bounds
+void Observations::spillSighting(const Sighting &sighting){
+    if(sightings_log){
+        const Vec3d &V = sighting.location.vect;
+        const Matx33d A = sighting.location.axes;
+        const Rect &R = sighting.bounds;
+        sightings_log->Write(": %.6f %d (%.4f, %.4f, %.4f) [%g %g %g; %g %g %g; %g %g %g] {%d %d %d %d}",
+            duration_cast<microseconds>(sighting.sample_time).count()/1000000.0, sighting.source,
+            V(0), V(1), V(2),
+            A(0,0), A(0,1), A(0,2), A(1,0), A(1,1), A(1,2), A(2,0), A(2,1), A(2,2),
+            R.x, R.y, R.width, R.height);
     }
-
-    C.vect = C.axes.inv() * (A.axes * A.vect + B.axes * B.vect);    //takes two lines to prove
-    //you can see here how if B is a zero matrix, it fully cancels out of this equation.
-    //If no velocity or acceleration data is returned by a given sensor, the variance matrix is set to zeroes
-    return C;
 }
 
-//translate a distrib struct from the origin
-
-Distrib translateDistrib(Distrib A, Vec3d offset){
-    Distrib D;
-    D.axes = A.axes;
-    D.vect = A.vect + offset;
-    return D;
+TIME_TYPE Observations::lastObservation(){
+    return accumulator.sample_time;
 }
 
-
-//rotate a distrib struct about the origin
-
-Distrib rotateDistribEuler(Distrib A, double roll, double pitch, double yaw){
-    Distrib D;
-    Matx33d R_total = rotationMatrix(roll, pitch, yaw);
-    return rotateDistrib(A, R_total);
+unsigned long Observations::sightingCount(){
+    return sightings_total;
 }
 
-Matx33d rotationMatrix(double roll, double pitch, double yaw){
-    double a;
-    a = DEG2RAD(roll);
-    Matx33d Rx(1,      0,       0,
-                    0, cos(a), -sin(a),
-                    0, sin(a),  cos(a));
-    a = DEG2RAD(pitch);
-    Matx33d Ry( cos(a), 0,  sin(a),
-                          0, 1,       0,
-                    -sin(a), 0,  cos(a));
-    a = DEG2RAD(yaw);
-    Matx33d Rz(cos(a), -sin(a), 0,
-                    sin(a),  cos(a), 0,
-                        0,        0, 1);
-    return Rz*Ry*Rx;
+unsigned long Observations::detectionCount(){
+    return detections_total;
 }
 
-Distrib rotateDistrib(Distrib A, Matx33d Mrot){
-    Distrib D;
-    D.axes = Mrot * A.axes * Mrot.inv();
-    D.vect = Mrot * A.vect;
-
-    return D;
+Distrib Observations::getLocation(){
+    return accumulator.location;
 }
 
-//stretch a distrib struct about the origin by a ratio
-Distrib stretchDistrib(Distrib A, double sx, double sy, double sz){
-    Distrib D;
-
-    Matx33d S(
-        sx, 0, 0,
-        0, sy, 0,
-        0, 0, sz);
-
-    D.vect = S * A.vect;    //increase distance from origin
-    D.axes = S.inv() * S.inv() * A.axes;    //increase the size
-
-    return D;
-}
-    
-    //we want the convolution of e^((x-l1).t()*A*(x-l1)), e^((x-l2).t()*B*(x-l2))
-    //The translation of one Distrib by another. Can be used to encode velocity uncertainty
-Distrib vectorSum(Distrib A, Distrib B){
 
-    if((determinant(A.axes) <= DBL_MIN) || (determinant(B.axes) <= DBL_MIN)){
-        std::cout << "vector sum non-invertible matrix!" << std::endl;
-        return A;
+//screen the colour of a distribution onto rows [row0,row1) and columns [col0,col1) of the map
+static void rasterRows(Mat *mat, const Distrib *dist, const int colour[3], double scale, int row0, int row1, int col0, int col1)
+{
+    //always sample in the plane of the measurement, where the density is e^-(a dx^2 + 2b dx dy + c dy^2)
+    const double a = dist->axes.xx, b = dist->axes.xy, c = dist->axes.yy;
+    for (int i = row0; i < row1; ++i) {
+        double dy = (i-(mat->rows/2.0))*scale - dist->vect[1];
+        Vec4b *row = mat->ptr<Vec4b>(i);
+        for (int j = col0; j < col1; ++j) {
+            double dx = (j-(mat->cols/2.0))*scale - dist->vect[0];
+            double p = exp(-(a*dx*dx + 2*b*dx*dy + c*dy*dy));
+            Vec4b& rgba = row[j];
+
+            ////screen layering: 1 - (1-C)(1-rgba), in integers
+            for (int k = 0; k < 3; ++k) {
+                int C = (int)(colour[k] * p);
+                rgba[k] = (uchar)(UCHAR_MAX - ((UCHAR_MAX - C)*(UCHAR_MAX - rgba[k]) + UCHAR_MAX/2)/UCHAR_MAX);
+            }
+            rgba[3] = UCHAR_MAX;
+        }
     }
-    
-    Distrib C;
-    C.vect = A.vect + B.vect;
-    C.axes = (A.axes.inv() + B.axes.inv()).inv();
-    return C;
-}
-
-    //estimate the velocity from two locations and a time difference
-    //estimate the acceleration from two velocities and a time difference
-    //This is basicaly the same as the vectorSum. These won't make reversible transformations
-Distrib changeStep(Distrib newLoc, Distrib oldLoc, TIME_TYPE timestep){
-    Distrib estVel;
-    estVel.vect = newLoc.vect - oldLoc.vect;    //difference in position
-    estVel.axes = (newLoc.axes.inv() + oldLoc.axes.inv()).inv();    //change in variance is same as vectorSum
-
-    estVel = stretchDistrib(estVel, TICKS_PER_SEC/(double)(timestep.count()));
-    return estVel;
 }
 
-
-void rasterDistrib(Mat *mat, Distrib *dist, Vec4b colour, double scale)
+void rasterDistrib(Mat *mat, Distrib *dist, Vec4b colour, double scale, ThreadPool *pool, int bands)
 {
-    for (int i = 0; i < mat->rows; ++i) {
-        for (int j = 0; j < mat->cols; ++j) {
-            Vec4b& rgba = mat->at<Vec4b>(i, j);
-            Vec4b C = colour;
-            
-            Vec3d B((j-(mat->cols/2.0))*scale, (i-(mat->rows/2.0))*scale,dist->vect[2]);    //always sample in the plane of the measurement
-
-            C(0) = colour(0) * sampleDistrib(*dist, B);
-            C(1) = colour(1) * sampleDistrib(*dist, B);
-            C(2) = colour(2) * sampleDistrib(*dist, B);
-
-            ////screen layering
-            rgba[0] = saturate_cast<uchar>(
-                (1.0 -(
-                    (1.0-((double)C[0]/(double)UCHAR_MAX))*
-                    (1.0-((double)rgba[0]/(double)UCHAR_MAX))
-                 ))* UCHAR_MAX);
-            rgba[1] = saturate_cast<uchar>(
-                (1.0 -(
-                    (1.0-((double)C[1]/(double)UCHAR_MAX))*
-                    (1.0-((double)rgba[1]/(double)UCHAR_MAX))
-                 ))* UCHAR_MAX);
-            rgba[2] = saturate_cast<uchar>(
-                (1.0 -(
-                    (1.0-((double)C[2]/(double)UCHAR_MAX))*
-                    (1.0-((double)rgba[2]/(double)UCHAR_MAX))
-                 ))* UCHAR_MAX);
-            rgba[3] = UCHAR_MAX;
+    const int rgb[3] = {colour(0), colour(1), colour(2)};
+    int brightest = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+    if (brightest == 0 || mat->rows == 0 || mat->cols == 0) {
+        return;
+    }
 
-            //rgba[0] = UCHAR_MAX;
-            //rgba[1] = saturate_cast<uchar>((float (mat.cols - j)) / ((float)mat.cols) * UCHAR_MAX);
-            //rgba[2] = saturate_cast<uchar>((float (mat.rows - i)) / ((float)mat.rows) * UCHAR_MAX);
-            //rgba[3] = saturate_cast<uchar>(0.5 * (rgba[1] + rgba[2]));
+    //Screening with a colour that rounds down to zero changes nothing, so only the ellipse where
+    //the density is at least 1/brightest needs drawing (a bit over 3 sigma).
+    int row0 = 0, row1 = mat->rows, col0 = 0, col1 = mat->cols;
+    const double a = dist->axes.xx, b = dist->axes.xy, c = dist->axes.yy;
+    double det = a*c - b*b;
+    if (a > 0 && c > 0 && det > 0) {
+        double t = log((double)brightest);
+        double ex = sqrt(t*c/det) / scale, ey = sqrt(t*a/det) / scale;   //half widths, in pixels
+        double cx = dist->vect[0]/scale + mat->cols/2.0, cy = dist->vect[1]/scale + mat->rows/2.0;
+        col0 = std::max(col0, (int)std::max(-1.0, floor(cx - ex)));
+        col1 = std::min(col1, (int)std::min((double)mat->cols, ceil(cx + ex) + 1));
+        row0 = std::max(row0, (int)std::max(-1.0, floor(cy - ey)));
+        row1 = std::min(row1, (int)std::min((double)mat->rows, ceil(cy + ey) + 1));
+        if (col0 >= col1 || row0 >= row1) {
+            return; //off the map
         }
     }
+
+    //Split the rows into bands; the first is done on this thread while the pool does the rest.
+    int rows = row1 - row0;
+    bands = pool ? std::max(1, std::min(bands, rows)) : 1;
+    std::vector<std::future<void>> ret;
+    ret.reserve(bands - 1);
+    for (int i = 1; i < bands; i++) {
+        int start = row0 + (i * rows) / bands;
+        int end = row0 + ((i + 1) * rows) / bands;
+        ret.emplace_back(pool->enqueue([mat, dist, &rgb, scale, start, end, col0, col1] {
+            rasterRows(mat, dist, rgb, scale, start, end, col0, col1);
+        }));
+    }
+    rasterRows(mat, dist, rgb, scale, row0, row0 + rows / bands, col0, col1);
+    for (auto &&result : ret) {
+        result.get();
+    }
 }
 
-void storeDistrib(Mat* mat, std::string filename){
+void storeDistrib(Mat* mat, std::string filename, int compression){
     //Mat mat(rows, cols, CV_8UC4);
     //rasterDistrib(mat,dist);
 
     vector<int> compression_params;
     compression_params.push_back(CV_IMWRITE_PNG_COMPRESSION);
-    compression_params.push_back(9);
+    compression_params.push_back(compression);
 
     imwrite(filename, *mat, compression_params);
 
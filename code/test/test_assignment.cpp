@@ -0,0 +1,81 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "assignment.h"
+#include <algorithm>
+#include <random>
+
+using namespace picopter;
+
+TEST(AssignmentTest, TestBeatsGreedy) {
+    //Greedy takes (0,0) first, then has to pay 10 for (1,1).
+    Assignment a;
+    a.Reset(2, 2);
+    a.Set(0, 0, 1);
+    a.Set(0, 1, 2);
+    a.Set(1, 0, 2);
+    a.Set(1, 1, 10);
+
+    EXPECT_EQ(2u, a.Solve());
+    EXPECT_EQ(1, a.RowMatch(0));
+    EXPECT_EQ(0, a.RowMatch(1));
+    EXPECT_EQ(1, a.ColMatch(0));
+    EXPECT_DOUBLE_EQ(4, a.Cost());
+}
+
+TEST(AssignmentTest, TestGating) {
+    //Row 1 can only have column 0, so row 0 must take its worse option.
+    //Row 2 and column 3 have nothing allowed at all.
+    Assignment a;
+    a.Reset(3, 4);
+    a.Set(0, 0, 1);
+    a.Set(0, 2, 5);
+    a.Set(1, 0, 3);
+
+    EXPECT_EQ(2u, a.Solve());
+    EXPECT_EQ(2, a.RowMatch(0));
+    EXPECT_EQ(0, a.RowMatch(1));
+    EXPECT_EQ(-1, a.RowMatch(2));
+    EXPECT_EQ(-1, a.ColMatch(1));
+    EXPECT_EQ(-1, a.ColMatch(3));
+    EXPECT_DOUBLE_EQ(8, a.Cost());
+
+    //The buffers are reused for the next problem.
+    a.Reset(1, 1);
+    EXPECT_EQ(0u, a.Solve());
+    EXPECT_EQ(-1, a.RowMatch(0));
+}
+
+TEST(AssignmentTest, TestBruteForce) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> cost(0, 10);
+    Assignment a;
+
+    for (int trial = 0; trial < 50; trial++) {
+        int rows = 1 + trial % 5, cols = 1 + (trial / 5) % 5;
+        std::vector<double> c(rows * cols);
+        a.Reset(rows, cols);
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                c[i * cols + j] = cost(rng);
+                a.Set(i, j, c[i * cols + j]);
+            }
+        }
+        EXPECT_EQ(static_cast<size_t>(std::min(rows, cols)), a.Solve());
+
+        //Try every way of pairing the shorter side with the longer one.
+        int n = std::min(rows, cols), m = std::max(rows, cols);
+        std::vector<int> perm(m);
+        for (int k = 0; k < m; k++) {
+            perm[k] = k;
+        }
+        double best = 1e9;
+        do {
+            double total = 0;
+            for (int k = 0; k < n; k++) {
+                total += rows <= cols ? c[k * cols + perm[k]] : c[perm[k] * cols + k];
+            }
+            best = std::min(best, total);
+        } while (std::next_permutation(perm.begin(), perm.end()));
+        EXPECT_NEAR(best, a.Cost(), 1e-9);
+    }
+}
@@ -0,0 +1,168 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "camera_blobs.h"
+#include <algorithm>
+
+using namespace picopter;
+
+class BlobsTest : public ::testing::Test {
+    protected:
+        BlobsTest() {
+            LogInit();
+        }
+
+        /** Direct (slow) closing with a square element. **/
+        static std::vector<uint8_t> Close(const std::vector<uint8_t> &img, int w, int h, int size) {
+            int before = size / 2, after = size - 1 - size / 2;
+            std::vector<uint8_t> dilated(w * h), closed(w * h);
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    bool set = false;
+                    for (int dy = -before; dy <= after; dy++) {
+                        for (int dx = -before; dx <= after; dx++) {
+                            int yy = y + dy, xx = x + dx;
+                            if (yy >= 0 && yy < h && xx >= 0 && xx < w && img[yy * w + xx]) {
+                                set = true;
+                            }
+                        }
+                    }
+                    dilated[y * w + x] = set;
+                }
+            }
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    bool set = true;
+                    for (int dy = -before; dy <= after; dy++) {
+                        for (int dx = -before; dx <= after; dx++) {
+                            int yy = y + dy, xx = x + dx;
+                            if (yy >= 0 && yy < h && xx >= 0 && xx < w && !dilated[yy * w + xx]) {
+                                set = false;
+                            }
+                        }
+                    }
+                    closed[y * w + x] = set ? 255 : 0;
+                }
+            }
+            return closed;
+        }
+
+        /** Direct (slow) 8-connected flood fill labelling. **/
+        static std::vector<Blob> Flood(const std::vector<uint8_t> &img, int w, int h) {
+            std::vector<Blob> blobs;
+            std::vector<bool> seen(w * h, false);
+            for (int i = 0; i < w * h; i++) {
+                if (!img[i] || seen[i]) {
+                    continue;
+                }
+                Blob b{0, 0, 0, w, h, -1, -1};
+                std::vector<int> stack(1, i);
+                seen[i] = true;
+                while (!stack.empty()) {
+                    int p = stack.back(), x = p % w, y = p / w;
+                    stack.pop_back();
+                    b.m00++;
+                    b.m10 += x;
+                    b.m01 += y;
+                    b.min_x = std::min(b.min_x, x);
+                    b.min_y = std::min(b.min_y, y);
+                    b.max_x = std::max(b.max_x, x);
+                    b.max_y = std::max(b.max_y, y);
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int xx = x + dx, yy = y + dy;
+                            if (xx >= 0 && xx < w && yy >= 0 && yy < h &&
+                                img[yy * w + xx] && !seen[yy * w + xx]) {
+                                seen[yy * w + xx] = true;
+                                stack.push_back(yy * w + xx);
+                            }
+                        }
+                    }
+                }
+                blobs.push_back(b);
+            }
+            return blobs;
+        }
+
+        static bool BlobLess(const Blob &a, const Blob &b) {
+            if (a.min_y != b.min_y) return a.min_y < b.min_y;
+            return a.min_x < b.min_x;
+        }
+
+        static void ExpectSame(std::vector<Blob> a, std::vector<Blob> b) {
+            ASSERT_EQ(a.size(), b.size());
+            std::sort(a.begin(), a.end(), BlobLess);
+            std::sort(b.begin(), b.end(), BlobLess);
+            for (size_t i = 0; i < a.size(); i++) {
+                EXPECT_EQ(a[i].m00, b[i].m00);
+                EXPECT_EQ(a[i].m10, b[i].m10);
+                EXPECT_EQ(a[i].m01, b[i].m01);
+                EXPECT_EQ(a[i].min_x, b[i].min_x);
+                EXPECT_EQ(a[i].min_y, b[i].min_y);
+                EXPECT_EQ(a[i].max_x, b[i].max_x);
+                EXPECT_EQ(a[i].max_y, b[i].max_y);
+            }
+        }
+};
+
+TEST_F(BlobsTest, TestShapes) {
+    //A U shape (joined at the bottom), a diagonal line and a single pixel.
+    const int w = 12, h = 8;
+    const char *rows[h] = {
+        "x..x......x.",
+        "x..x.....x..",
+        "x..x....x...",
+        "xxxx...x....",
+        "............",
+        "..........x.",
+        "............",
+        "............"
+    };
+    std::vector<uint8_t> img(w * h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            img[y * w + x] = rows[y][x] == 'x' ? 1 : 0;
+        }
+    }
+
+    BlobLabeller labeller;
+    std::vector<uint8_t> copy = img;
+    ASSERT_EQ(3u, labeller.Label(copy.data(), w, h, w));
+    ExpectSame(Flood(img, w, h), labeller.GetBlobs());
+
+    std::vector<Blob> largest;
+    ASSERT_EQ(2u, labeller.GetLargest(2, 0, &largest));
+    EXPECT_EQ(10, largest[0].m00);
+    EXPECT_EQ(4, largest[1].m00);
+    ASSERT_EQ(1u, labeller.GetLargest(4, 4, &largest));
+}
+
+TEST_F(BlobsTest, TestRandomClosing) {
+    srand(4321);
+    for (int size = 0; size <= 8; size += 4) {
+        BlobLabeller labeller(size);
+        for (int trial = 0; trial < 20; trial++) {
+            int w = 1 + rand() % 60, h = 1 + rand() % 40, stride = w + rand() % 5;
+            std::vector<uint8_t> img(w * h), mask(stride * h, 0xAA);
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    img[y * w + x] = (rand() % 7) == 0 ? 255 : 0;
+                    mask[y * stride + x] = img[y * w + x];
+                }
+            }
+
+            std::vector<uint8_t> expected = Close(img, w, h, std::max(1, size));
+            labeller.Label(mask.data(), w, h, stride);
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    ASSERT_EQ(expected[y * w + x], mask[y * stride + x])
+                        << "size " << size << " at " << x << "," << y;
+                }
+                //Padding between rows is left alone.
+                for (int x = w; x < stride; x++) {
+                    ASSERT_EQ(0xAA, mask[y * stride + x]);
+                }
+            }
+            ExpectSame(Flood(expected, w, h), labeller.GetBlobs());
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "distrib.h"
+
+using namespace picopter;
+using cv::Vec3d;
+using cv::Matx33d;
+
+TEST(DistribTest, TestCombineSeparate) {
+    DistribParams p1 = {1, 2, 3, 1, 2, 3, 30, 10, 5};
+    DistribParams p2 = {-2, 0, 1, 0.5, 0.5, 4, -45, 0, 20};
+    Distrib A = generatedistrib(p1);
+    Distrib B = generatedistrib(p2);
+
+    Distrib C = combineDistribs(A, B);
+    Distrib D = separateDistribs(C, B);
+    for (int i = 0; i < 3; i++) {
+        EXPECT_NEAR(A.vect(i), D.vect(i), 1e-9);
+        for (int j = 0; j < 3; j++) {
+            EXPECT_NEAR(A.axes(i,j), D.axes(i,j), 1e-9);
+        }
+    }
+
+    //The batch form gives the same answer.
+    Distrib both[] = {A, B};
+    Distrib E = combineDistribs(both, 2);
+    EXPECT_NEAR(C.vect(0), E.vect(0), 1e-9);
+    EXPECT_NEAR(C.vect(2), E.vect(2), 1e-9);
+}
+
+TEST(DistribTest, TestSingularCombine) {
+    //A camera sighting: known well in x and y, nothing known in z.
+    Distrib ray = {SymMat3(4, 4, 0, 0, 0, 0), Vec3d(3, -2, 0)};
+    //The ground: known in z only.
+    Distrib ground = {SymMat3(0, 0, 1, 0, 0, 0), Vec3d(0, 0, -5)};
+
+    Distrib C = combineDistribs(ray, ground);
+    EXPECT_NEAR(3, C.vect(0), 1e-9);
+    EXPECT_NEAR(-2, C.vect(1), 1e-9);
+    EXPECT_NEAR(-5, C.vect(2), 1e-9);
+
+    //Nothing known along the ray, so they agree exactly in overlap.
+    Distrib above = {SymMat3(4, 4, 0, 0, 0, 0), Vec3d(3, -2, 100)};
+    EXPECT_DOUBLE_EQ(1, overlapDistribs(ray, above));
+}
+
+TEST(DistribTest, TestConvolve) {
+    //For diagonal matrices, (A^-1 + B^-1)^-1 is ab/(a+b) on each axis.
+    SymMat3 a(1, 2, 4, 0, 0, 0);
+    SymMat3 b(3, 2, 0, 0, 0, 0);
+    SymMat3 c = convolveSym(a, b);
+    EXPECT_NEAR(0.75, c.xx, 1e-12);
+    EXPECT_NEAR(1, c.yy, 1e-12);
+    EXPECT_NEAR(0, c.zz, 1e-12);
+    EXPECT_NEAR(0, c.xy, 1e-12);
+
+    //Rotating both the matrix and the vector leaves the quadratic form be.
+    Matx33d r = rotationMatrix(20, -35, 70);
+    SymMat3 m = generatedistrib(DistribParams{0, 0, 0, 1, 2, 3, 10, 20, 30}).axes;
+    Vec3d v(1, -2, 0.5);
+    EXPECT_NEAR(quadForm(m, v), quadForm(rotateSym(m, r), r * v), 1e-9);
+}
@@ -0,0 +1,93 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "camera_glyph_bank.h"
+
+using namespace picopter;
+
+class GlyphBankTest : public ::testing::Test {
+    protected:
+        GlyphBankTest() {
+            LogInit();
+        }
+
+        /** A random glyph (blocky, like a real one). **/
+        static std::vector<uint8_t> RandomGlyph() {
+            const int n = GLYPH_BANK_SIZE, cell = n / 8;
+            std::vector<uint8_t> img(n * n);
+            bool cells[8][8];
+            for (int i = 0; i < 8; i++) {
+                for (int j = 0; j < 8; j++) {
+                    cells[i][j] = rand() % 2;
+                }
+            }
+            for (int y = 0; y < n; y++) {
+                for (int x = 0; x < n; x++) {
+                    img[y * n + x] = cells[y / cell][x / cell] ? 255 : 0;
+                }
+            }
+            return img;
+        }
+
+        /** Turns an image a quarter clockwise. **/
+        static std::vector<uint8_t> Turn(const std::vector<uint8_t> &img) {
+            const int n = GLYPH_BANK_SIZE;
+            std::vector<uint8_t> out(n * n);
+            for (int y = 0; y < n; y++) {
+                for (int x = 0; x < n; x++) {
+                    out[y * n + x] = img[(n - 1 - x) * n + y];
+                }
+            }
+            return out;
+        }
+};
+
+TEST_F(GlyphBankTest, TestMatch) {
+    const int n = GLYPH_BANK_SIZE;
+    std::vector<std::vector<uint8_t>> glyphs;
+    GlyphBank bank;
+    GlyphMatch match;
+
+    srand(1234);
+    ASSERT_FALSE(bank.Match(RandomGlyph().data(), n, 0.5, &match));
+    for (int i = 0; i < 20; i++) {
+        glyphs.push_back(RandomGlyph());
+        bank.Add(glyphs.back().data(), n);
+    }
+    ASSERT_EQ(20u, bank.Size());
+
+    for (int i = 0; i < 20; i++) {
+        std::vector<uint8_t> img = glyphs[i];
+        for (int r = 0; r < 4; r++) {
+            ASSERT_TRUE(bank.Match(img.data(), n, 0.9, &match));
+            EXPECT_EQ(i, match.index);
+            EXPECT_EQ(r, match.rotation);
+            EXPECT_DOUBLE_EQ(1.0, match.similarity);
+            img = Turn(img);
+        }
+    }
+
+    //Noisy (5% of pixels flipped) in a padded buffer.
+    const int stride = n + 3;
+    std::vector<uint8_t> noisy(stride * n);
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            noisy[y * stride + x] = glyphs[7][y * n + x] ^ ((rand() % 20) == 0 ? 255 : 0);
+        }
+    }
+    ASSERT_TRUE(bank.Match(noisy.data(), stride, 0.9, &match));
+    EXPECT_EQ(7, match.index);
+    EXPECT_EQ(0, match.rotation);
+    EXPECT_GT(match.similarity, 0.9);
+    EXPECT_LT(match.similarity, 1.0);
+    EXPECT_FALSE(bank.Match(noisy.data(), stride, 0.999, &match));
+
+    //A glyph that is a turn of another is found as itself, not as a turn.
+    std::vector<uint8_t> turned = Turn(glyphs[3]);
+    bank.Add(turned.data(), n);
+    ASSERT_TRUE(bank.Match(turned.data(), n, 0.9, &match));
+    EXPECT_EQ(20, match.index);
+    EXPECT_EQ(0, match.rotation);
+
+    bank.Clear();
+    EXPECT_EQ(0u, bank.Size());
+}
@@ -0,0 +1,72 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "latest_value.h"
+
+using namespace picopter;
+using std::this_thread::sleep_for;
+using std::chrono::milliseconds;
+
+typedef struct Triple {
+    double a, b, c;
+} Triple;
+
+TEST(LatestValueTest, TestSamples) {
+    LatestValue<Triple> cell(Triple{-1, -1, -1});
+    Triple t;
+    SampleInfo info;
+
+    //Nothing stored yet.
+    EXPECT_FALSE(cell.Load(&t, &info));
+    EXPECT_EQ(0u, info.seq);
+    EXPECT_EQ(-1, t.a);
+    EXPECT_TRUE(cell.IsStale(milliseconds(1000)));
+
+    auto before = SampleClock::now();
+    cell.Store(Triple{1, 2, 3});
+    EXPECT_TRUE(cell.Load(&t, &info));
+    EXPECT_EQ(1u, info.seq);
+    EXPECT_GE(info.time, before);
+    EXPECT_EQ(3, t.c);
+    EXPECT_FALSE(cell.IsStale(milliseconds(1000)));
+
+    cell.Store(Triple{4, 5, 6});
+    EXPECT_EQ(2u, cell.Sequence());
+    sleep_for(milliseconds(30));
+    EXPECT_GE(cell.Age(), milliseconds(30));
+    EXPECT_TRUE(cell.IsStale(milliseconds(20)));
+}
+
+TEST(LatestValueTest, TestConcurrentReaders) {
+    LatestValue<Triple> cell;
+    std::atomic<bool> stop{false};
+    std::atomic<int> torn{0};
+    std::vector<std::thread> readers;
+
+    for (int i = 0; i < 3; i++) {
+        readers.emplace_back([&] {
+            uint64_t last = 0;
+            while (!stop) {
+                Triple t;
+                SampleInfo info;
+                cell.Load(&t, &info);
+                //Every value read must be one that was stored whole, and
+                //samples must never go backwards.
+                if (t.a != t.b || t.b != t.c || info.seq < last) {
+                    torn++;
+                }
+                last = info.seq;
+            }
+        });
+    }
+
+    for (int i = 1; i <= 100000; i++) {
+        cell.Store(Triple{double(i), double(i), double(i)});
+    }
+    stop = true;
+    for (std::thread &t : readers) {
+        t.join();
+    }
+
+    EXPECT_EQ(0, torn);
+    EXPECT_EQ(100000u, cell.Sequence());
+}
@@ -0,0 +1,119 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "message_bus.h"
+
+using namespace picopter;
+using std::this_thread::sleep_for;
+using std::chrono::milliseconds;
+
+class MessageBusTest : public ::testing::Test {
+    protected:
+        MessageBusTest() {
+            LogInit();
+        }
+
+        static mavlink_message_t Message(int msgid) {
+            mavlink_message_t msg = {};
+            msg.msgid = msgid;
+            return msg;
+        }
+};
+
+TEST_F(MessageBusTest, TestSubscribers) {
+    MessageBus bus;
+    int a = 0, b = 0, other = 0;
+    int ida = bus.Subscribe(30, [&a](const mavlink_message_t*) { a++; }, DELIVER_INLINE);
+    bus.Subscribe(30, [&b](const mavlink_message_t*) { b++; }, DELIVER_INLINE);
+    bus.Subscribe(33, [&other](const mavlink_message_t*) { other++; }, DELIVER_INLINE);
+    EXPECT_EQ(-1, bus.Subscribe(MESSAGE_BUS_TOPICS, [](const mavlink_message_t*) {}, DELIVER_INLINE));
+
+    mavlink_message_t msg = Message(30);
+    bus.Publish(&msg);
+    EXPECT_EQ(1, a);
+    EXPECT_EQ(1, b);
+    EXPECT_EQ(0, other);
+
+    bus.Unsubscribe(ida);
+    bus.Publish(&msg);
+    EXPECT_EQ(1, a);
+    EXPECT_EQ(2, b);
+
+    MessageBusStats stats;
+    bus.GetStats(30, &stats);
+    EXPECT_EQ(2u, stats.published);
+    EXPECT_EQ(3u, stats.delivered);
+    EXPECT_EQ(0u, stats.dropped);
+}
+
+TEST_F(MessageBusTest, TestQueued) {
+    MessageBus bus;
+    std::atomic<int> count{0};
+    std::thread::id publisher = std::this_thread::get_id(), caller;
+
+    //A slow subscriber doesn't hold up the publisher.
+    bus.Subscribe(74, [&](const mavlink_message_t *msg) {
+        caller = std::this_thread::get_id();
+        sleep_for(milliseconds(20));
+        count++;
+    }, DELIVER_QUEUED);
+
+    mavlink_message_t msg = Message(74);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 5; i++) {
+        bus.Publish(&msg);
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, milliseconds(20));
+
+    for (int i = 0; i < 100 && count < 5; i++) {
+        sleep_for(milliseconds(10));
+    }
+    EXPECT_EQ(5, count);
+    EXPECT_NE(publisher, caller);
+
+    MessageBusStats stats;
+    bus.GetStats(74, &stats);
+    EXPECT_EQ(5u, stats.delivered);
+    EXPECT_GE(stats.max_latency, 20);
+    EXPECT_LE(stats.mean_latency, stats.max_latency);
+}
+
+TEST_F(MessageBusTest, TestUnsubscribeWaits) {
+    MessageBus bus;
+    std::atomic<bool> entered{false}, finished{false};
+    int id = bus.Subscribe(30, [&](const mavlink_message_t*) {
+        entered = true;
+        sleep_for(milliseconds(50));
+        finished = true;
+    }, DELIVER_INLINE);
+
+    //Unsubscribing while an inline call is running waits for it.
+    mavlink_message_t msg = Message(30);
+    std::thread publisher([&bus, &msg] { bus.Publish(&msg); });
+    while (!entered) {
+        sleep_for(milliseconds(1));
+    }
+    bus.Unsubscribe(id);
+    EXPECT_TRUE(finished);
+    publisher.join();
+
+    //A handler can unsubscribe itself, inline or queued.
+    std::atomic<int> count{0};
+    int inline_id = -1, queued_id = -1;
+    inline_id = bus.Subscribe(31, [&](const mavlink_message_t*) {
+        count++;
+        bus.Unsubscribe(inline_id);
+    }, DELIVER_INLINE);
+    queued_id = bus.Subscribe(31, [&](const mavlink_message_t*) {
+        count++;
+        bus.Unsubscribe(queued_id);
+    }, DELIVER_QUEUED);
+
+    msg = Message(31);
+    bus.Publish(&msg);
+    for (int i = 0; i < 100 && count < 2; i++) {
+        sleep_for(milliseconds(10));
+    }
+    bus.Publish(&msg);
+    sleep_for(milliseconds(20));
+    EXPECT_EQ(2, count);
+}
@@ -0,0 +1,71 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "mjpeg_server.h"
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace picopter;
+
+class MJPEGServerTest : public ::testing::Test {
+    protected:
+        MJPEGServerTest() {
+            LogInit();
+        }
+
+        /** Connects to the server and sends a request. **/
+        static int Request(uint16_t port, const char *request) {
+            struct sockaddr_in addr = {0};
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            struct timeval timeout = {5, 0};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            EXPECT_EQ(0, connect(fd, (struct sockaddr *)&addr, sizeof(addr)));
+            EXPECT_EQ((ssize_t)strlen(request), write(fd, request, strlen(request)));
+            return fd;
+        }
+
+        /** Publishes frames until the response contains the given text. **/
+        static std::string ReadUntil(MJPEGServer &server, int fd, const std::string &text) {
+            std::string response;
+            char buffer[256];
+            for (int i = 0; i < 100 && response.find(text) == std::string::npos; i++) {
+                std::vector<uint8_t> frame{'J', 'P', 'E', 'G'};
+                server.Publish(&frame);
+                ssize_t ret = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (ret > 0) {
+                    response.append(buffer, ret);
+                } else if (ret == 0) {
+                    break;
+                }
+                usleep(10000);
+            }
+            return response;
+        }
+};
+
+TEST_F(MJPEGServerTest, TestRequests) {
+    MJPEGServer server(0);
+    ASSERT_NE(0, server.GetPort());
+
+    int fd = Request(server.GetPort(), "GET /?action=snapshot HTTP/1.1\r\nHost: x\r\n\r\n");
+    std::string response = ReadUntil(server, fd, "JPEG");
+    EXPECT_EQ(0u, response.find("HTTP/1.0 200 OK\r\n"));
+    EXPECT_NE(std::string::npos, response.find("Content-Type: image/jpeg\r\n"));
+    EXPECT_NE(std::string::npos, response.find("Content-Length: 4\r\n\r\nJPEG"));
+    close(fd);
+
+    fd = Request(server.GetPort(), "GET /?action=stream HTTP/1.1\r\n\r\n");
+    response = ReadUntil(server, fd, "JPEG\r\n--picopterframe");
+    EXPECT_NE(std::string::npos, response.find("multipart/x-mixed-replace"));
+    EXPECT_NE(std::string::npos, response.find("--picopterframe\r\n"
+        "Content-Type: image/jpeg\r\nContent-Length: 4\r\n\r\nJPEG\r\n"));
+    close(fd);
+
+    fd = Request(server.GetPort(), "GET /nothing HTTP/1.1\r\n\r\n");
+    response = ReadUntil(server, fd, "\r\n\r\n");
+    EXPECT_EQ(0u, response.find("HTTP/1.0 404 Not Found\r\n"));
+    close(fd);
+}
@@ -0,0 +1,78 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "reactor.h"
+#include <unistd.h>
+
+using namespace picopter;
+using std::this_thread::sleep_for;
+using std::chrono::milliseconds;
+
+class ReactorTest : public ::testing::Test {
+    protected:
+        ReactorTest() {
+            LogInit();
+        }
+};
+
+TEST_F(ReactorTest, TestTimer) {
+    Reactor r;
+    std::atomic<int> ticks{0};
+    int id = r.AddTimer(10, [&ticks] { ticks++; });
+    ASSERT_GE(id, 0);
+
+    r.Start();
+    sleep_for(milliseconds(105));
+    EXPECT_GE(ticks, 5);
+    EXPECT_LE(ticks, 11);
+
+    //Nothing more once removed.
+    r.Remove(id);
+    int last = ticks;
+    sleep_for(milliseconds(50));
+    EXPECT_EQ(last, ticks);
+}
+
+TEST_F(ReactorTest, TestResetTimer) {
+    Reactor r;
+    std::atomic<int> ticks{0};
+    int id = r.AddTimer(60, [&ticks] { ticks++; });
+    r.Start();
+
+    //Keep touching it, like a watchdog; it should never expire.
+    for (int i = 0; i < 10; i++) {
+        sleep_for(milliseconds(20));
+        EXPECT_TRUE(r.ResetTimer(id));
+    }
+    EXPECT_EQ(0, ticks);
+    sleep_for(milliseconds(100));
+    EXPECT_GE(ticks, 1);
+    EXPECT_FALSE(r.ResetTimer(-1));
+}
+
+TEST_F(ReactorTest, TestDescriptor) {
+    Reactor r;
+    int fds[2];
+    std::atomic<int> bytes{0};
+    ASSERT_EQ(0, pipe(fds));
+
+    ASSERT_GE(r.AddDescriptor(fds[0], [&bytes, &fds] {
+        char buf[16];
+        ssize_t ret = read(fds[0], buf, sizeof(buf));
+        if (ret > 0) {
+            bytes += ret;
+        }
+    }), 0);
+    r.Start();
+
+    ASSERT_EQ(3, write(fds[1], "abc", 3));
+    ASSERT_EQ(2, write(fds[1], "de", 2));
+    for (int i = 0; i < 100 && bytes < 5; i++) {
+        sleep_for(milliseconds(1));
+    }
+    EXPECT_EQ(5, bytes);
+
+    //Stopping doesn't wait on anything.
+    r.Stop();
+    close(fds[0]);
+    close(fds[1]);
+}
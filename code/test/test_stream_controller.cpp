@@ -0,0 +1,70 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "stream_controller.h"
+
+using namespace picopter;
+
+class StreamControllerTest : public ::testing::Test {
+    protected:
+        StreamControllerTest() {
+            LogInit();
+        }
+
+        /**
+         * Simulates a window of frames at the given rate and cost. Encoding
+         * cost scales with the stream area, as it does for JPEG.
+         */
+        static void Simulate(StreamController &c, double *now, double fps,
+            double process_ms, double full_encode_ms)
+        {
+            for (int i = 0; i < STREAM_CONTROL_WINDOW; i++) {
+                StreamSettings s = c.GetSettings();
+                *now += 1000.0 / fps;
+                if (i % s.skip == 0) {
+                    c.AddStreamed(full_encode_ms * s.scale * s.scale / 10000.0);
+                }
+                c.AddProcessed(*now, process_ms);
+            }
+        }
+};
+
+TEST_F(StreamControllerTest, TestAdapts) {
+    StreamController c(10, 75, true);
+    double now = 0;
+    c.AddProcessed(now, 0);
+
+    //Detection is below the floor: the stream should back off to cheapest.
+    for (int i = 0; i < 10; i++) {
+        Simulate(c, &now, 5, 150, 40);
+    }
+    StreamSettings cheap = c.GetSettings();
+    EXPECT_EQ(15, cheap.skip);
+    EXPECT_EQ(50, cheap.scale);
+    EXPECT_EQ(40, cheap.quality);
+
+    //Plenty of headroom: it should improve, but only after a hold period.
+    Simulate(c, &now, 30, 5, 10);
+    EXPECT_EQ(cheap.skip, c.GetSettings().skip);
+    for (int i = 0; i < 100; i++) {
+        Simulate(c, &now, 30, 5, 10);
+    }
+    StreamSettings best = c.GetSettings();
+    EXPECT_EQ(1, best.skip);
+    EXPECT_EQ(100, best.scale);
+    EXPECT_EQ(75, best.quality);
+
+    //Encoding every frame eats the budget: it should settle in between.
+    for (int i = 0; i < 100; i++) {
+        Simulate(c, &now, 30, 60, 60);
+    }
+    StreamSettings mid = c.GetSettings();
+    EXPECT_GT(mid.skip, 1);
+    EXPECT_LT(mid.skip, 15);
+
+    //Fixed settings when not adaptive.
+    c.SetAdaptive(false);
+    Simulate(c, &now, 5, 150, 40);
+    EXPECT_EQ(5, c.GetSettings().skip);
+    EXPECT_EQ(100, c.GetSettings().scale);
+    EXPECT_EQ(75, c.GetSettings().quality);
+}
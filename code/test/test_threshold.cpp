@@ -0,0 +1,156 @@
+#include "gtest/gtest.h"
+#include "picopter.h"
+#include "camera_threshold.h"
+
+using namespace picopter;
+
+class ThresholdTest : public ::testing::Test {
+    protected:
+        ThresholdTest() {
+            LogInit();
+
+            //Random input and a random 0/255 table.
+            srand(1234);
+            for (size_t i = 0; i < sizeof(lut); i++) {
+                lut[i] = (rand() & 1) ? 255 : 0;
+            }
+            src.resize(4 * 323 * 4);
+            for (size_t i = 0; i < src.size(); i++) {
+                src[i] = rand() & 0xFF;
+            }
+            bits.resize(THRESH_FULL_SIZE);
+            for (size_t i = 0; i < bits.size(); i++) {
+                bits[i] = rand() & 0xFF;
+            }
+        }
+
+        /** Builds channel masks for a hue/luma range and fixed other channels. **/
+        static ThresholdChannels MakeChannels(ThresholdColourspace colourspace, int p1_min, int p1_max) {
+            ThresholdChannels channels;
+            channels.colourspace = colourspace;
+            for (int v = 0; v < 256; v++) {
+                if (p1_min < 0) {
+                    channels.accept[0][v] = (v >= p1_min + 180 && v <= 180) || v <= p1_max;
+                } else {
+                    channels.accept[0][v] = v >= p1_min && v <= p1_max;
+                }
+                channels.accept[1][v] = v >= 95;
+                channels.accept[2][v] = v >= 127 && v <= 240;
+            }
+            return channels;
+        }
+
+        /** Checks every colour of the table against a direct conversion. **/
+        static void CheckTable(ThresholdBitTable &table, const ThresholdChannels &channels) {
+            int handle;
+            const uint8_t *t = table.Acquire(&handle);
+            ASSERT_TRUE(t != nullptr);
+            for (int r = 0; r < 256; r++) {
+                for (int g = 0; g < 256; g++) {
+                    for (int b = 0; b < 256; b++) {
+                        uint8_t c[3];
+                        if (channels.colourspace == THRESH_HSV) {
+                            RGB2HSV(r, g, b, &c[0], &c[1], &c[2]);
+                        } else {
+                            RGB2YCbCr(r, g, b, &c[0], &c[1], &c[2]);
+                        }
+                        bool expected = channels.accept[0][c[0]] &&
+                            channels.accept[1][c[1]] && channels.accept[2][c[2]];
+                        int idx = (r << 16) | (g << 8) | b;
+                        bool actual = (t[idx >> 3] >> (idx & 7)) & 1;
+                        ASSERT_EQ(expected, actual) << r << "," << g << "," << b;
+                    }
+                }
+            }
+            table.Release(handle);
+        }
+
+        void CompareKernel(ThresholdKernelType type) {
+            CompareKernel(type, THRESH_TABLE_BINNED, lut);
+            CompareKernel(type, THRESH_TABLE_FULL, bits.data());
+        }
+
+        void CompareKernel(ThresholdKernelType type, ThresholdTableType table, const uint8_t *lut) {
+            ThresholdKernel ref = GetThresholdKernel(THRESH_KERNEL_SCALAR, table);
+            ThresholdKernel kernel = GetThresholdKernel(type, table);
+            if (!kernel) {
+                return; //Not supported on this machine.
+            }
+
+            for (int stride = 3; stride <= 12; stride += 3) {
+                for (int width = 0; width < 323; width++) {
+                    std::vector<uint8_t> expected(width), actual(width);
+                    //Place the row at the end of the buffer to catch overreads.
+                    const uint8_t *row = &src[src.size() - ((width - 1) * stride + 3)];
+                    if (width == 0) {
+                        row = &src[0];
+                    }
+                    ref(row, expected.data(), width, stride, lut);
+                    kernel(row, actual.data(), width, stride, lut);
+                    ASSERT_EQ(expected, actual) << GetThresholdKernelName(type)
+                        << " stride " << stride << " width " << width;
+                }
+            }
+        }
+
+        uint8_t lut[THRESH_SIZE * THRESH_SIZE * THRESH_SIZE];
+        std::vector<uint8_t> bits;
+        std::vector<uint8_t> src;
+};
+
+TEST_F(ThresholdTest, TestScalarLookup) {
+    const uint8_t px[] = {0x1F, 0x2F, 0x3F, 0xF0, 0xE0, 0xD0};
+    uint8_t out[2];
+
+    memset(lut, 0, sizeof(lut));
+    lut[(0x3 << 8) | (0x2 << 4) | 0x1] = 255;
+    lut[(0xD << 8) | (0xE << 4) | 0xF] = 255;
+    GetThresholdKernel(THRESH_KERNEL_SCALAR)(px, out, 2, 3, lut);
+    EXPECT_EQ(255, out[0]);
+    EXPECT_EQ(255, out[1]);
+}
+
+TEST_F(ThresholdTest, TestSSE2) {
+    CompareKernel(THRESH_KERNEL_SSE2);
+}
+
+TEST_F(ThresholdTest, TestAVX2) {
+    CompareKernel(THRESH_KERNEL_AVX2);
+}
+
+TEST_F(ThresholdTest, TestNEON) {
+    CompareKernel(THRESH_KERNEL_NEON);
+}
+
+TEST_F(ThresholdTest, TestBestKernel) {
+    EXPECT_TRUE(GetThresholdKernel(GetBestThresholdKernel()) != nullptr);
+}
+
+TEST_F(ThresholdTest, TestBitTable) {
+    ThresholdBitTable table;
+    int handle;
+
+    EXPECT_TRUE(table.Acquire(&handle) == nullptr);
+
+    ThresholdChannels channels = MakeChannels(THRESH_HSV, -10, 10);
+    table.Update(channels);
+    table.Flush();
+    CheckTable(table, channels);
+
+    //Incremental rebuilds (each buffer is updated from its own old state).
+    channels = MakeChannels(THRESH_HSV, 20, 40);
+    table.Update(channels);
+    table.Flush();
+    CheckTable(table, channels);
+
+    channels = MakeChannels(THRESH_HSV, 30, 60);
+    table.Update(channels);
+    table.Flush();
+    CheckTable(table, channels);
+
+    //Change of colourspace.
+    channels = MakeChannels(THRESH_YCbCr, 0, 200);
+    table.Update(channels);
+    table.Flush();
+    CheckTable(table, channels);
+}
@@ -15,17 +15,30 @@
 			"INPUT_HEIGHT" => NULL,
 			"PROCESS_WIDTH" => NULL,
 			"STREAM_WIDTH" => NULL,
+			"STREAM_PORT" => NULL,
+			"STREAM_ADAPTIVE" => NULL,
+			"STREAM_MIN_FPS" => NULL,
+			"STREAM_MAX_QUALITY" => NULL,
 			"BOX_SIZE" => NULL,
 			"LEARN_SIZE" => NULL,
 			"LEARN_HUE_WIDTH" => NULL,
 			"THREAD_SLEEP_TIME" => NULL,
 			"DILATE_ELEMENT" => NULL,
 			"ERODE_ELEMENT" => NULL,
-			"PIXEL_THRESHOLD" => NULL
+			"PIXEL_THRESHOLD" => NULL,
+			"ROI_TRACKING" => NULL,
+			"ROI_MAX_MISSES" => NULL,
+			"ROI_FULL_INTERVAL" => NULL,
+			"ROI_MARGIN" => NULL,
+			"HOG_STRIDE" => NULL
 		),
 		"GPS" => array(
 			"FIX_TIMEOUT" => NULL,
-			"CYCLE_TIMEOUT" => NULL
+			"CYCLE_TIMEOUT" => NULL,
+			"RATE" => NULL
+		),
+		"IMU" => array(
+			"RATE" => NULL
 		),
 		"OBJECT_TRACKER" => array(
 			"TRACK_Kpw" => NULL,
@@ -47,7 +60,12 @@
 			"TRACK_SETPOINT_W" => NULL,
 			"TRACK_SETPOINT_X" => NULL,
 			"TRACK_SETPOINT_Y" => NULL,
-			"TRACK_SETPOINT_Z" => NULL
+			"TRACK_SETPOINT_Z" => NULL,
+			"LOG_SIGHTINGS" => NULL,
+			"ASSOCIATION_GATE" => NULL,
+			"TRACK_CONFIRM_DETECTIONS" => NULL,
+			"TRACK_TENTATIVE_TIMEOUT" => NULL,
+			"TRACK_LOST_TIMEOUT" => NULL
 		),
 		"WAYPOINTS" => array(
 			"SIMPLE_Kpxy" => NULL,